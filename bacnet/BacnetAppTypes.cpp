@@ -11,8 +11,7 @@ namespace VIGBACNET {
 
 
 bool Null::set(const BacnetValue &value, bool throwError) {
-	Null *v = dynamic_cast<Null*>(
-			const_cast<BacnetValue*>(&value));
+	const Null *v = primitive_cast<Null>(value);
 	if (v) {
 		*this = *v;
 		valueDirty();
@@ -40,8 +39,7 @@ void OctetString::set(const OctetBuffer& buffer) {
 }
 
 bool OctetString::set(const BacnetValue &value, bool throwError) {
-	OctetString *v = dynamic_cast<OctetString*>(
-			const_cast<BacnetValue*>(&value));
+	const OctetString *v = primitive_cast<OctetString>(value);
 	if (v) {
 		*this = *v;
 		valueDirty();
@@ -126,8 +124,7 @@ void CharacterString::set(const std::string str) {
 }
 
 bool CharacterString::set(const BacnetValue &value, bool throwError) {
-	CharacterString *v = dynamic_cast<CharacterString*>(
-			const_cast<BacnetValue*>(&value));
+	const CharacterString *v = primitive_cast<CharacterString>(value);
 	if (v) {
 		*this = *v;
 		valueDirty();
@@ -174,7 +171,6 @@ BitString& BitString::operator=(const BitString &value) {
 }
 
 bool BitString::get(uint8_t* buffer, size_t size) const {
-	FC_Debug(*this);
 	if (byteLength() <= size) {
 		const uint8_t InitMask = 0x80;
 		uint8_t mask = InitMask;
@@ -208,8 +204,7 @@ void BitString::set(const BitBuffer& buffer) {
 }
 
 bool BitString::set(const BacnetValue &value, bool throwError) {
-	BitString *v = dynamic_cast<BitString*>(
-			const_cast<BacnetValue*>(&value));
+	const BitString *v = primitive_cast<BitString>(value);
 	if (v) {
 		*this = *v;
 		valueDirty();
@@ -369,8 +364,7 @@ void Date::set(const struct tm& date) {
 }
 
 bool Date::set(const BacnetValue &value, bool throwError) {
-	Date *v = dynamic_cast<Date*>(
-			const_cast<BacnetValue*>(&value));
+	const Date *v = primitive_cast<Date>(value);
 	if (v) {
 		*this = *v;
 		valueDirty();
@@ -520,8 +514,7 @@ void Time::set(time_t now) {
 }
 
 bool Time::set(const BacnetValue &value, bool throwError) {
-	Time *v = dynamic_cast<Time*>(
-			const_cast<BacnetValue*>(&value));
+	const Time *v = primitive_cast<Time>(value);
 	if (v) {
 		*this = *v;
 		valueDirty();
@@ -650,8 +643,7 @@ void ObjectIdentifier::set(uint32_t oid) {
 }
 
 bool ObjectIdentifier::set(const BacnetValue &value, bool throwError) {
-	ObjectIdentifier *v = dynamic_cast<ObjectIdentifier*>(
-			const_cast<BacnetValue*>(&value));
+	const ObjectIdentifier *v = primitive_cast<ObjectIdentifier>(value);
 	if (v) {
 		*this = *v;
 		valueDirty();
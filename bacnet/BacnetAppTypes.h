@@ -51,6 +51,9 @@ public:
 
 	virtual size_t length() const { return 0; }
 	virtual DataTypeEnum type() const { return TypeId; }
+	virtual const void* primitive(DataTypeEnum::Enum id) const {
+		return id == TypeId ? this : 0;
+	}
 	int get() const { return 0; }
 
 	virtual bool set(const BacnetValue &value, bool throwError=true);
@@ -78,6 +81,7 @@ template<typename T, DataTypeEnum::Enum ID>
 class ScalarType : public virtual PrimitiveValue {
 public:
 	static const DataTypeEnum::Enum TypeId = ID;
+	typedef T ValueType;
 
 	ScalarType() :
 		_value(0) {}
@@ -113,6 +117,9 @@ public:
 
 	virtual size_t length() const { return sizeof(T); }
 	virtual DataTypeEnum type() const { return TypeId; }
+	virtual const void* primitive(DataTypeEnum::Enum id) const {
+		return id == TypeId ? this : 0;
+	}
 
 	T get() const { return _value; }
 
@@ -125,8 +132,7 @@ public:
 	}
 
 	virtual bool set(const BacnetValue &value, bool throwError=true) {
-		ScalarType *v = dynamic_cast<ScalarType*>(
-				const_cast<BacnetValue*>(&value));
+		const ScalarType *v = primitive_cast<ScalarType>(value);
 		if (v) {
 			*this = *v;
 			valueDirty();
@@ -202,6 +208,9 @@ public:
 
 	virtual size_t length() const { return _buffer.size(); }
 	virtual DataTypeEnum type() const { return TypeId; }
+	virtual const void* primitive(DataTypeEnum::Enum id) const {
+		return id == TypeId ? this : 0;
+	}
 
 	const OctetBuffer& get() const { return _buffer; }
 	void set(const OctetBuffer& buffer);
@@ -262,6 +271,9 @@ public:
 
 	virtual size_t length() const { return _str.length(); }
 	virtual DataTypeEnum type() const { return TypeId; }
+	virtual const void* primitive(DataTypeEnum::Enum id) const {
+		return id == TypeId ? this : 0;
+	}
 
 	const std::string& get() const { return _str; }
 	void set(const std::string str);
@@ -316,6 +328,9 @@ public:
 		return (size_t)(std::ceil((double)_buffer.size() / 8.0));
 	}
 	virtual DataTypeEnum type() const { return TypeId; }
+	virtual const void* primitive(DataTypeEnum::Enum id) const {
+		return id == TypeId ? this : 0;
+	}
 	const BitBuffer& get() const { return _buffer; }
 	bool get(size_t idx) const {
 		return _buffer.at(idx);
@@ -390,6 +405,9 @@ public:
 
 	size_t length() const { return 4; }
 	DataTypeEnum type() const { return TypeId; }
+	const void* primitive(DataTypeEnum::Enum id) const {
+		return id == TypeId ? this : 0;
+	}
 	size_t encode(uint8_t* buffer, size_t size) const;
 
 	bool operator==(const Date& rh) const;
@@ -460,6 +478,9 @@ public:
 
 	size_t length() const { return 4; }
 	DataTypeEnum type() const { return TypeId; }
+	const void* primitive(DataTypeEnum::Enum id) const {
+		return id == TypeId ? this : 0;
+	}
 
 	size_t encode(uint8_t* buffer, size_t size) const;
 
@@ -515,6 +536,9 @@ public:
 
 	size_t length() const { return 4; }
 	DataTypeEnum type() const { return TypeId; }
+	const void* primitive(DataTypeEnum::Enum id) const {
+		return id == TypeId ? this : 0;
+	}
 
 	ObjectIdentifier get() const {
 		return *this;
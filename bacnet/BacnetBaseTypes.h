@@ -7,6 +7,7 @@
 #ifndef BacnetBaseTypes_h
 #define BacnetBaseTypes_h
 
+#include <string.h>
 #include <vector>
 #include "BacnetUtils.h"
 #include "BacnetAppTypes.h"
@@ -57,7 +58,7 @@ struct EnumBaseType : public virtual Enumerated, public virtual T {
 	 *
 	 * If both type are identical no check is done on the value, however if the base type
 	 * is an Enumuerated, we make sure the value is compatible with the enum value for that
-	 * specific type
+	 * specific type.  The enum types are told apart by their type name, which is unique.
 	 *
 	 * @param value the bacnet value to copy data from
 	 * @param throwError flag to tell if the conversion should throw if cannot convert the value
@@ -65,29 +66,26 @@ struct EnumBaseType : public virtual Enumerated, public virtual T {
 	 * return true if successful conversion
 	 */
 	virtual bool set(const BacnetValue &value, bool throwError=true) {
-		bool result = false;
-		EnumBaseType *v = dynamic_cast<EnumBaseType*>(const_cast<BacnetValue*>(&value));
-		if (v) {
-			*this = *v;
-			valueDirty();
-			result = true;
-		} else {
-			unsigned u;
-			// try to convert to an enum value
-			if (ValueGetter::get(value, u, false)) {
-				if (std::string(getName((Enum)u)) != "Unknown") {
-					Enumerated::set(u);
-					result = true;
-				} else if (throwError) {
-					throwException(BacnetErrorException(ErrorClassEnum::Property,
-							ErrorCodeEnum::ValueOutOfRange,
-							FC::StringAPrintf("%d is not a valid value for type %s",u, typeName())));
-				}
-			} else if (throwError) {
-				throwException(getErrorTypeException(value.typeName()));
+		unsigned u = 0;
+		BacnetStatus status = assign(value, u);
+		if (!status.ok() && throwError) {
+			if (status.eCode() == ErrorCodeEnum::ValueOutOfRange) {
+				throwException(BacnetErrorException(ErrorClassEnum::Property,
+						ErrorCodeEnum::ValueOutOfRange,
+						FC::StringAPrintf("%d is not a valid value for type %s",u, typeName())));
 			}
+			throwException(getErrorTypeException(value.typeName()));
 		}
-		return result;
+		return status.ok();
+	}
+
+	/**
+	 * Same as set but a number which is not a value of the enum answers
+	 * ValueOutOfRange instead of throwing
+	 */
+	virtual BacnetStatus trySet(const BacnetValue &value) {
+		unsigned u = 0;
+		return assign(value, u);
 	}
 
 	virtual const char* typeName() const {
@@ -146,6 +144,29 @@ struct EnumBaseType : public virtual Enumerated, public virtual T {
 	virtual BacnetValueRef clone() const {
 		return new EnumBaseType(*this);
 	}
+
+private:
+	/**
+	 * Convert and store {value}, see set
+	 * {u} receives the number converted from {value}, for the error message.
+	 */
+	BacnetStatus assign(const BacnetValue &value, unsigned& u) {
+		const Enumerated *v = primitive_cast<Enumerated>(value);
+		if (v && !strcmp(value.typeName(), typeName())) {
+			Enumerated::set(v->get());
+			valueDirty();
+			return BacnetStatus();
+		}
+		// try to convert to an enum value
+		if (!ValueGetter::get(value, u, false)) {
+			return BacnetStatus(ErrorClassEnum::Property, ErrorCodeEnum::InvalidDataType);
+		}
+		if (!EnumTable<T>::isValid(u)) {
+			return BacnetStatus(ErrorClassEnum::Property, ErrorCodeEnum::ValueOutOfRange);
+		}
+		Enumerated::set(u);
+		return BacnetStatus();
+	}
 };
 
 
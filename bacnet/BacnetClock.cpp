@@ -0,0 +1,15 @@
+/*
+ * BacnetClock.cpp
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#include "BacnetClock.h"
+
+namespace VIGBACNET {
+
+volatile uint64_t TickClock::_now = 0;
+volatile uint64_t TickClock::_stamp = 0;
+volatile uint32_t TickClock::_loops = 0;
+
+} // VIGBACNET
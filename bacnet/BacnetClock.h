@@ -0,0 +1,91 @@
+/*
+ * BacnetClock.h
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#ifndef BacnetClock_h
+#define BacnetClock_h
+
+#include <time.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace VIGBACNET {
+
+/**
+ * Monotonic clock for measuring durations
+ * Unlike the wall clock it never goes backward when the system time is set.
+ */
+class Clock {
+public:
+	static uint64_t now() {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+	}
+};
+
+/**
+ * Monotonic clock read once per server tick
+ * Reading it is a memory load, cheap enough for every value change.  The started
+ * servers advance it at each work tick, while none runs it falls back to Clock so it
+ * never stays at the time of the last tick.  stamp gives
+ * strictly increasing values so changes made within one tick keep their order, it
+ * runs ahead of the tick time by one nanosecond per stamp and tick never moves it back.
+ */
+class TickClock {
+public:
+	static uint64_t now() {
+		uint64_t now = _now;
+		return now ? now : Clock::now();
+	}
+
+	static uint64_t stamp() {
+		if (!_now) {
+			return Clock::now();
+		}
+		return __sync_add_and_fetch(&_stamp, 1);
+	}
+
+	/**
+	 * Read the clock for the next tick, return the tick time
+	 * The time is only kept while a tick loop runs.
+	 */
+	static uint64_t tick() {
+		uint64_t now = Clock::now();
+		uint64_t stamp = _stamp;
+		while (stamp < now && !__sync_bool_compare_and_swap(&_stamp, stamp, now)) {
+			stamp = _stamp;
+		}
+		if (_loops) {
+			_now = now;
+		}
+		return now;
+	}
+
+	/**
+	 * Count a tick loop starting, return the first tick time
+	 */
+	static uint64_t startLoop() {
+		__sync_fetch_and_add(&_loops, 1);
+		return tick();
+	}
+	/**
+	 * Count a tick loop stopped, the last one sends the readers back to Clock
+	 */
+	static void stopLoop() {
+		if (__sync_sub_and_fetch(&_loops, 1) == 0) {
+			_now = 0;
+		}
+	}
+
+private:
+	static volatile uint64_t _now;
+	static volatile uint64_t _stamp;
+	static volatile uint32_t _loops;
+};
+
+} // VIGBACNET
+
+#endif /* BACNETCLOCK_H_ */
@@ -0,0 +1,353 @@
+/*
+ * BacnetCompactValue.cpp
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <typeinfo>
+#include "BacnetCompactValue.h"
+
+namespace VIGBACNET {
+
+namespace {
+
+/**
+ * Return the value if it is exactly of class T, not a subclass
+ * A subclass, e.g. Units for Enumerated, must keep its class so it is boxed.
+ */
+template <typename T>
+const T* exactly(const BacnetValue& value) {
+	return value.typeInfo() == typeid(T) ? primitive_cast<T>(value) : 0;
+}
+
+} // local namespace
+
+void CompactValue::acquire() const {
+	if (hasBlob()) {
+		__sync_add_and_fetch(&_data.blob->refs, 1);
+	} else if (_kind == BoxedKind) {
+		__sync_add_and_fetch(&_data.box->refs, 1);
+	}
+}
+
+void CompactValue::release() {
+	if (hasBlob()) {
+		if (__sync_sub_and_fetch(&_data.blob->refs, 1) == 0) {
+			free(_data.blob);
+		}
+	} else if (_kind == BoxedKind) {
+		if (__sync_sub_and_fetch(&_data.box->refs, 1) == 0) {
+			delete _data.box;
+		}
+	}
+}
+
+void CompactValue::setBlob(Kind kind, const uint8_t* data, size_t size, uint32_t length) {
+	Blob* blob = (Blob*)malloc(offsetof(Blob, data) + (size ? size : 1));
+	if (!blob) {
+		throw std::bad_alloc();
+	}
+	blob->refs = 1;
+	blob->size = (uint32_t)size;
+	if (size) {
+		memcpy(blob->data, data, size);
+	}
+	_kind = (uint8_t)kind;
+	_data.blob = blob;
+	_length = length;
+}
+
+void CompactValue::setBox(const BacnetValue& value) {
+	_data.box = new Box(value.clone());
+	_kind = BoxedKind;
+}
+
+void CompactValue::set(const BacnetValue& value) {
+	clear();
+	switch (value.type().get()) {
+	case DataTypeEnum::Null:
+		if (exactly<Null>(value)) {
+			_kind = NullKind;
+			return;
+		}
+		break;
+	case DataTypeEnum::Boolean:
+		if (const Boolean* v = exactly<Boolean>(value)) {
+			_kind = BooleanKind;
+			_data.b = v->get();
+			return;
+		}
+		break;
+	case DataTypeEnum::Unsigned:
+		if (const Unsigned* v = exactly<Unsigned>(value)) {
+			_kind = UnsignedKind;
+			_data.u = v->get();
+			return;
+		}
+		break;
+	case DataTypeEnum::Integer:
+		if (const Integer* v = exactly<Integer>(value)) {
+			_kind = IntegerKind;
+			_data.i = v->get();
+			return;
+		}
+		break;
+	case DataTypeEnum::Real:
+		if (const Real* v = exactly<Real>(value)) {
+			_kind = RealKind;
+			_data.f = v->get();
+			return;
+		}
+		break;
+	case DataTypeEnum::Double:
+		if (const Double* v = exactly<Double>(value)) {
+			_kind = DoubleKind;
+			_data.d = v->get();
+			return;
+		}
+		break;
+	case DataTypeEnum::Enumerated:
+		if (const Enumerated* v = exactly<Enumerated>(value)) {
+			_kind = EnumeratedKind;
+			_data.u = v->get();
+			return;
+		}
+		break;
+	case DataTypeEnum::Date:
+		if (const Date* v = exactly<Date>(value)) {
+			_kind = DateKind;
+			_data.date.year = (int16_t)v->getYear();
+			_data.date.month = (uint8_t)v->getMonth().get();
+			_data.date.day = (uint8_t)v->getDay();
+			_data.date.wday = (uint8_t)v->getWeekDay().get();
+			return;
+		}
+		break;
+	case DataTypeEnum::Time:
+		if (const Time* v = exactly<Time>(value)) {
+			_kind = TimeKind;
+			_data.time.hour = (uint8_t)v->getHour();
+			_data.time.minute = (uint8_t)v->getMinute();
+			_data.time.second = (uint8_t)v->getSecond();
+			_data.time.hundredths = (uint8_t)v->getHundredths();
+			return;
+		}
+		break;
+	case DataTypeEnum::ObjectIdentifier:
+		if (const ObjectIdentifier* v = exactly<ObjectIdentifier>(value)) {
+			_kind = ObjectIdKind;
+			_data.u = v->getCoded();
+			return;
+		}
+		break;
+	case DataTypeEnum::OctetString:
+		if (const OctetString* v = exactly<OctetString>(value)) {
+			const OctetString::OctetBuffer& buffer = v->get();
+			setBlob(OctetStringKind, buffer.empty() ? 0 : &buffer[0], buffer.size(),
+					(uint32_t)buffer.size());
+			return;
+		}
+		break;
+	case DataTypeEnum::CharacterString:
+		if (const CharacterString* v = exactly<CharacterString>(value)) {
+			const std::string& str = v->get();
+			setBlob(CharacterStringKind, (const uint8_t*)str.data(), str.size(),
+					(uint32_t)str.size());
+			_charset = (uint8_t)v->getCharset().get();
+			return;
+		}
+		break;
+	case DataTypeEnum::BitString:
+		if (const BitString* v = exactly<BitString>(value)) {
+			std::vector<uint8_t> bytes(v->byteLength(), 0);
+			if (!bytes.empty()) {
+				v->get(&bytes[0], bytes.size());
+			}
+			setBlob(BitStringKind, bytes.empty() ? 0 : &bytes[0], bytes.size(),
+					(uint32_t)v->length());
+			return;
+		}
+		break;
+	default:
+		break;
+	}
+	setBox(value);
+}
+
+DataTypeEnum CompactValue::type() const {
+	switch (_kind) {
+	case NullKind:
+		return DataTypeEnum::Null;
+	case BooleanKind:
+		return DataTypeEnum::Boolean;
+	case UnsignedKind:
+		return DataTypeEnum::Unsigned;
+	case IntegerKind:
+		return DataTypeEnum::Integer;
+	case RealKind:
+		return DataTypeEnum::Real;
+	case DoubleKind:
+		return DataTypeEnum::Double;
+	case EnumeratedKind:
+		return DataTypeEnum::Enumerated;
+	case DateKind:
+		return DataTypeEnum::Date;
+	case TimeKind:
+		return DataTypeEnum::Time;
+	case ObjectIdKind:
+		return DataTypeEnum::ObjectIdentifier;
+	case OctetStringKind:
+		return DataTypeEnum::OctetString;
+	case CharacterStringKind:
+		return DataTypeEnum::CharacterString;
+	case BitStringKind:
+		return DataTypeEnum::BitString;
+	case BoxedKind:
+		return _data.box->value->type();
+	}
+	return DataTypeEnum();
+}
+
+namespace {
+
+BitString::BitBuffer unpackBits(const uint8_t* data, uint32_t bits) {
+	BitString::BitBuffer buffer(bits, false);
+	for (uint32_t i = 0; i < bits; i++) {
+		buffer[i] = (data[i / 8] & (0x80 >> (i % 8))) != 0;
+	}
+	return buffer;
+}
+
+} // local namespace
+
+BacnetValueRef CompactValue::toValue() const {
+	switch (_kind) {
+	case NullKind:
+		return new Null();
+	case BooleanKind:
+		return new Boolean(_data.b);
+	case UnsignedKind:
+		return new Unsigned(_data.u);
+	case IntegerKind:
+		return new Integer(_data.i);
+	case RealKind:
+		return new Real(_data.f);
+	case DoubleKind:
+		return new Double(_data.d);
+	case EnumeratedKind:
+		return new Enumerated(_data.u);
+	case DateKind:
+		return new Date(_data.date.year, (MonthEnum::Enum)_data.date.month, _data.date.day,
+				(DayOfTheWeekEnum::Enum)_data.date.wday);
+	case TimeKind:
+		return new Time(_data.time.hour, _data.time.minute, _data.time.second,
+				_data.time.hundredths);
+	case ObjectIdKind:
+		return new ObjectIdentifier(_data.u);
+	case OctetStringKind:
+		return new OctetString(_data.blob->data, _data.blob->size);
+	case CharacterStringKind:
+		return new CharacterString(_data.blob->data, _data.blob->size,
+				(CharsetEnum::Enum)_charset);
+	case BitStringKind:
+		return new BitString(unpackBits(_data.blob->data, _length));
+	case BoxedKind:
+		return _data.box->value->clone();
+	}
+	return 0;
+}
+
+bool CompactValue::assignTo(BacnetValue& to, bool throwError) const {
+	switch (_kind) {
+	case NullKind: {
+		Null v;
+		return to.set(v, throwError);
+	}
+	case BooleanKind: {
+		Boolean v(_data.b);
+		return to.set(v, throwError);
+	}
+	case UnsignedKind: {
+		Unsigned v(_data.u);
+		return to.set(v, throwError);
+	}
+	case IntegerKind: {
+		Integer v(_data.i);
+		return to.set(v, throwError);
+	}
+	case RealKind: {
+		Real v(_data.f);
+		return to.set(v, throwError);
+	}
+	case DoubleKind: {
+		Double v(_data.d);
+		return to.set(v, throwError);
+	}
+	case EnumeratedKind: {
+		Enumerated v(_data.u);
+		return to.set(v, throwError);
+	}
+	case ObjectIdKind: {
+		ObjectIdentifier v(_data.u);
+		return to.set(v, throwError);
+	}
+	case BoxedKind:
+		return to.set(*_data.box->value, throwError);
+	case EmptyKind:
+		return emptyError(throwError);
+	default: {
+		// Dates, times and strings are not on the hot paths
+		BacnetValueRef value = toValue();
+		return to.set(*value, throwError);
+	}
+	}
+}
+
+bool CompactValue::emptyError(bool throwError) const {
+	if (throwError) {
+		throwException(BacnetErrorException(ErrorClassEnum::Property,
+				ErrorCodeEnum::InvalidDataType, "The property has no value."));
+	}
+	return false;
+}
+
+bool CompactValue::operator==(const CompactValue& rh) const {
+	if (_kind != rh._kind) {
+		return false;
+	}
+	switch (_kind) {
+	case EmptyKind:
+	case NullKind:
+		return true;
+	case BooleanKind:
+		return _data.b == rh._data.b;
+	case UnsignedKind:
+	case EnumeratedKind:
+	case ObjectIdKind:
+		return _data.u == rh._data.u;
+	case IntegerKind:
+		return _data.i == rh._data.i;
+	case RealKind:
+		return FC::eq(_data.f, rh._data.f);
+	case DoubleKind:
+		return FC::eq(_data.d, rh._data.d);
+	case DateKind:
+		return !memcmp(&_data.date, &rh._data.date, sizeof(_data.date));
+	case TimeKind:
+		return !memcmp(&_data.time, &rh._data.time, sizeof(_data.time));
+	case OctetStringKind:
+	case CharacterStringKind:
+	case BitStringKind:
+		return _length == rh._length && _data.blob->size == rh._data.blob->size &&
+				!memcmp(_data.blob->data, rh._data.blob->data, _data.blob->size);
+	case BoxedKind:
+		// Class instances are only equal when shared
+		return _data.box == rh._data.box;
+	}
+	return false;
+}
+
+} // VIGBACNET
@@ -0,0 +1,226 @@
+/*
+ * BacnetCompactValue.h
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#ifndef BacnetCompactValue_h
+#define BacnetCompactValue_h
+
+#include <stdint.h>
+#include <string>
+#include <type_traits>
+#include "fc.h"
+#include "BacnetAppTypes.h"
+#include "BacnetValueGetterSetter.h"
+
+namespace VIGBACNET {
+
+/**
+ * BACnet value stored in 16 bytes
+ * The primitive values are kept inline in a tagged union.  Octet, character and bit
+ * strings keep their bytes out of line, other values (constructed types, Units and
+ * the other enumerated subclasses, ...) keep a clone of the BacnetValue.  The out of
+ * line part is immutable and shared between the copies, so copying a compact value
+ * never allocates.  The value has no modified and dirty flags, it is meant for read
+ * only copies like the published object versions, the class API stays the way to
+ * change values.
+ */
+class CompactValue {
+public:
+	enum Kind {
+		EmptyKind,
+		NullKind,
+		BooleanKind,
+		UnsignedKind,
+		IntegerKind,
+		RealKind,
+		DoubleKind,
+		EnumeratedKind,
+		DateKind,
+		TimeKind,
+		ObjectIdKind,
+		OctetStringKind,
+		CharacterStringKind,
+		BitStringKind,
+		BoxedKind,
+	};
+
+	CompactValue() : _kind(EmptyKind), _charset(0), _reserved(0), _length(0) {
+		_data.d = 0;
+	}
+	explicit CompactValue(const BacnetValue& value) :
+		_kind(EmptyKind), _charset(0), _reserved(0), _length(0) {
+		_data.d = 0;
+		set(value);
+	}
+	CompactValue(const CompactValue& value) :
+		_data(value._data), _kind(value._kind), _charset(value._charset), _reserved(0),
+		_length(value._length) {
+		acquire();
+	}
+	~CompactValue() {
+		release();
+	}
+
+	CompactValue& operator=(const CompactValue& value) {
+		if (this != &value) {
+			value.acquire();
+			release();
+			_data = value._data;
+			_kind = value._kind;
+			_charset = value._charset;
+			_length = value._length;
+		}
+		return *this;
+	}
+
+	void set(const BacnetValue& value);
+	void clear() {
+		release();
+		_kind = EmptyKind;
+		_data.d = 0;
+		_length = 0;
+	}
+
+	Kind kind() const { return (Kind)_kind; }
+	bool isEmpty() const { return _kind == EmptyKind; }
+	DataTypeEnum type() const;
+
+	/**
+	 * Create the class instance of the value, a null reference if empty
+	 */
+	BacnetValueRef toValue() const;
+
+	/**
+	 * Get the value like ValueGetter::cast
+	 * The primitive values are converted in place, the other conversions go through
+	 * a temporary class instance.
+	 */
+	template <typename T>
+	typename std::enable_if<std::is_base_of<BacnetValue, T>::value, bool>::type
+	get(T& to, bool throwError = true) const {
+		return assignTo(to, throwError);
+	}
+	template <typename T>
+	typename std::enable_if<not std::is_base_of<BacnetValue, T>::value, bool>::type
+	get(T& to, bool throwError = true) const {
+		if (IsPrimitiveType<T>::Value) {
+			switch (_kind) {
+			case BooleanKind:
+				IsPrimitiveType<T>::castFrom(_data.b, to);
+				return true;
+			case IntegerKind:
+				IsPrimitiveType<T>::castFrom(_data.i, to);
+				return true;
+			case UnsignedKind:
+			case EnumeratedKind:
+				IsPrimitiveType<T>::castFrom(_data.u, to);
+				return true;
+			case RealKind:
+				IsPrimitiveType<T>::castFrom(_data.f, to);
+				return true;
+			case DoubleKind:
+				IsPrimitiveType<T>::castFrom(_data.d, to);
+				return true;
+			default:
+				break;
+			}
+		}
+		if (getString(to)) {
+			return true;
+		}
+		BacnetValueRef value = toValue();
+		if (!value) {
+			return emptyError(throwError);
+		}
+		return ValueGetter::cast(*value, to, throwError);
+	}
+
+	/**
+	 * Set {to} to the value, like BacnetValue::set
+	 * The primitive values go through a class instance on the stack.
+	 */
+	bool assignTo(BacnetValue& to, bool throwError = true) const;
+
+	bool operator==(const CompactValue& rh) const;
+	bool operator!=(const CompactValue& rh) const {
+		return !(*this == rh);
+	}
+
+private:
+	// Encodes and decodes the stack vbags without class instance
+	friend class VsbConverter;
+
+	// Out of line bytes of the strings, shared by the copies
+	struct Blob {
+		volatile uint32_t refs;
+		uint32_t size;
+		uint8_t data[1];
+	};
+	// Out of line class instance, shared by the copies
+	struct Box {
+		Box(const BacnetValueRef& v) : refs(1), value(v) {}
+
+		volatile uint32_t refs;
+		BacnetValueRef value;
+	};
+	struct DateFields {
+		int16_t year;
+		uint8_t month;
+		uint8_t day;
+		uint8_t wday;
+	};
+	struct TimeFields {
+		uint8_t hour;
+		uint8_t minute;
+		uint8_t second;
+		uint8_t hundredths;
+	};
+
+	union Data {
+		bool b;
+		uint32_t u;
+		int32_t i;
+		float f;
+		double d;
+		DateFields date;
+		TimeFields time;
+		Blob* blob;
+		Box* box;
+	};
+
+	bool hasBlob() const {
+		return _kind == OctetStringKind || _kind == CharacterStringKind || _kind == BitStringKind;
+	}
+	void acquire() const;
+	void release();
+	void setBlob(Kind kind, const uint8_t* data, size_t size, uint32_t length);
+	void setBox(const BacnetValue& value);
+	bool emptyError(bool throwError) const;
+
+	bool getString(std::string& to) const {
+		if (_kind == CharacterStringKind) {
+			to.assign((const char*)_data.blob->data, _data.blob->size);
+			return true;
+		}
+		return false;
+	}
+	template <typename T>
+	bool getString(T&) const {
+		return false;
+	}
+
+	Data _data;
+	uint8_t _kind;
+	uint8_t _charset;
+	uint16_t _reserved;
+	// Number of bits of a bit string, bytes of the other strings
+	uint32_t _length;
+};
+
+static_assert(sizeof(CompactValue) == 16, "CompactValue must stay 16 bytes");
+
+} // VIGBACNET
+
+#endif /* BACNETCOMPACTVALUE_H_ */
@@ -137,6 +137,41 @@ void Device::clearPropertyDirty(const ObjectIdentifier &oid, PropertyIdentifierE
 	}
 }
 
+size_t Device::applyObjectProperties(PropertyUpdate* updates, const size_t* order, size_t count,
+		std::vector<ObjectIdentifier>* changed) {
+	size_t applied = 0;
+	size_t i = 0;
+	while (i < count) {
+		const ObjectIdentifier& oid = updates[order[i]].oid;
+		auto it = _objects.find(oid);
+		bool objChanged = false;
+		// Apply all the updates for this object
+		for (; i < count && updates[order[i]].oid == oid; i++) {
+			PropertyUpdate& update = updates[order[i]];
+			if (it == _objects.end()) {
+				update.success = false;
+				update.errorClass = ErrorClassEnum::Object;
+				update.errorCode = ErrorCodeEnum::UnknownObject;
+			} else if (!update.value) {
+				update.success = false;
+				update.errorClass = ErrorClassEnum::Services;
+				update.errorCode = ErrorCodeEnum::MissingRequiredParameter;
+			} else {
+				update.success = it->second->trySetProperty(update.pid, *update.value,
+						update.errorClass, update.errorCode);
+			}
+			if (update.success) {
+				objChanged = true;
+				applied++;
+			}
+		}
+		if (objChanged && changed) {
+			changed->push_back(oid);
+		}
+	}
+	return applied;
+}
+
 void Device::addObject(const Object& object) {
 	if (object.getOid().getType() == ObjectTypeEnum::Device) {
 		throwException(BacnetErrorException(ErrorClassEnum::Object,
@@ -157,7 +192,12 @@ void Device::deleteObject(const ObjectIdentifier& oid) {
 				ErrorCodeEnum::ObjectDeletionNotPermitted,
 				"Cannot remove a Device object from its own device."));
 	}
-	_objects.erase(oid);
+	auto it = _objects.find(oid);
+	if (it != _objects.end()) {
+		// Let any handle still referencing the object know it is gone
+		it->second->markDeleted();
+		_objects.erase(it);
+	}
 	resetObjectInstance(oid.getType());
 }
 
@@ -179,6 +219,25 @@ ObjectRef Device::getObject(const ObjectIdentifier& oid) {
 	return obj;
 }
 
+bool Device::resolveProperty(const ObjectIdentifier& oid, PropertyIdentifierEnum id,
+		ObjectRef& obj, BacnetValueRef& value) const {
+	auto it = _objects.find(oid);
+	if (it != _objects.end()) {
+		PropertyRef prop = it->second->findProperty(id);
+		if (prop) {
+			obj = it->second;
+			value = prop->getValue();
+			return true;
+		}
+	}
+	return false;
+}
+
+ObjectRef Device::findObject(const ObjectIdentifier& oid) const {
+	auto it = _objects.find(oid);
+	return it != _objects.end() ? it->second : ObjectRef(0);
+}
+
 ObjectRef Device::getObject(const std::string &name) {
 	ObjectRef obj;
 	auto it = _objects.begin();
@@ -214,6 +273,14 @@ ObjectRef Device::getNextObject(const ObjectIdentifier* from) {
 	}
 	return obj;
 }
+bool Device::getNextObjectIdentifier(const ObjectIdentifier* from, ObjectIdentifier& next) const {
+	auto it = from ? _objects.upper_bound(*from) : _objects.begin();
+	if (it != _objects.end()) {
+		next = it->first;
+		return true;
+	}
+	return false;
+}
 /**
  * Print address and all objects for this device
  */
@@ -162,6 +162,26 @@ private:
 };
 
 
+/**
+ * Single entry of a batch property update
+ * The caller fills the object, property and value to write.  Once the batch is
+ * applied {success} tells if the value was written, otherwise {errorClass} and
+ * {errorCode} tell why it was rejected.
+ */
+struct PropertyUpdate {
+	PropertyUpdate(const ObjectIdentifier& objId, const PropertyIdentifierEnum& propId,
+			const BacnetValueRef& val) :
+		oid(objId), pid(propId), value(val), success(false) {}
+
+	ObjectIdentifier oid;
+	PropertyIdentifierEnum pid;
+	BacnetValueRef value;
+	bool success;
+	ErrorClassEnum errorClass;
+	ErrorCodeEnum errorCode;
+};
+typedef std::vector<PropertyUpdate> PropertyUpdateList;
+
 class Device;
 typedef FC::Ref<Device> DeviceRef;
 
@@ -263,8 +283,7 @@ public:
 						   const T &value, bool throwError = true) {
 		auto it = _objects.find(oid);
 		if (it != _objects.end()) {
-			it->second->setProperty(id, value, throwError);
-			return true;
+			return it->second->setProperty(id, value, throwError);
 		} else if (throwError) {
 			std::ostringstream oss;
 			oss << "Object " << oid << "does not exist.";
@@ -273,6 +292,35 @@ public:
 		}
 		return false;
 	}
+	/**
+	 * Set an object property without exception
+	 */
+	BacnetStatus trySetObjectProperty(const ObjectIdentifier &oid, PropertyIdentifierEnum id,
+			const BacnetValue &value) {
+		auto it = _objects.find(oid);
+		if (it == _objects.end()) {
+			return BacnetStatus(ErrorClassEnum::Object, ErrorCodeEnum::UnknownObject);
+		}
+		ErrorClassEnum eClass;
+		ErrorCodeEnum eCode;
+		if (!it->second->trySetProperty(id, value, eClass, eCode)) {
+			return BacnetStatus(eClass, eCode);
+		}
+		return BacnetStatus();
+	}
+	/**
+	 * Apply the batch entries listed in {order}
+	 * {order} holds indexes in {updates} and must list the entries of a same object
+	 * next to each other, so each object is looked up only once.  It lets the caller
+	 * choose the grouping, e.g. Server::setProperties applies all the objects sharing
+	 * a lock at once.  The status of each entry is reported in place and no exception
+	 * is thrown for a failed entry.  The identifiers of the objects that had at least
+	 * one property set are appended to {changed} if given.
+	 *
+	 * return the number of entries successfully applied
+	 */
+	size_t applyObjectProperties(PropertyUpdate* updates, const size_t* order, size_t count,
+			std::vector<ObjectIdentifier>* changed = 0);
 	bool isPropertyRemoteWrittable(PropertyIdentifierEnum id) const {
 		return _device->isPropertyRemoteWrittable(id);
 	}
@@ -299,6 +347,20 @@ public:
 	ObjectInstance getNextObjectInstance(ObjectTypeEnum type) const;
 	ObjectRef getObject(const ObjectIdentifier& oid);
 	ObjectRef getObject(const std::string &name);
+	/**
+	 * Resolve an object property to the object and the value actually stored
+	 * Unlike getObject no copy is made, the returned references point to the device
+	 * own data and must only be used under the owner synchronization.
+	 *
+	 * return false if the object or the property does not exist
+	 */
+	bool resolveProperty(const ObjectIdentifier& oid, PropertyIdentifierEnum id,
+			ObjectRef& obj, BacnetValueRef& value) const;
+	/**
+	 * Return the object itself or a null reference, no copy is made
+	 * Like resolveProperty it must only be used under the owner synchronization.
+	 */
+	ObjectRef findObject(const ObjectIdentifier& oid) const;
 	bool hasObject(const ObjectIdentifier& oid) {
 		return _objects.find(oid) != _objects.end();
 	}
@@ -315,6 +377,13 @@ public:
 	 * return reference to copy of next object found or null if none
 	 */
 	ObjectRef getNextObject(const ObjectIdentifier* from = 0);
+	/**
+	 * Same as getNextObject but only return the identifier of the next object
+	 * No object is copied and no property value is read.
+	 *
+	 * return false if there is no more object
+	 */
+	bool getNextObjectIdentifier(const ObjectIdentifier* from, ObjectIdentifier& next) const;
 	size_t getCount() {
 		return _objects.size();
 	}
@@ -345,7 +414,8 @@ protected:
 		}
 	};
 
-	typedef std::map<ObjectIdentifier, FC::Ref<Object>, SortByOid> ObjectMap;
+	typedef std::map<ObjectIdentifier, FC::Ref<Object>, SortByOid,
+			PoolAllocator<std::pair<const ObjectIdentifier, FC::Ref<Object> > >::Type> ObjectMap;
 	typedef std::map<ObjectTypeEnum, ObjectInstance> ObjectInstanceMap;
 
 	DeviceAddress _address;
@@ -9,10 +9,174 @@
 #ifndef BacnetEnums_h
 #define BacnetEnums_h
 
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
 #include "fc.h"
 
 namespace VIGBACNET {
 
+/**
+ * Lookup tables of an enum definition T
+ *
+ * The getName switch of the definition stays the only list of the values.  The
+ * tables are built from it the first time they are used: a bitmap of the valid
+ * values, a value being valid when its name is not "Unknown", and a perfect hash of
+ * the names for the reverse lookup.  The values of the definitions are below Size;
+ * larger values are checked with getName, which does not allocate either.
+ *
+ * The perfect hash is a hash and displace table: the names are spread in buckets
+ * and each bucket has the seed that puts all its names in free slots.  A lookup is
+ * two hashes of the name and one string compare.
+ */
+template <typename T>
+class EnumTable {
+public:
+	typedef typename T::Enum Enum;
+
+	static const uint32_t Size = 1024;
+
+	static bool isValid(uint32_t value) {
+		if (value < Size) {
+			return (instance()._valid[value / 64] >> (value % 64)) & 1;
+		}
+		return strcmp(T::getName((Enum)value), "Unknown") != 0;
+	}
+
+	/**
+	 * Find the value with the given name, as returned by getName
+	 * return false if no value has this name
+	 */
+	static bool fromName(const char* name, Enum& e) {
+		const EnumTable& table = instance();
+		if (table._entries.empty()) {
+			return false;
+		}
+		uint32_t seed = table._seeds[hash(name, 0) & (table._seeds.size() - 1)];
+		const Entry& entry = table._entries[hash(name, seed) & (table._entries.size() - 1)];
+		if (entry.name && !strcmp(entry.name, name)) {
+			e = (Enum)entry.value;
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Number of distinct names
+	 */
+	static size_t getCount() { return instance()._count; }
+
+private:
+	struct Entry {
+		Entry() : name(0), value(0) {}
+		Entry(const char* n, uint32_t v) : name(n), value(v) {}
+
+		const char* name;
+		uint32_t value;
+	};
+
+	static const EnumTable& instance() {
+		static const EnumTable table;
+		return table;
+	}
+
+	static uint32_t hash(const char* name, uint32_t seed) {
+		// FNV-1a, the seed changes the offset basis
+		uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+		for (; *name; name++) {
+			h = (h ^ (uint8_t)*name) * 16777619u;
+		}
+		h ^= h >> 15;
+		h *= 0x2c1b3c6du;
+		h ^= h >> 12;
+		return h;
+	}
+
+	static size_t powerOfTwo(size_t n) {
+		size_t p = 1;
+		while (p < n) {
+			p <<= 1;
+		}
+		return p;
+	}
+
+	EnumTable() : _count(0) {
+		memset(_valid, 0, sizeof(_valid));
+		std::vector<Entry> names;
+		for (uint32_t value = 0; value < Size; value++) {
+			const char* name = T::getName((Enum)value);
+			if (!strcmp(name, "Unknown")) {
+				continue;
+			}
+			_valid[value / 64] |= (uint64_t)1 << (value % 64);
+			// Aliases keep the name of the first value
+			bool found = false;
+			for (size_t i = 0; i < names.size() && !found; i++) {
+				found = !strcmp(names[i].name, name);
+			}
+			if (!found) {
+				names.push_back(Entry(name, value));
+			}
+		}
+		_count = names.size();
+		if (!names.empty()) {
+			buildHash(names);
+		}
+	}
+
+	void buildHash(const std::vector<Entry>& names) {
+		_entries.resize(powerOfTwo(names.size() * 2));
+		_seeds.resize(powerOfTwo((names.size() + 3) / 4));
+		std::vector<std::vector<size_t> > buckets(_seeds.size());
+		for (size_t i = 0; i < names.size(); i++) {
+			buckets[hash(names[i].name, 0) & (_seeds.size() - 1)].push_back(i);
+		}
+		// Place the largest buckets first, while most slots are free
+		std::vector<size_t> order(buckets.size());
+		for (size_t i = 0; i < order.size(); i++) {
+			order[i] = i;
+		}
+		std::sort(order.begin(), order.end(), LargerBucket(buckets));
+		std::vector<size_t> slots;
+		for (size_t i = 0; i < order.size() && !buckets[order[i]].empty(); i++) {
+			const std::vector<size_t>& bucket = buckets[order[i]];
+			for (uint32_t seed = 1; ; seed++) {
+				slots.clear();
+				size_t j = 0;
+				for (; j < bucket.size(); j++) {
+					size_t slot = hash(names[bucket[j]].name, seed) & (_entries.size() - 1);
+					if (_entries[slot].name ||
+							std::find(slots.begin(), slots.end(), slot) != slots.end()) {
+						break;
+					}
+					slots.push_back(slot);
+				}
+				if (j == bucket.size()) {
+					for (j = 0; j < bucket.size(); j++) {
+						_entries[slots[j]] = names[bucket[j]];
+					}
+					_seeds[order[i]] = seed;
+					break;
+				}
+			}
+		}
+	}
+
+	struct LargerBucket {
+		LargerBucket(const std::vector<std::vector<size_t> >& b) : buckets(b) {}
+		bool operator() (size_t lhs, size_t rhs) const {
+			return buckets[lhs].size() > buckets[rhs].size();
+		}
+		const std::vector<std::vector<size_t> >& buckets;
+	};
+
+	uint64_t _valid[Size / 64];
+	std::vector<Entry> _entries;
+	std::vector<uint32_t> _seeds;
+	size_t _count;
+};
+
 template <typename T>
 struct EnumTemplate : public virtual T, public virtual FC::Formatter {
 	typedef typename T::Enum Enum;
@@ -31,6 +195,24 @@ struct EnumTemplate : public virtual T, public virtual FC::Formatter {
 		return T::getName(_e);
 	}
 
+	/**
+	 * Tell if {value} is one of the values of the enum, without allocation
+	 */
+	static bool isValid(uint32_t value) {
+		return EnumTable<T>::isValid(value);
+	}
+
+	/**
+	 * Find the value with the given name, e.g. "Analog Input" for an ObjectTypeEnum
+	 * return false if no value has this name
+	 */
+	static bool fromName(const char* name, Enum& e) {
+		return EnumTable<T>::fromName(name, e);
+	}
+	static bool fromName(const std::string& name, Enum& e) {
+		return EnumTable<T>::fromName(name.c_str(), e);
+	}
+
 	EnumTemplate& operator=(const Enum& e) {
 		_e = e;
 		return *this;
@@ -256,7 +438,7 @@ struct DataTypeEnumDefinition {
 	};
 
 	static const char *getTypeName() {
-		return "ObjectType";
+		return "DataType";
 	}
 
 	static const char* getName(Enum e) {
@@ -1023,7 +1205,9 @@ struct SegmentationEnumDefinition {
 		case SegmentedReceive:
 			return "Segmented Receive";
 		case NoSegmentation:
-			return "NoSemgentation";
+			return "No Segmentation";
+		default:
+			return "Unknown";
 		}
 	}
 
@@ -1410,7 +1594,7 @@ public:
 	};
 
 	static const char* getTypeName() {
-		return "Error Class";
+		return "Error Code";
 	}
 
 	static const char* getName(Enum e) {
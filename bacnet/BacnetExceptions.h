@@ -55,6 +55,33 @@ protected:
 	ErrorCodeEnum _eCode;
 };
 
+/**
+ * Result of an operation reporting its errors without exception
+ * A failed status holds the BACnet error class and code, it has no message so
+ * failing costs no formatting and no unwinding.  The throwing API is built on top
+ * of it with toException.
+ */
+class BacnetStatus {
+public:
+	BacnetStatus() :
+		_ok(true), _eClass(ErrorClassEnum::getDefault()), _eCode(ErrorCodeEnum::getDefault()) {}
+	BacnetStatus(ErrorClassEnum eClass, ErrorCodeEnum eCode) :
+		_ok(false), _eClass(eClass), _eCode(eCode) {}
+
+	bool ok() const { return _ok; }
+	ErrorClassEnum eClass() const { return _eClass; }
+	ErrorCodeEnum eCode() const { return _eCode; }
+
+	BacnetErrorException toException(const std::string &what = "") const {
+		return BacnetErrorException(_eClass, _eCode, what);
+	}
+
+private:
+	bool _ok;
+	ErrorClassEnum _eClass;
+	ErrorCodeEnum _eCode;
+};
+
 } // VIGBACNET
 
 #endif /* BACNETEXCEPTIONS_H_ */
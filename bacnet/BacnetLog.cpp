@@ -0,0 +1,120 @@
+/*
+ * BacnetLog.cpp
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "BacnetLog.h"
+#include "BacnetUtils.h"
+#include "BacnetExceptions.h"
+
+namespace VIGBACNET {
+
+namespace {
+
+const char HotTraceMagic[4] = { 'V', 'B', 'H', 'T' };
+const uint32_t HotTraceVersion = 1;
+
+} // local namespace
+
+volatile bool Log::_debug = (getenv("BACNET_DEBUG") != 0);
+
+FC::Mutex HotTrace::_mutex;
+HotTraceEvent* HotTrace::_events = 0;
+uint64_t HotTrace::_mask = 0;
+volatile uint64_t HotTrace::_next = 0;
+volatile bool HotTrace::_enabled = false;
+
+const char* HotTrace::kindName(uint32_t kind) {
+	switch (kind) {
+	case ReadRequest:
+		return "ReadRequest";
+	case WriteRequest:
+		return "WriteRequest";
+	case TransactionCreated:
+		return "TransactionCreated";
+	case TransactionSent:
+		return "TransactionSent";
+	case TransactionAck:
+		return "TransactionAck";
+	case TransactionDeleted:
+		return "TransactionDeleted";
+	default:
+		return "Unknown";
+	}
+}
+
+void HotTrace::enable(size_t capacity) {
+	FC::MutexLock lock(_mutex);
+	if (!_events) {
+		size_t size = 1;
+		while (size < capacity) {
+			size <<= 1;
+		}
+		_events = new HotTraceEvent[size];
+		memset(_events, 0, size * sizeof(HotTraceEvent));
+		_mask = size - 1;
+		// The ring must be visible before the flag
+		__sync_synchronize();
+	}
+	_enabled = true;
+}
+
+size_t HotTrace::dump(const std::string& path) {
+	FC::MutexLock lock(_mutex);
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file) {
+		throwException(BacnetApplicationException(FC::StringAPrintf(
+				"Cannot create the hot trace file %s: %s", path.c_str(), strerror(errno))));
+	}
+	uint64_t next = _next;
+	uint64_t size = _events ? _mask + 1 : 0;
+	uint64_t count = next < size ? next : size;
+	fwrite(HotTraceMagic, 1, sizeof(HotTraceMagic), file);
+	fwrite(&HotTraceVersion, sizeof(HotTraceVersion), 1, file);
+	fwrite(&count, sizeof(count), 1, file);
+	for (uint64_t i = next - count; i < next; i++) {
+		fwrite(&_events[i & _mask], sizeof(HotTraceEvent), 1, file);
+	}
+	fclose(file);
+	return (size_t)count;
+}
+
+size_t HotTrace::decode(const std::string& path, FILE* out) {
+	FILE* file = fopen(path.c_str(), "rb");
+	if (!file) {
+		throwException(BacnetApplicationException(FC::StringAPrintf(
+				"Cannot open the hot trace file %s: %s", path.c_str(), strerror(errno))));
+	}
+	char magic[sizeof(HotTraceMagic)];
+	uint32_t version = 0;
+	uint64_t count = 0;
+	if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+		fread(&version, sizeof(version), 1, file) != 1 ||
+		fread(&count, sizeof(count), 1, file) != 1 ||
+		memcmp(magic, HotTraceMagic, sizeof(magic)) || version != HotTraceVersion) {
+		fclose(file);
+		throwException(BacnetApplicationException(FC::StringAPrintf(
+				"%s is not a hot trace file of version %u", path.c_str(), HotTraceVersion)));
+	}
+	HotTraceEvent event;
+	size_t decoded = 0;
+	uint64_t start = 0;
+	while (decoded < count && fread(&event, sizeof(event), 1, file) == 1) {
+		if (decoded == 0) {
+			start = event.time;
+		}
+		// Time relative to the oldest event, in microseconds
+		fprintf(out, "%12.3f %-18s %10u %20llu %20llu\n",
+				(double)(int64_t)(event.time - start) / 1000.0, kindName(event.kind), event.a,
+				(unsigned long long)event.b, (unsigned long long)event.c);
+		decoded++;
+	}
+	fclose(file);
+	return decoded;
+}
+
+} // VIGBACNET
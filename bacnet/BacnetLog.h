@@ -0,0 +1,129 @@
+/*
+ * BacnetLog.h
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#ifndef BacnetLog_h
+#define BacnetLog_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <sstream>
+#include "fc.h"
+#include "BacnetClock.h"
+
+namespace VIGBACNET {
+
+/**
+ * Switch of the debug messages of the request paths
+ * Building those messages streams whole requests and values, so it is only done when
+ * the switch is on.  FC does not let the library query its log level, hence this
+ * switch in addition to it: a request path message is only logged if the switch is
+ * on and the FC log level lets FC_Debug1 through.  Raising the FC log level alone
+ * does not show them.  The switch is off unless the BACNET_DEBUG environment variable
+ * is set, e.g. BACNET_DEBUG=1, and can be changed at run time with setDebug.  The
+ * server logs its state when it starts.
+ */
+class Log {
+public:
+	static bool isDebug() { return _debug; }
+	static void setDebug(bool debug) { _debug = debug; }
+
+private:
+	static volatile bool _debug;
+};
+
+} // VIGBACNET
+
+/**
+ * Log a debug message built with the stream operator, e.g.
+ *   BACNET_DEBUG1("Got a read request: " << request);
+ * Nothing is evaluated when the debug messages are off.
+ */
+#define BACNET_DEBUG1(message) \
+	do { \
+		if (VIGBACNET::Log::isDebug()) { \
+			std::ostringstream bacnetDebugStream; \
+			bacnetDebugStream << message; \
+			FC_Debug1(bacnetDebugStream.str().c_str()); \
+		} \
+	} while (0)
+
+namespace VIGBACNET {
+
+/**
+ * Event of the hot path trace, 32 bytes
+ * The meaning of {a}, {b} and {c} depends on the kind, see HotTrace::Kind.
+ */
+struct HotTraceEvent {
+	uint64_t time;
+	uint32_t kind;
+	uint32_t a;
+	uint64_t b;
+	uint64_t c;
+};
+
+/**
+ * Binary ring buffer of the hot path events
+ * Recording copies a few integers in the next slot of the ring, nothing is formatted.
+ * The ring keeps the latest events, it is written to a file with dump and turned
+ * into text offline with decode.  Writers do not wait for each other, so when the
+ * ring wraps around while it is recorded concurrently an old event may be torn.
+ */
+class HotTrace {
+public:
+	static const size_t DefaultCapacity = 65536;
+
+	enum Kind {
+		ReadRequest = 1,		// a: coded oid, b: property id
+		WriteRequest,			// a: coded oid, b: property id
+		TransactionCreated,		// a: service, b: transaction id
+		TransactionSent,		// a: remote device, b: transaction id, c: stack result
+		TransactionAck,			// a: vbag data type, b: transaction id, c: response time in ns
+		TransactionDeleted,		// b: transaction id
+	};
+
+	static const char* kindName(uint32_t kind);
+
+	/**
+	 * Start recording, the ring of {capacity} events is created on the first call
+	 */
+	static void enable(size_t capacity = DefaultCapacity);
+	static void disable() { _enabled = false; }
+	static bool isEnabled() { return _enabled; }
+
+	static void record(Kind kind, uint32_t a, uint64_t b = 0, uint64_t c = 0) {
+		if (_enabled) {
+			uint64_t idx = __sync_fetch_and_add(&_next, 1);
+			HotTraceEvent& event = _events[idx & _mask];
+			event.time = Clock::now();
+			event.kind = kind;
+			event.a = a;
+			event.b = b;
+			event.c = c;
+		}
+	}
+
+	/**
+	 * Write the events of the ring, oldest first
+	 * return the number of events written
+	 */
+	static size_t dump(const std::string& path);
+	/**
+	 * Write a dump as text, one event per line
+	 */
+	static size_t decode(const std::string& path, FILE* out);
+
+private:
+	static FC::Mutex _mutex;
+	static HotTraceEvent* _events;
+	static uint64_t _mask;
+	static volatile uint64_t _next;
+	static volatile bool _enabled;
+};
+
+} // VIGBACNET
+
+#endif /* BACNETLOG_H_ */
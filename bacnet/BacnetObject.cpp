@@ -40,6 +40,23 @@ ObjectRef Object::createLight(ObjectTypeEnum type, ObjectInstance instance, std:
 	return new Object(type, instance, name, &props);
 }
 
+bool Object::trySetProperty(PropertyIdentifierEnum id, const BacnetValue& value,
+		ErrorClassEnum& eClass, ErrorCodeEnum& eCode) {
+	auto it = _properties.find(id);
+	if (it == _properties.end()) {
+		eClass = ErrorClassEnum::Property;
+		eCode = ErrorCodeEnum::UnknownProperty;
+		return false;
+	}
+	BacnetStatus status = it->second->getValue()->trySet(value);
+	if (!status.ok()) {
+		eClass = status.eClass();
+		eCode = status.eCode();
+		return false;
+	}
+	return true;
+}
+
 bool Object::isPropertyRemoteWrittable(PropertyIdentifierEnum id) const {
 	auto it = _properties.find(id);
 	if (it != _properties.end()) {
@@ -48,6 +65,14 @@ bool Object::isPropertyRemoteWrittable(PropertyIdentifierEnum id) const {
 	return false;
 }
 
+PropertyRef Object::findProperty(PropertyIdentifierEnum id) const {
+	auto it = _properties.find(id);
+	if (it == _properties.end()) {
+		return 0;
+	}
+	return it->second;
+}
+
 bool Object::isPropertyModified(PropertyIdentifierEnum id) const {
 	auto it = _properties.find(id);
 	if (it != _properties.end()) {
@@ -117,15 +142,7 @@ void Object::init(const ObjectIdentifier& oid, std::string& name,
 	_properties[PropertyIdentifierEnum::ObjectName] =
 			new Property(new CharacterString(name), true, false);
 }
-/*
-PropertyRef Object::getProperty(PropertyIdentifierEnum prop) const {
-	auto it = _properties.find(prop);
-	if (it == _properties.end()) {
-		return 0;
-	}
-	return it->second;
-}
-*/
+
 void Object::copy(const Object& object) {
 	_properties.clear();
 	auto it = object._properties.begin();
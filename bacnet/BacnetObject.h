@@ -21,7 +21,10 @@ typedef FC::Ref<Object> ObjectRef;
 
 class Object : public FC::RefObject, public FC::Formatter {
 public:
-	typedef std::map<PropertyIdentifierEnum, PropertyRef> PropertyMap;
+	BACNET_POOL_ALLOCATED
+
+	typedef std::map<PropertyIdentifierEnum, PropertyRef, std::less<PropertyIdentifierEnum>,
+			PoolAllocator<std::pair<const PropertyIdentifierEnum, PropertyRef> >::Type> PropertyMap;
 
 	static ObjectRef create(ObjectTypeEnum type, ObjectInstance instance, std::string name="");
 	static ObjectRef createLight(ObjectTypeEnum type, ObjectInstance instance, std::string name="");
@@ -31,16 +34,19 @@ public:
 	// Or at minimum give a validate method that make sure the object has
 	// all the required properties for its type
 	Object(const ObjectIdentifier& oid, std::string name = "",
-			const ObjectPropertySet *props = 0) {
+			const ObjectPropertySet *props = 0) :
+		_deleted(false) {
 		init(oid, name, props);
 	}
 
 	Object(ObjectTypeEnum type, ObjectInstance instance,
-			std::string name = "", const ObjectPropertySet *props = 0) {
+			std::string name = "", const ObjectPropertySet *props = 0) :
+		_deleted(false) {
 		init(ObjectIdentifier(type, instance), name, props);
 	}
 
-	Object(const Object& object) {
+	Object(const Object& object) :
+		_deleted(false) {
 		copy(object);
 	}
 
@@ -96,7 +102,28 @@ public:
 		}
 		return ValueSetter::cast(value, *(it->second->getValue()), throwError);
 	}
+	/**
+	 * Set a property from a BacnetValue without throwing
+	 * On failure the error class and code describing why the property could not be
+	 * set are returned in {eClass} and {eCode}.
+	 *
+	 * return true if the property was set
+	 */
+	bool trySetProperty(PropertyIdentifierEnum id, const BacnetValue& value,
+			ErrorClassEnum& eClass, ErrorCodeEnum& eCode);
 	bool isPropertyRemoteWrittable(PropertyIdentifierEnum id) const;
+	/**
+	 * Return the property itself or a null reference if the object does not have it
+	 */
+	PropertyRef findProperty(PropertyIdentifierEnum id) const;
+	const PropertyMap& getProperties() const { return _properties; }
+	/**
+	 * Tell if the object has been removed from its device
+	 * Handles resolved on the object keep it alive and use this flag to detect
+	 * that it is not served anymore.
+	 */
+	bool isDeleted() const { return _deleted; }
+	void markDeleted() { _deleted = true; }
 	bool isPropertyModified(PropertyIdentifierEnum id) const;
 	void clearPropertyModified(PropertyIdentifierEnum id);
 	bool isPropertyDirty(PropertyIdentifierEnum id) const;
@@ -118,10 +145,10 @@ public:
 
 protected:
 	void init(const ObjectIdentifier& oid, std::string& name, const ObjectPropertySet *props);
-	//PropertyRef getProperty(PropertyIdentifierEnum prop) const;
 	void copy(const Object& object);
 
 	PropertyMap _properties;
+	bool _deleted;
 };
 
 
@@ -0,0 +1,160 @@
+/*
+ * BacnetPool.cpp
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#include <stdlib.h>
+#include "BacnetPool.h"
+
+namespace VIGBACNET {
+
+Pool::SizeClass Pool::_classes[Pool::ClassCount];
+Pool::ThreadCache* volatile Pool::_caches;
+__thread Pool::ThreadCache* Pool::_cache;
+volatile uint64_t Pool::_largeLive;
+volatile uint64_t Pool::_largeLiveBytes;
+volatile uint64_t Pool::_largeAllocations;
+
+void* Pool::allocate(size_t size) {
+	if (size > MaxSize) {
+		void* p = ::operator new(size);
+		__sync_fetch_and_add(&_largeLive, 1);
+		__sync_fetch_and_add(&_largeLiveBytes, size);
+		__sync_fetch_and_add(&_largeAllocations, 1);
+		return p;
+	}
+	size_t index = size ? (size - 1) / Granularity : 0;
+	ThreadCache& cache = *threadCache();
+	if (!cache.free[index]) {
+		fill(cache, index);
+	}
+	Block* block = cache.free[index];
+	cache.free[index] = block->next;
+	cache.count[index]--;
+	cache.live[index]++;
+	cache.allocations[index]++;
+	return block;
+}
+
+void Pool::deallocate(void* p, size_t size) {
+	if (!p) {
+		return;
+	}
+	if (size > MaxSize) {
+		::operator delete(p);
+		__sync_fetch_and_sub(&_largeLive, 1);
+		__sync_fetch_and_sub(&_largeLiveBytes, size);
+		return;
+	}
+	size_t index = size ? (size - 1) / Granularity : 0;
+	ThreadCache& cache = *threadCache();
+	Block* block = (Block*)p;
+	block->next = cache.free[index];
+	cache.free[index] = block;
+	cache.live[index]--;
+	if (++cache.count[index] > 2 * Batch) {
+		drain(cache, index);
+	}
+}
+
+Pool::ThreadCache* Pool::createCache() {
+	// Not from operator new, which may be the pool itself
+	ThreadCache* cache = (ThreadCache*)calloc(1, sizeof(ThreadCache));
+	if (!cache) {
+		throw std::bad_alloc();
+	}
+	do {
+		cache->next = _caches;
+	} while (!__sync_bool_compare_and_swap(&_caches, cache->next, cache));
+	_cache = cache;
+	return cache;
+}
+
+void Pool::fill(ThreadCache& cache, size_t index) {
+	SizeClass& sc = _classes[index];
+	size_t blockSize = (index + 1) * Granularity;
+	lock(sc);
+	if (!sc.free && sc.chunk == sc.chunkEnd) {
+		// The chunk holds a whole number of blocks so chunk reaches chunkEnd exactly
+		size_t chunkSize = ChunkSize - ChunkSize % blockSize;
+		char* chunk;
+		try {
+			chunk = (char*)::operator new(chunkSize);
+		} catch (...) {
+			unlock(sc);
+			throw;
+		}
+		sc.reservedBytes += chunkSize;
+		sc.chunk = chunk;
+		sc.chunkEnd = chunk + chunkSize;
+	}
+	for (uint32_t i = 0; i < Batch; i++) {
+		Block* block;
+		if (sc.free) {
+			block = sc.free;
+			sc.free = block->next;
+		} else if (sc.chunk != sc.chunkEnd) {
+			block = (Block*)sc.chunk;
+			sc.chunk += blockSize;
+		} else {
+			break;
+		}
+		block->next = cache.free[index];
+		cache.free[index] = block;
+		cache.count[index]++;
+	}
+	unlock(sc);
+}
+
+void Pool::drain(ThreadCache& cache, size_t index) {
+	// Keep the most recently freed blocks, they are the warmest
+	Block* last = cache.free[index];
+	for (uint32_t i = 1; i < Batch; i++) {
+		last = last->next;
+	}
+	Block* first = last->next;
+	last->next = 0;
+	Block* tail = first;
+	while (tail->next) {
+		tail = tail->next;
+	}
+	cache.count[index] = Batch;
+	SizeClass& sc = _classes[index];
+	lock(sc);
+	tail->next = sc.free;
+	sc.free = first;
+	unlock(sc);
+}
+
+void Pool::getStats(std::vector<Stats>& stats) {
+	stats.clear();
+	for (size_t i = 0; i < ClassCount; i++) {
+		Stats s;
+		s.blockSize = (i + 1) * Granularity;
+		int64_t live = 0;
+		s.allocations = 0;
+		for (ThreadCache* cache = _caches; cache; cache = cache->next) {
+			live += cache->live[i];
+			s.allocations += cache->allocations[i];
+		}
+		s.live = live > 0 ? (uint64_t)live : 0;
+		s.liveBytes = s.live * s.blockSize;
+		SizeClass& sc = _classes[i];
+		lock(sc);
+		s.reservedBytes = sc.reservedBytes;
+		unlock(sc);
+		if (s.allocations) {
+			stats.push_back(s);
+		}
+	}
+	Stats large;
+	large.blockSize = 0;
+	large.live = _largeLive;
+	large.liveBytes = _largeLiveBytes;
+	large.allocations = _largeAllocations;
+	large.reservedBytes = _largeLiveBytes;
+	stats.push_back(large);
+}
+
+} // VIGBACNET
@@ -0,0 +1,206 @@
+/*
+ * BacnetPool.h
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#ifndef BacnetPool_h
+#define BacnetPool_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace VIGBACNET {
+
+/**
+ * Size class pools of the small objects of the library
+ * The values, properties, objects, map nodes, transactions and events are created
+ * and deleted at a high rate and are all a few tens of bytes.  The requested size
+ * is rounded up to a multiple of 16 bytes, each of the 32 size classes keeps a free
+ * list of its blocks and carves new blocks out of 64KB chunks.  Sizes above 512
+ * bytes go to the global operator new.  Each thread caches a few free blocks per
+ * class so allocating and freeing take no lock nor atomic operation, the blocks move
+ * between the thread and the shared lists by batches.  Chunks are never given back
+ * to the system, nor are the blocks cached by a thread when it exits.
+ *
+ * The pools are used when the library is built with BACNET_POOL (make
+ * BACNET_POOL=1), the classes use the default allocator otherwise so both can be
+ * compared.  The code using the library must be built with the same setting.
+ */
+class Pool {
+public:
+	static const size_t Granularity = 16;
+	static const size_t MaxSize = 512;
+	static const size_t ClassCount = MaxSize / Granularity;
+	static const size_t ChunkSize = 64 * 1024;
+
+	/**
+	 * Counters of one size class, {blockSize} 0 for the sizes above MaxSize
+	 */
+	struct Stats {
+		size_t blockSize;
+		// Blocks in use and their bytes
+		uint64_t live;
+		uint64_t liveBytes;
+		// Blocks allocated since the start
+		uint64_t allocations;
+		// Bytes of the chunks, free blocks included
+		uint64_t reservedBytes;
+	};
+
+	static void* allocate(size_t size);
+	static void deallocate(void* p, size_t size);
+
+	/**
+	 * Get the counters of the size classes used so far, the large sizes last
+	 */
+	static void getStats(std::vector<Stats>& stats);
+
+	static bool isEnabled() {
+#ifdef BACNET_POOL
+		return true;
+#else
+		return false;
+#endif
+	}
+
+private:
+	// Blocks moved at once between a thread cache and its size class
+	static const uint32_t Batch = 32;
+
+	struct Block {
+		Block* next;
+	};
+
+	// Only zero initialized members so a pool is usable before the static
+	// constructors run, e.g. by the static objects of another file
+	struct SizeClass {
+		volatile int lock;
+		Block* free;
+		char* chunk;
+		char* chunkEnd;
+		uint64_t reservedBytes;
+	} __attribute__((aligned(64)));
+
+	/**
+	 * Free blocks and counters of one thread
+	 * The counters are only written by their thread, the stats add the counters of
+	 * all the caches so a block freed by another thread than the one which allocated
+	 * it is counted right.
+	 */
+	struct ThreadCache {
+		Block* free[ClassCount];
+		uint32_t count[ClassCount];
+		int64_t live[ClassCount];
+		uint64_t allocations[ClassCount];
+		ThreadCache* next;
+	};
+
+	static void lock(SizeClass& sc) {
+		while (__sync_lock_test_and_set(&sc.lock, 1)) {
+			while (sc.lock) {
+				// wait for the owner without hammering the cache line
+			}
+		}
+	}
+	static void unlock(SizeClass& sc) {
+		__sync_lock_release(&sc.lock);
+	}
+
+	static ThreadCache* threadCache() {
+		return _cache ? _cache : createCache();
+	}
+	static ThreadCache* createCache();
+	static void fill(ThreadCache& cache, size_t index);
+	static void drain(ThreadCache& cache, size_t index);
+
+	static SizeClass _classes[ClassCount];
+	static ThreadCache* volatile _caches;
+	static __thread ThreadCache* _cache;
+	static volatile uint64_t _largeLive;
+	static volatile uint64_t _largeLiveBytes;
+	static volatile uint64_t _largeAllocations;
+};
+
+/**
+ * Declare the class operators allocating the instances of the class and its
+ * subclasses from the pools
+ * The size given to operator delete is the one of the deleted class as long as the
+ * destructor is virtual, which is the case of the reference counted classes.
+ */
+#ifdef BACNET_POOL
+#define BACNET_POOL_ALLOCATED \
+	static void* operator new(size_t size) { \
+		return ::VIGBACNET::Pool::allocate(size); \
+	} \
+	static void operator delete(void* p, size_t size) { \
+		::VIGBACNET::Pool::deallocate(p, size); \
+	}
+#else
+#define BACNET_POOL_ALLOCATED
+#endif
+
+/**
+ * STL allocator on the pools, for the nodes of the maps
+ */
+template <typename T>
+class PoolStlAllocator {
+public:
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	template <typename U>
+	struct rebind {
+		typedef PoolStlAllocator<U> other;
+	};
+
+	PoolStlAllocator() {}
+	PoolStlAllocator(const PoolStlAllocator&) {}
+	template <typename U>
+	PoolStlAllocator(const PoolStlAllocator<U>&) {}
+
+	pointer address(reference x) const { return &x; }
+	const_pointer address(const_reference x) const { return &x; }
+
+	pointer allocate(size_type n, const void* = 0) {
+		return (pointer)Pool::allocate(n * sizeof(T));
+	}
+	void deallocate(pointer p, size_type n) {
+		Pool::deallocate(p, n * sizeof(T));
+	}
+
+	size_type max_size() const { return (size_t)-1 / sizeof(T); }
+
+	void construct(pointer p, const T& value) { new ((void*)p) T(value); }
+	void destroy(pointer p) { p->~T(); }
+
+	template <typename U>
+	bool operator==(const PoolStlAllocator<U>&) const { return true; }
+	template <typename U>
+	bool operator!=(const PoolStlAllocator<U>&) const { return false; }
+};
+
+/**
+ * Allocator of the containers of pooled elements, e.g.
+ * std::map<K, V, std::less<K>, PoolAllocator<std::pair<const K, V> >::Type>
+ */
+template <typename T>
+struct PoolAllocator {
+#ifdef BACNET_POOL
+	typedef PoolStlAllocator<T> Type;
+#else
+	typedef std::allocator<T> Type;
+#endif
+};
+
+} // VIGBACNET
+
+#endif /* BACNETPOOL_H_ */
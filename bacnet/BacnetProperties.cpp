@@ -101,7 +101,7 @@ static const ObjectPropertiesMap& getObjectPropertiesMap() {
 } // local namespace
 
 void ObjectProperties::getAll(ObjectPropertySet& s) {
-	const auto objProps = getObjectPropertiesMap();
+	const auto& objProps = getObjectPropertiesMap();
 	for (auto itObj = objProps.begin(); itObj != objProps.end(); itObj++) {
 		for (auto itProp = itObj->second.begin(); itProp != itObj->second.end(); itProp++) {
 			s.insert(new ObjectProperty(**itProp));
@@ -110,7 +110,7 @@ void ObjectProperties::getAll(ObjectPropertySet& s) {
 }
 
 void ObjectProperties::getAll(ObjectTypeEnum type, ObjectPropertySet& s) {
-	const auto objProps = getObjectPropertiesMap();
+	const auto& objProps = getObjectPropertiesMap();
 	auto itObj = objProps.find(type);
 	if (itObj != objProps.end()) {
 		for (auto itProp = itObj->second.begin(); itProp != itObj->second.end(); itProp++) {
@@ -120,7 +120,7 @@ void ObjectProperties::getAll(ObjectTypeEnum type, ObjectPropertySet& s) {
 }
 
 ObjectPropertyRef ObjectProperties::get(ObjectTypeEnum type, PropertyIdentifierEnum id) {
-	const auto objProps = getObjectPropertiesMap();
+	const auto& objProps = getObjectPropertiesMap();
 	auto itObj = objProps.find(type);
 	if (itObj != objProps.end()) {
 		ObjectPropertyRef refCmp;
@@ -159,7 +159,7 @@ bool ObjectProperties::isServerSupported(ObjectTypeEnum type) {
 
 BacnetValueRef ObjectProperties::getBacnetValue(ObjectTypeEnum type,
 		PropertyIdentifierEnum id, bool throwUnsupported) {
-	const auto objProps = getObjectPropertiesMap();
+	const auto& objProps = getObjectPropertiesMap();
 	auto itObj = objProps.find(type);
 	if (itObj != objProps.end()) {
 		ObjectPropertyRef refCmp;
@@ -169,14 +169,16 @@ BacnetValueRef ObjectProperties::getBacnetValue(ObjectTypeEnum type,
 			return (*itProp)->getDefaultProperty()->getValue()->clone();
 		}
 	}
-	throwException(BacnetErrorException(ErrorClassEnum::Property, ErrorCodeEnum::UnknownProperty,
-			FC::StringAPrintf("%s property of object %s does not exist", type.name(), id.name())));
+	if (throwUnsupported) {
+		throwException(BacnetErrorException(ErrorClassEnum::Property, ErrorCodeEnum::UnknownProperty,
+				FC::StringAPrintf("%s property of object %s does not exist", type.name(), id.name())));
+	}
 	return 0;
 }
 
 PropertyRef ObjectProperties::getProperty(ObjectTypeEnum type,
 		PropertyIdentifierEnum id) {
-	const auto objProps = getObjectPropertiesMap();
+	const auto& objProps = getObjectPropertiesMap();
 	auto itObj = objProps.find(type);
 	if (itObj != objProps.end()) {
 		ObjectPropertyRef refCmp;
@@ -24,6 +24,8 @@ namespace VIGBACNET {
  */
 class Property : public FC::RefObject, public FC::Formatter {
 public:
+	BACNET_POOL_ALLOCATED
+
 	Property(const BacnetValueRef &value, bool isRequired = false, bool isRemoteWrittable=false) :
 		_value(value), _isRemoteWrittable(isRemoteWrittable),
 		_isRequired(isRequired){ }
@@ -0,0 +1,174 @@
+/*
+ * BacnetQueue.h
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#ifndef BacnetQueue_h
+#define BacnetQueue_h
+
+#include <sched.h>
+#include <stdint.h>
+#include "fc.h"
+#include "BacnetSync.h"
+
+namespace VIGBACNET {
+
+/**
+ * What a bounded queue does with a new item when it is full
+ * - OverflowBlock waits for a consumer to make room, only for producers that can wait
+ * - OverflowDropOldest discards the oldest item to make room
+ * - OverflowReject refuses the new item
+ */
+enum OverflowPolicy {
+	OverflowBlock,
+	OverflowDropOldest,
+	OverflowReject,
+};
+
+/**
+ * Bounded lock-free queue for any number of producers and consumers
+ * Items live in a fixed ring allocated once, the capacity is rounded up to a power of
+ * two.  Each cell has a sequence number telling whether it is ready to be written or
+ * read, so producers and consumers only compete on their own position counter.
+ */
+template <typename T>
+class BoundedQueue : public FC::RefObject {
+public:
+	BoundedQueue(size_t capacity, OverflowPolicy policy = OverflowReject) :
+		_policy(policy), _dropped(0), _rejected(0), _enqueuePos(0), _dequeuePos(0) {
+		size_t size = 2;
+		while (size < capacity) {
+			size <<= 1;
+		}
+		_mask = size - 1;
+		_cells = new Cell[size];
+		for (size_t i = 0; i < size; i++) {
+			_cells[i].sequence = i;
+		}
+	}
+
+	~BoundedQueue() {
+		delete [] _cells;
+	}
+
+	/**
+	 * Add an item applying the queue overflow policy
+	 * return false if the item was rejected
+	 */
+	bool push(const T& item) {
+		switch (_policy) {
+		case OverflowBlock:
+			while (!tryPush(item)) {
+				sched_yield();
+			}
+			return true;
+		case OverflowDropOldest:
+			while (!tryPush(item)) {
+				T oldest;
+				if (pop(oldest)) {
+					__sync_fetch_and_add(&_dropped, 1);
+				}
+			}
+			return true;
+		default:
+			if (tryPush(item)) {
+				return true;
+			}
+			__sync_fetch_and_add(&_rejected, 1);
+			return false;
+		}
+	}
+
+	/**
+	 * Add an item if there is room
+	 */
+	bool tryPush(const T& item) {
+		Cell* cell;
+		size_t pos = _enqueuePos;
+		for (;;) {
+			cell = &_cells[pos & _mask];
+			size_t seq = cell->sequence;
+			__sync_synchronize();
+			intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+			if (diff == 0) {
+				if (__sync_bool_compare_and_swap(&_enqueuePos, pos, pos + 1)) {
+					break;
+				}
+				pos = _enqueuePos;
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = _enqueuePos;
+			}
+		}
+		cell->data = item;
+		__sync_synchronize();
+		cell->sequence = pos + 1;
+		return true;
+	}
+
+	/**
+	 * Remove the oldest item
+	 * return false if the queue is empty
+	 */
+	bool pop(T& item) {
+		Cell* cell;
+		size_t pos = _dequeuePos;
+		for (;;) {
+			cell = &_cells[pos & _mask];
+			size_t seq = cell->sequence;
+			__sync_synchronize();
+			intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+			if (diff == 0) {
+				if (__sync_bool_compare_and_swap(&_dequeuePos, pos, pos + 1)) {
+					break;
+				}
+				pos = _dequeuePos;
+			} else if (diff < 0) {
+				return false;
+			} else {
+				pos = _dequeuePos;
+			}
+		}
+		item = cell->data;
+		// Do not keep what the item references alive until the cell is reused
+		cell->data = T();
+		__sync_synchronize();
+		cell->sequence = pos + _mask + 1;
+		return true;
+	}
+
+	size_t capacity() const { return _mask + 1; }
+	OverflowPolicy policy() const { return _policy; }
+	// Only a hint while producers or consumers are running
+	size_t size() const { return _enqueuePos - _dequeuePos; }
+	uint64_t dropped() const { return _dropped; }
+	uint64_t rejected() const { return _rejected; }
+
+private:
+	BoundedQueue(const BoundedQueue&);
+	BoundedQueue& operator=(const BoundedQueue&);
+
+	struct Cell {
+		volatile size_t sequence;
+		T data;
+	};
+
+	Cell* _cells;
+	size_t _mask;
+	OverflowPolicy _policy;
+	volatile uint64_t _dropped;
+	volatile uint64_t _rejected;
+	// Producers and consumers positions each a cache line away from anything else, the
+	// queues are allocated with new which does not honor an over alignment
+	char _pad0[CacheLineSize];
+	volatile size_t _enqueuePos;
+	char _pad1[CacheLineSize];
+	volatile size_t _dequeuePos;
+	char _pad2[CacheLineSize];
+};
+
+} // VIGBACNET
+
+#endif /* BACNETQUEUE_H_ */
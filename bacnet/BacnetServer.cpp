@@ -5,13 +5,16 @@
  */
 
 
-#include <sys/time.h>
+#include <algorithm>
+#include <functional>
 #include "fc.h"
 #include "FCStopWatch.h"
 #include "BacnetServer.h"
 #include "vsbhp.h"
 #include "mstp.h"
 #include "BacnetVsbConverter.h"
+#include "BacnetTrace.h"
+#include "BacnetLog.h"
 
 
 namespace VIGBACNET {
@@ -34,31 +37,155 @@ PropertiesSetter defaultPropertiesSetter = {
 	2,														// BBMD TTL
 	DeviceAddress(DeviceAddress::getLocalhostIp(), 0xBAC0),	// Device Address
 	DeviceAddress::getLocalhostBroadcast(),					// Device Broadcast Address,
-	5 														// stack process rate in msec
+	5, 														// stack process rate in msec
+	8,														// transaction shards
+	0,														// response decoding threads
+	TransactionManager::DefaultRecycleMs,					// unanswered transaction life
+	TransactionManager::DefaultLiveMs						// completed transaction life
 };
 
 ServerManager::InstanceServerMap ServerManager::_servers;
+ServerRef ServerManager::_primary;
+ServerManager::ObjectServerMap ServerManager::_objectServers;
+ServerManager::VbagStripe ServerManager::_vbagStripes[StripedLock::NumStripes];
+RWLock ServerManager::_lock;
+FC::Mutex Server::_stackMutex;
 
 ServerRef ServerManager::createServer(const PropertiesSetter& props) {
-	if (_servers.size() < MaxServerAllowed &&
-		_servers.find(props.deviceInstance) == _servers.end()) {
-		ServerRef server = new Server(props.deviceInstance, props.deviceName, props.processRate);
-		setServerProperties(server, props);
-		_servers[props.deviceInstance] = server;
-		return server;
+	{
+		ReadLock lock(_lock);
+		if (_servers.size() >= MaxServerAllowed ||
+			_servers.find(props.deviceInstance) != _servers.end()) {
+			return 0;
+		}
 	}
-	return 0;
+	// Set the properties before the server can be reached by the stack
+	ServerRef server = new Server(props.deviceInstance, props.deviceName, props.processRate,
+			props.transactionShards);
+	setServerProperties(server, props);
+	WriteLock lock(_lock);
+	uint32_t deviceOid = ObjectIdentifier(ObjectTypeEnum::Device, props.deviceInstance).getCoded();
+	if (_servers.size() >= MaxServerAllowed ||
+		_servers.find(props.deviceInstance) != _servers.end() ||
+		_objectServers.find(deviceOid) != _objectServers.end()) {
+		return 0;
+	}
+	_servers[props.deviceInstance] = server;
+	_objectServers[deviceOid] = server.get();
+	if (!_primary) {
+		_primary = server;
+	}
+	return server;
 }
 
 bool ServerManager::deleteServer(ObjectInstance serverInstance) {
-	return _servers.erase(serverInstance) > 0;
+	WriteLock lock(_lock);
+	auto it = _servers.find(serverInstance);
+	if (it == _servers.end()) {
+		return false;
+	}
+	Server* server = it->second.get();
+	auto oit = _objectServers.begin();
+	while (oit != _objectServers.end()) {
+		if (oit->second == server) {
+			oit = _objectServers.erase(oit);
+		} else {
+			++oit;
+		}
+	}
+	for (size_t i = 0; i < StripedLock::NumStripes; i++) {
+		VbagStripe& stripe = _vbagStripes[i];
+		FC::MutexLock vbagLock(stripe.mutex);
+		auto vit = stripe.routes.begin();
+		while (vit != stripe.routes.end()) {
+			if (vit->second.server == server) {
+				vit = stripe.routes.erase(vit);
+			} else {
+				++vit;
+			}
+		}
+	}
+	if (_primary.get() == server) {
+		_primary = 0;
+	}
+	_servers.erase(it);
+	if (!_primary && !_servers.empty()) {
+		_primary = _servers.begin()->second;
+	}
+	return true;
 }
 
 ServerRef ServerManager::getServer(ObjectInstance serverInstance) {
+	ReadLock lock(_lock);
 	auto it = _servers.find(serverInstance);
 	return (it != _servers.end()) ? it->second : ServerRef(0);
 }
 
+ServerRef ServerManager::getPrimaryServer() {
+	ReadLock lock(_lock);
+	return _primary;
+}
+
+ServerRef ServerManager::getObjectServer(const ObjectIdentifier& oid) {
+	ReadLock lock(_lock);
+	auto it = _objectServers.find(oid.getCoded());
+	return (it != _objectServers.end()) ? ServerRef(it->second) : ServerRef(0);
+}
+
+ServerRef ServerManager::getTransactionServer(const frVbag& bag, unsigned* shard) {
+	VbagStripe& stripe = vbagStripe(&bag);
+	FC::MutexLock lock(stripe.mutex);
+	auto it = stripe.routes.find(&bag);
+	if (it == stripe.routes.end()) {
+		return 0;
+	}
+	if (shard) {
+		*shard = it->second.shard;
+	}
+	return it->second.server;
+}
+
+void ServerManager::getServers(std::vector<ServerRef>& servers) {
+	ReadLock lock(_lock);
+	servers.reserve(servers.size() + _servers.size());
+	auto it = _servers.begin();
+	while (it != _servers.end()) {
+		servers.push_back(it->second);
+		it++;
+	}
+}
+
+bool ServerManager::registerObject(const ObjectIdentifier& oid, Server* server) {
+	WriteLock lock(_lock);
+	auto it = _objectServers.find(oid.getCoded());
+	if (it != _objectServers.end()) {
+		return it->second == server;
+	}
+	_objectServers[oid.getCoded()] = server;
+	return true;
+}
+
+void ServerManager::unregisterObject(const ObjectIdentifier& oid, const Server* server) {
+	WriteLock lock(_lock);
+	auto it = _objectServers.find(oid.getCoded());
+	if (it != _objectServers.end() && it->second == server) {
+		_objectServers.erase(it);
+	}
+}
+
+void ServerManager::registerTransaction(const frVbag* bag, Server* server, unsigned shard) {
+	VbagStripe& stripe = vbagStripe(bag);
+	VbagRoute route = { server, shard };
+	FC::MutexLock lock(stripe.mutex);
+	stripe.routes[bag] = route;
+}
+
+void ServerManager::unregisterTransaction(const frVbag* bag) {
+	VbagStripe& stripe = vbagStripe(bag);
+	FC::MutexLock lock(stripe.mutex);
+	stripe.routes.erase(bag);
+}
+
 void ServerManager::setServerProperties(const ServerRef& server, const PropertiesSetter& props) {
 	server->setProperty(PropertyIdentifierEnum::SystemStatus,
 			props.systemStatus);
@@ -88,14 +215,21 @@ void ServerManager::setServerProperties(const ServerRef& server, const Propertie
 	server->setBbmdTtl(props.bbmdTtl);
 	server->setAddress(props.address);
 	server->setBroadcast(props.broadcastAddress);
+	server->setAckWorkers(props.ackWorkers);
+	server->setTransactionTimeouts(props.transactionRecycleMs, props.transactionLiveMs);
 }
 
 
 TransactionRef TransactionManager::createTransaction(const ConfirmedServiceChoiceEnum& service,
-		ConfirmedRequestAckRef ack) {
-	TransactionRef ref = new Transaction(++_currentId, service, ack);
+		ConfirmedRequestAckRef ack, Transaction::IdType id) {
+	TransactionRef ref = new Transaction(id ? id : nextId(), service, ack);
 	_uuidTransMap[ref->transId()] = ref;
 	_vbagTransMap[ref->vbag()] = ref;
+	if (_owner) {
+		ServerManager::registerTransaction(ref->vbag(), _owner, _shard);
+		_owner->_stats.outgoingService(service.get()).requests.add();
+	}
+	HotTrace::record(HotTrace::TransactionCreated, service.get(), ref->transId());
 	FC_Debug1f("Created Bacnet transaction %llu", ref->transId());
 	return ref;
 }
@@ -103,9 +237,13 @@ TransactionRef TransactionManager::createTransaction(const ConfirmedServiceChoic
 
 void TransactionManager::deleteTransaction(TransactionRef trans) {
 	if (trans) {
+		HotTrace::record(HotTrace::TransactionDeleted, 0, trans->transId());
 		FC_Debug1f("Delete Bacnet transaction %llu", trans->transId());
 		_uuidTransMap.erase(trans->transId());
 		_vbagTransMap.erase(trans->vbag());
+		if (_owner) {
+			ServerManager::unregisterTransaction(trans->vbag());
+		}
 	}
 }
 
@@ -173,18 +311,24 @@ void TransactionManager::extendTransactionLife(const Transaction::IdType& id) {
  * will have their timer started.  Expired transaction will be deleted.
  */
 void TransactionManager::cleanup() {
-	time_t now = time(0);
+	uint64_t now = TickClock::now();
 	auto it = _uuidTransMap.begin();
 	while (it != _uuidTransMap.end()) {
 		TransactionRef trans = it->second;
 		if (trans) {
 			// Start complete transaction timer for newly discovered complete transaction
-			if (trans->vbag()->status == vbsComplete && (now - trans->completeTime()) == 0) {
+			if (trans->vbag()->status == vbsComplete && trans->completeTime() == 0) {
 				trans->resetCompleteTime();
 			}
-			if (((now - trans->createTime()) > RecycleTime) ||
-				 (trans->vbag()->status == vbsComplete &&
-				 (now - trans->completeTime()) > LiveTime)) {
+			bool complete = (trans->vbag()->status == vbsComplete);
+			if ((now > trans->createTime() + _recycleTime) ||
+				 (complete && now > trans->completeTime() + _liveTime)) {
+				if (_owner) {
+					(complete ? _owner->_stats.expiredComplete : _owner->_stats.expiredPending).add();
+				}
+				if (trans->state() == Transaction::Pending && trans->remoteStats()) {
+					trans->remoteStats()->recordExpired();
+				}
 				deleteTransaction(it++->first);
 			} else {
 				++it;
@@ -198,35 +342,195 @@ void TransactionManager::cleanup() {
 	}
 }
 
-Server::Server(ObjectInstance instance, const std::string& name, unsigned doWorkRateMsec) :
-	_bbmdIp("0.0.0.0"), _bbmdTtl(0), _broadcast(""), _started(false) , _workRate(doWorkRateMsec),
-	_transMgr(new TransactionManager()) {
+TransactionShards::TransactionShards(Server* owner, unsigned count) :
+	_count(count == 0 ? 1 : (count > MaxShards ? MaxShards : count)) {
+	_shards = new Shard[_count];
+	for (unsigned i = 0; i < _count; i++) {
+		_shards[i].manager = new TransactionManager(owner, i, _count);
+	}
+}
+
+TransactionShards::~TransactionShards() {
+	delete [] _shards;
+}
+
+TransactionRef TransactionShards::createTransaction(ObjectInstance device,
+		const ConfirmedServiceChoiceEnum& service, ConfirmedRequestAckRef ack) {
+	Shard& s = _shards[device % _count];
+	FC::MutexLock lock(s.mutex);
+	return s.manager->createTransaction(service, ack);
+}
+
+TransactionRef TransactionShards::createTransaction(const Transaction::IdType& id,
+		const ConfirmedServiceChoiceEnum& service, ConfirmedRequestAckRef ack) {
+	Shard& s = shard(id);
+	FC::MutexLock lock(s.mutex);
+	return s.manager->createTransaction(service, ack, id);
+}
+
+void TransactionShards::deleteTransaction(TransactionRef trans) {
+	if (trans) {
+		Shard& s = shard(trans->transId());
+		FC::MutexLock lock(s.mutex);
+		s.manager->deleteTransaction(trans);
+	}
+}
+
+void TransactionShards::deleteTransaction(const Transaction::IdType& id) {
+	Shard& s = shard(id);
+	FC::MutexLock lock(s.mutex);
+	TransactionRef trans = s.manager->getTransaction(id);
+	// Deleted by the application before its response, which will not be counted
+	if (trans && trans->state() == Transaction::Pending && trans->remoteStats()) {
+		trans->remoteStats()->recordCancelled();
+	}
+	s.manager->deleteTransaction(trans);
+}
+
+TransactionRef TransactionShards::getTransaction(const Transaction::IdType& id) {
+	Shard& s = shard(id);
+	FC::MutexLock lock(s.mutex);
+	return s.manager->getTransaction(id);
+}
+
+TransactionRef TransactionShards::getTransaction(const frVbag& bag, unsigned shard) {
+	Shard& s = _shards[shard % _count];
+	FC::MutexLock lock(s.mutex);
+	return s.manager->getTransaction(bag);
+}
+
+void TransactionShards::setTimeouts(uint32_t recycleMs, uint32_t liveMs) {
+	for (unsigned i = 0; i < _count; i++) {
+		FC::MutexLock lock(_shards[i].mutex);
+		_shards[i].manager->setTimeouts(recycleMs, liveMs);
+	}
+}
+
+void TransactionShards::cleanup() {
+	for (unsigned i = 0; i < _count; i++) {
+		FC::MutexLock lock(_shards[i].mutex);
+		_shards[i].manager->cleanup();
+	}
+}
+
+Server::Server(ObjectInstance instance, const std::string& name, unsigned doWorkRateMsec,
+		unsigned transactionShards) :
+	_bbmdIp("0.0.0.0"), _bbmdTtl(0), _broadcast(""), _started(false), _ownsStack(false),
+	_workRate(doWorkRateMsec), _transMgr(new TransactionShards(this, transactionShards)),
+	_batchEvents(false), _hotPointsEnabled(false) {
+#ifdef VSB_DEFERRED_RESPONSE
+	_deferredWrites = false;
+#endif
 	_localDev = new Device(instance, name);
+	_localOid = ObjectIdentifier(ObjectTypeEnum::Device, instance);
+	addSlot(_localOid);
+}
+
+void Server::addObject(const Object& obj) {
+	WriteLock dbLock(_dbLock);
+	ObjectIdentifier oid = obj.getOid();
+	_localDev->addObject(obj);
+	// The stack callbacks find the server by object, it must be unique in the process
+	if (!ServerManager::registerObject(oid, this)) {
+		_localDev->deleteObject(oid);
+		std::ostringstream oss;
+		oss << "Object " << oid << " is already hosted by another device.";
+		throwException(BacnetErrorException(ErrorClassEnum::Object,
+				ErrorCodeEnum::ObjectIdentifierAlreadyExists, oss.str()));
+	}
+	addSlot(oid);
+}
+
+void Server::deleteObject(const ObjectIdentifier& oid) {
+	WriteLock dbLock(_dbLock);
+	_localDev->deleteObject(oid);
+	ServerManager::unregisterObject(oid, this);
+	_slots.erase(oid.getCoded());
+	_dbVersion.increment();
+}
+
+DatabaseSnapshotRef Server::snapshot() const {
+	DatabaseSnapshotRef snap = _snapshot.load();
+	if (snap && snap->version() == _dbVersion.get()) {
+		return snap;
+	}
+	// Objects were added or deleted, the version cannot change while the read lock is held
+	ReadLock dbLock(_dbLock);
+	FC::MutexLock lock(_snapshotMutex);
+	uint32_t version = _dbVersion.get();
+	snap = _snapshot.load();
+	if (snap && snap->version() == version) {
+		return snap;
+	}
+	snap = new DatabaseSnapshot(version);
+	snap->reserve(_slots.size());
+	auto it = _slots.begin();
+	while (it != _slots.end()) {
+		snap->add(it->first, it->second);
+		it++;
+	}
+	_snapshot.store(snap);
+	return snap;
 }
 
 void Server::doWork() {
-	FC::MutexLock lock(_mutex);
-	struct timeval now;
-	gettimeofday(&now, NULL);
-	unsigned elapsedms = unsigned((now.tv_sec - _lastWork.tv_sec) * 1000 +
-			(now.tv_usec - _lastWork.tv_usec) / 1000);
+	FC::MutexLock lock(_stackMutex);
+	uint64_t now = TickClock::tick();
+	unsigned elapsedms = unsigned((now - _lastWork) / 1000000);
 	// Prevent frWork to be called more than DoWorkRate or it might messup the EverySecond count
 	bool elapsedOk = (elapsedms >= DoWorkRate);
 	if (_started) {
-		frMain();
-		if (elapsedOk) {
-			frWork((byte)elapsedms);
-			gettimeofday(&_lastWork, NULL);
+		_stats.workTicks.add();
+		if (_ownsStack) {
+			uint64_t start = Clock::now();
+			frMain();
+			_stats.workMain.recordSince(start);
+			if (elapsedOk) {
+				start = Clock::now();
+				frWork((byte)elapsedms);
+				_stats.workStack.recordSince(start);
+				_lastWork = now;
+			}
 		}
+		sendSubmitted();
+		uint64_t start = Clock::now();
 		_transMgr->cleanup();
+		_stats.workCleanup.recordSince(start);
+#ifdef VSB_DEFERRED_RESPONSE
+		expirePendingWrites();
+#endif
+		flushEvents();
+	}
+}
+
+void Server::flushEvents() {
+	FC::Ref<EventBatchEvent> event;
+	{
+		FC::MutexLock lock(_eventMutex);
+		if (_pendingEvents.empty()) {
+			return;
+		}
+		// Copy the records so the queue keeps its capacity for the next tick
+		event = new EventBatchEvent(_pendingEvents);
+		_pendingEvents.clear();
 	}
+	post(event);
 }
 
 void Server::initialize() {
-	FC_Debug1("Starting the BACnet server");
-	frStartup(portBIP);
+	FC_Debug1f("Starting the BACnet server, request debug messages %s (BACNET_DEBUG)",
+			Log::isDebug() ? "on" : "off");
+	// Only the primary server runs the stack, the others are reached through it
+	_ownsStack = (ServerManager::getPrimaryServer().get() == this);
+	if (_ownsStack) {
+		FC::MutexLock lock(_stackMutex);
+		frStartup(portBIP);
+	}
+	if (_ackWorkers) {
+		_ackWorkers->start();
+	}
 	_started = true;
-	gettimeofday(&_lastWork, NULL);
+	_lastWork = TickClock::startLoop();
 	on(&Server::onDoWork);
 	_workTimer = new DoWorkTimer(_workRate);
 	_workTimer->start(this);
@@ -239,12 +543,106 @@ void Server::fini() {
 	FC_Debug1("Stopping the BACnet server");
 	_workTimer->stop();
 	_started = false;
-	frStop(portBIP);
+	TickClock::stopLoop();
+	if (_ackWorkers) {
+		_ackWorkers->stop();
+	}
+	if (_ownsStack) {
+		FC::MutexLock lock(_stackMutex);
+		frStop(portBIP);
+		_ownsStack = false;
+	}
 	EventThread::fini();
 }
 
+namespace {
+
+/**
+ * Order batch entries by object lock, then by object, then by caller order
+ */
+struct SortUpdateByLock {
+	SortUpdateByLock(const PropertyUpdate* updates) : _updates(updates) {}
+	bool operator() (size_t lhs, size_t rhs) const {
+		uint32_t l = _updates[lhs].oid.getCoded();
+		uint32_t r = _updates[rhs].oid.getCoded();
+		size_t lStripe = StripedLock::index(l);
+		size_t rStripe = StripedLock::index(r);
+		if (lStripe != rStripe) {
+			return lStripe < rStripe;
+		}
+		if (l != r) {
+			return l < r;
+		}
+		return lhs < rhs;
+	}
+	const PropertyUpdate* _updates;
+};
+
+} // local namespace
+
+size_t Server::setProperties(PropertyUpdate* updates, size_t count) {
+	std::vector<ObjectIdentifier> changed;
+	std::vector<PropertyIdentifierEnum> pids;
+	std::vector<size_t> order(count);
+	size_t applied = 0;
+	for (size_t i = 0; i < count; i++) {
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), SortUpdateByLock(updates));
+	{
+		ReadLock dbLock(_dbLock);
+		size_t start = 0;
+		while (start < count) {
+			// Find all the entries sharing the same object lock
+			size_t stripe = StripedLock::index(updates[order[start]].oid.getCoded());
+			size_t end = start + 1;
+			while (end < count && StripedLock::index(updates[order[end]].oid.getCoded()) == stripe) {
+				end++;
+			}
+			WriteLock objLock(_objLocks.at(stripe));
+			applied += _localDev->applyObjectProperties(updates, &order[start], end - start,
+					&changed);
+			// Publish each changed object once with all its changed properties
+			while (start < end) {
+				const ObjectIdentifier& oid = updates[order[start]].oid;
+				pids.clear();
+				for (; start < end && updates[order[start]].oid == oid; start++) {
+					if (updates[order[start]].success) {
+						pids.push_back(updates[order[start]].pid);
+					}
+				}
+				if (!pids.empty()) {
+					publishProperties(oid, &pids[0], pids.size());
+				}
+			}
+		}
+	}
+	if (!changed.empty()) {
+		FC::Ref<PropertiesChangedEvent> event(new PropertiesChangedEvent(changed));
+		post(event);
+	}
+	return applied;
+}
+
+void Server::publishProperties(const ObjectIdentifier& oid, const PropertyIdentifierEnum* ids,
+		size_t count) {
+	auto it = _slots.find(oid.getCoded());
+	ObjectRef obj = _localDev->findObject(oid);
+	if (it == _slots.end() || !obj) {
+		return;
+	}
+	CompactObjectRef version = new CompactObject(*it->second->load());
+	for (size_t i = 0; i < count; i++) {
+		PropertyRef prop = obj->findProperty(ids[i]);
+		if (prop && prop->getValue()) {
+			version->setProperty(ids[i], *prop->getValue());
+		}
+	}
+	it->second->store(version);
+}
+
 void Server::sendWhoIs(const WhoIsRequest& request) const {
-	FC::MutexLock lock(_mutex);
+	FC::MutexLock lock(_stackMutex);
 	frcForceRangeWhoIs(request.min(), request.max());
 }
 
@@ -252,6 +650,62 @@ void Server::sendIAm() const {
 
 }
 
+TransactionRef Server::createReadTransaction(ObjectInstance device,
+		const ReadPropertyRequest& request, Transaction::IdType id) const {
+	BacnetValueRef value = ObjectProperties::getBacnetValue(request.oid().getType(), request.pid());
+	ConfirmedRequestAckRef ack = new ReadPropertyAck(request.oid(), request.pid(), *value, request.index());
+	TransactionRef trans = id ? _transMgr->createTransaction(id, request.service(), ack) :
+			_transMgr->createTransaction(device, request.service(), ack);
+	trans->setRemoteStats(remoteStats(device));
+	trans->setSpanDevice(device);
+	return trans;
+}
+
+TransactionRef Server::createWriteTransaction(ObjectInstance device,
+		const WritePropertyRequest& request, Transaction::IdType id) const {
+	ConfirmedRequestAckRef ack = new WritePropertyAck(request.oid(), request.pid());
+	TransactionRef trans = id ? _transMgr->createTransaction(id, request.service(), ack) :
+			_transMgr->createTransaction(device, request.service(), ack);
+	trans->setRemoteStats(remoteStats(device));
+	trans->setSpanDevice(device);
+	return trans;
+}
+
+int Server::transmitRead(ObjectInstance device, const ReadPropertyRequest& request,
+		Transaction& trans) const {
+	trans.vbag()->narray = (byte)request.index();
+	trans.markSpan(&TransactionSpan::submitted);
+	int result = frcReadProperty(device, request.oid().getCoded(), request.pid().get(),
+			request.index().get(), trans.vbag());
+	HotTrace::record(HotTrace::TransactionSent, device, trans.transId(), (uint32_t)result);
+	if (result == 0) {
+		trans.remoteStats()->recordSent();
+	} else {
+		trans.finishSpan(result);
+	}
+	return result;
+}
+
+int Server::transmitWrite(ObjectInstance device, const WritePropertyRequest& request,
+		Transaction& trans) const {
+	if (!VsbConverter::toVbag(*request.value(), *(trans.vbag()))) {
+		return VsbConverter::toError(Error(ErrorClassEnum::Property,
+				ErrorCodeEnum::DatatypeNotSupported));
+	}
+	trans.vbag()->priority = (byte)request.priority();
+	trans.vbag()->narray = (byte)request.index();
+	trans.markSpan(&TransactionSpan::submitted);
+	int result = frcWriteProperty(device, request.oid().getCoded(), request.pid().get(),
+				request.index().get(), trans.vbag());
+	HotTrace::record(HotTrace::TransactionSent, device, trans.transId(), (uint32_t)result);
+	if (result == 0) {
+		trans.remoteStats()->recordSent();
+	} else {
+		trans.finishSpan(result);
+	}
+	return result;
+}
+
 /**
  * Send a read property request to a remote device
  *
@@ -260,14 +714,9 @@ void Server::sendIAm() const {
  */
 Transaction::IdType Server::sendReadProperty(ObjectInstance device,
 		const ReadPropertyRequest& request) const {
-	FC::MutexLock lock(_mutex);
-	int result = 0;
-	BacnetValueRef value = ObjectProperties::getBacnetValue(request.oid().getType(), request.pid());
-	ConfirmedRequestAckRef ack = new ReadPropertyAck(request.oid(), request.pid(), *value, request.index());
-	TransactionRef trans = _transMgr->createTransaction(request.service(), ack);
-	trans->vbag()->narray = (byte)request.index();
-	result = frcReadProperty(device, request.oid().getCoded(), request.pid().get(),
-			request.index().get(), trans->vbag());
+	FC::MutexLock lock(_stackMutex);
+	TransactionRef trans = createReadTransaction(device, request);
+	int result = transmitRead(device, request, *trans);
 	if (result != 0) {
 		_transMgr->deleteTransaction(trans);
 		Error err = VsbConverter::fromError((uint16_t)result);
@@ -275,49 +724,118 @@ Transaction::IdType Server::sendReadProperty(ObjectInstance device,
 				"Could not read %s-%d of device %d", request.oid().getType().name(),
 				request.oid().getInstance(), device)));
 	} else {
-		std::ostringstream oss;
-		oss << "Successfully sent read transaction (" << trans->transId() << "): " <<
-				    "request: " << request << ", ack: " << *ack;
-		FC_Debug1(oss.str().c_str());
+		BACNET_DEBUG1("Successfully sent read transaction (" << trans->transId() << "): " <<
+				"request: " << request << ", ack: " << *trans->ack());
 	}
 	return trans->transId();
 }
 
 Transaction::IdType Server::sendWriteProperty(ObjectInstance device,
 		const WritePropertyRequest& request) const {
-	FC::MutexLock lock(_mutex);
-	int result = 0;
-	ConfirmedRequestAckRef ack = new WritePropertyAck(request.oid(), request.pid());
-	TransactionRef trans = _transMgr->createTransaction(request.service(), ack);
-	if (VsbConverter::toVbag(*request.value(), *(trans->vbag()))) {;
-		trans->vbag()->priority = (byte)request.priority();
-		trans->vbag()->narray = (byte)request.index();
-		result = frcWriteProperty(device, request.oid().getCoded(), request.pid().get(),
-					request.index().get(), trans->vbag());
+	FC::MutexLock lock(_stackMutex);
+	TransactionRef trans = createWriteTransaction(device, request);
+	int result = transmitWrite(device, request, *trans);
+	if (result != 0) {
+		_transMgr->deleteTransaction(trans);
+		Error err = VsbConverter::fromError((uint16_t)result);
+		throwException(BacnetErrorException(err.getClass(), err.getCode(), FC::StringAPrintf(
+				"Could not write %s-%d of device %d (%s)", request.oid().getType().name(),
+				request.oid().getInstance(), device, request.value()->typeName())));
+	} else {
+		BACNET_DEBUG1("Successfully sent write transaction (" << trans->transId() << "): " <<
+				"request: " << request << ", ack: " << *trans->ack());
+	}
+	return trans->transId();
+}
+
+void Server::openQueues(const QueueSettings& settings) {
+	_submitQueue = new BoundedQueue<SubmitRecord>(settings.submitCapacity, settings.submitPolicy);
+	_ackQueue = new BoundedQueue<EventRecord>(settings.ackCapacity, settings.ackPolicy);
+	_writeQueue = new BoundedQueue<EventRecord>(settings.writeCapacity, settings.writePolicy);
+}
+
+Transaction::IdType Server::submit(ObjectInstance device, const ConfirmedRequestRef& request,
+		const TransactionRef& trans) {
+	SubmitRecord record;
+	record.trans = trans;
+	record.device = device;
+	record.request = request;
+	record.submitted = Clock::now();
+	if (!_submitQueue->push(record)) {
+		_transMgr->deleteTransaction(trans);
+		return 0;
+	}
+	return trans->transId();
+}
+
+Transaction::IdType Server::submitReadProperty(ObjectInstance device,
+		const ReadPropertyRequest& request) {
+	if (!_submitQueue) {
+		throwException(BacnetApplicationException("The server queues are not open."));
+	}
+	TransactionRef trans = createReadTransaction(device, request, _transMgr->nextId(device));
+	return submit(device, new ReadPropertyRequest(request), trans);
+}
+
+Transaction::IdType Server::submitWriteProperty(ObjectInstance device,
+		const WritePropertyRequest& request) {
+	if (!_submitQueue) {
+		throwException(BacnetApplicationException("The server queues are not open."));
+	}
+	TransactionRef trans = createWriteTransaction(device, request, _transMgr->nextId(device));
+	return submit(device, new WritePropertyRequest(request), trans);
+}
+
+void Server::sendSubmitted() {
+	if (!_submitQueue) {
+		return;
+	}
+	SubmitRecord record;
+	while (_submitQueue->pop(record)) {
+		int result = 0;
+		if (record.trans->service() == ConfirmedServiceChoiceEnum::ReadProperty) {
+			result = transmitRead(record.device,
+					static_cast<const ReadPropertyRequest&>(*record.request), *record.trans);
+		} else {
+			result = transmitWrite(record.device,
+					static_cast<const WritePropertyRequest&>(*record.request), *record.trans);
+		}
+		_submitLatency.record(Clock::now() - record.submitted);
 		if (result != 0) {
-			_transMgr->deleteTransaction(trans);
+			_transMgr->deleteTransaction(record.trans);
 			Error err = VsbConverter::fromError((uint16_t)result);
-			throwException(BacnetErrorException(err.getClass(), err.getCode(), FC::StringAPrintf(
-					"Could not write %s-%d of device %d", request.oid().getType().name(),
-					request.oid().getInstance(), device)));
-		} else {
-			std::ostringstream oss;
-			oss << "Successfully sent write transaction (" << trans->transId() << "): " <<
-				    "request: " << request << ", ack: " << *ack;
-			FC_Debug1(oss.str().c_str());
+			EventRecord ack(record.trans->service() == ConfirmedServiceChoiceEnum::ReadProperty ?
+					EventRecord::ReadAck : EventRecord::WriteAck, record.trans->transId());
+			ack.setError(err);
+			queueRecord(_ackQueue.get(), ack);
+			notifyAck<ErrorEvent>(ack, err);
 		}
-	} else {
-		throwException(BacnetErrorException(ErrorClassEnum::Property, ErrorCodeEnum::DatatypeNotSupported,
-				FC::StringAPrintf("Datatype %s is not supported at the moment.",
-						request.value()->typeName())));
 	}
-	return trans->transId();
+}
+
+size_t Server::pollAcks(EventRecord* records, size_t max) {
+	size_t count = 0;
+	while (_ackQueue && count < max && _ackQueue->pop(records[count])) {
+		count++;
+	}
+	return count;
+}
+
+size_t Server::pollWrites(EventRecord* records, size_t max) {
+	size_t count = 0;
+	while (_writeQueue && count < max && _writeQueue->pop(records[count])) {
+		count++;
+	}
+	return count;
 }
 
 template<>
 void Server::handleUnconfirmedRequest(const DeviceAddress& source, const IAmRequest& request) {
 	// Ignore ourself and all known devices
 	unsigned int devInstance = request.oid().getInstance();
+	if (devInstance != getInstance()) {
+		remoteStats(devInstance)->seen();
+	}
 	if (devInstance != getInstance()  &&
 		!knowsRemoteDevice(devInstance)) {
 		// get the address of the device, check if it has a router in between
@@ -327,59 +845,413 @@ void Server::handleUnconfirmedRequest(const DeviceAddress& source, const IAmRequ
 		device->setProperty(PropertyIdentifierEnum::VendorIdentifier, request.vendorId());
 		device->setProperty(PropertyIdentifierEnum::SegmentationSupported, request.segmentationSupported());
 		addRemoteDevice(*device);
-		std::ostringstream oss;
-		oss << "I Am Request -- Added new device " << *device;
-		FC_Debug(oss.str());
+		BACNET_DEBUG1("I Am Request -- Added new device " << *device);
 		FC::Ref<IAmEvent> event(new IAmEvent(request));
 		post(event);
 	}
 }
 
 
+template<>
+BacnetStatus Server::tryHandleConfirmedRequest(const ReadPropertyRequest &request,
+		ReadPropertyAckRef &ack) {
+	BACNET_DEBUG1("Got a read request: " << request);
+	BacnetValueRef val = ObjectProperties::getBacnetValue(request.oid().getType(), request.pid(),
+			false);
+	if (!val) {
+		return BacnetStatus(ErrorClassEnum::Property, ErrorCodeEnum::UnknownProperty);
+	}
+	BacnetStatus status = tryGetProperty(request.oid(), request.pid(), *val);
+	if (!status.ok()) {
+		return status;
+	}
+	ack = new ReadPropertyAck(request.oid(), request.pid(), *val, request.index());
+	EventRecord record(EventRecord::ReadRequest);
+	record.setObject(request.oid(), request.pid());
+	record.index = (uint32_t)request.index();
+	notifyRequest<ReadRequestEvent>(record, request);
+	return status;
+}
+
+BacnetStatus Server::tryServeReadRequest(const ReadPropertyRequest &request, frVbag& bag) {
+	BACNET_DEBUG1("Got a read request: " << request);
+	CompactObjectRef obj = snapshot()->getObject(request.oid());
+	if (!obj) {
+		return BacnetStatus(ErrorClassEnum::Object, ErrorCodeEnum::UnknownObject);
+	}
+	const CompactValue* value = obj->findProperty(request.pid());
+	if (!value) {
+		return BacnetStatus(ErrorClassEnum::Property, ErrorCodeEnum::UnknownProperty);
+	}
+	if (!VsbConverter::toVbag(*value, bag)) {
+		return BacnetStatus(ErrorClassEnum::Property, ErrorCodeEnum::InvalidDataType);
+	}
+	EventRecord record(EventRecord::ReadRequest);
+	record.setObject(request.oid(), request.pid());
+	record.index = (uint32_t)request.index();
+	notifyRequest<ReadRequestEvent>(record, request);
+	return BacnetStatus();
+}
+
+template<>
+BacnetStatus Server::tryHandleConfirmedRequest(const WritePropertyRequest &request,
+		WritePropertyAckRef &ack) {
+	BACNET_DEBUG1("Got a write request: " << request);
+	// Check if the server has this object
+	if (!hasObject(request.oid())) {
+		return BacnetStatus(ErrorClassEnum::Object, ErrorCodeEnum::UnknownObject);
+	}
+	// check if the property is remote writtable
+	if (!isPropertyRemoteWrittable(request.oid(), request.pid())) {
+		return BacnetStatus(ErrorClassEnum::Property, ErrorCodeEnum::WriteAccessDenied);
+	}
+	BacnetStatus status = trySetProperty(request.oid(), request.pid(), *request.value());
+	if (!status.ok()) {
+		return status;
+	}
+	ack = new WritePropertyAck(request.oid(), request.pid());
+	EventRecord record(EventRecord::WriteRequest);
+	record.setObject(request.oid(), request.pid());
+	record.index = (uint32_t)request.index();
+	record.priority = (uint8_t)request.priority();
+	queueRecord(_writeQueue.get(), record);
+	notifyRequest<WriteRequestEvent>(record, request);
+	return status;
+}
+
 template<>
 void Server::handleConfirmedRequest(const ReadPropertyRequest &request, ReadPropertyAckRef &ack) {
-	try {
-		std::ostringstream oss;
-		oss << "Got a read request: " << request;
-		FC_Debug1(oss.str().c_str());
-		try {
-			// can throw an BacnetErrorException if property does not match object
-			BacnetValueRef val = ObjectProperties::getBacnetValue(request.oid().getType(), request.pid());
-			_localDev->getObjectProperty(request.oid(), request.pid(), *val);
-			ack = new ReadPropertyAck(request.oid(), request.pid(), *val, request.index());
-			notifyRequest<ReadRequestEvent>(request);
-		} catch(BacnetApplicationException& ex) {
-			// Refactor any application exception to be a valid BACnet error
-			throw BacnetErrorException(ErrorClassEnum::Property, ErrorCodeEnum::InvalidDataType);
-		}
-	} catch (std::bad_cast&) {
-		throw BacnetErrorException(ErrorClassEnum::Services, ErrorCodeEnum::MissingRequiredParameter);
+	BacnetStatus status = tryHandleConfirmedRequest(request, ack);
+	if (!status.ok()) {
+		throw status.toException();
 	}
 }
 
 template<>
 void Server::handleConfirmedRequest(const WritePropertyRequest &request, WritePropertyAckRef &ack) {
+	BacnetStatus status = tryHandleConfirmedRequest(request, ack);
+	if (!status.ok()) {
+		throw status.toException();
+	}
+}
+
+AckWorkerPool::AckWorkerPool(Server& server, unsigned workers) :
+	_server(server), _running(0) {
+	for (unsigned i = 0; i < workers; i++) {
+		Worker* worker = new Worker;
+		worker->pool = this;
+		worker->queue = new BoundedQueue<TransactionRef>(QueueCapacity, OverflowReject);
+		sem_init(&worker->ready, 0, 0);
+		_workers.push_back(worker);
+	}
+}
+
+AckWorkerPool::~AckWorkerPool() {
+	stop();
+	for (size_t i = 0; i < _workers.size(); i++) {
+		sem_destroy(&_workers[i]->ready);
+		delete _workers[i];
+	}
+}
+
+void AckWorkerPool::start() {
+	if (!__sync_bool_compare_and_swap(&_running, 0, 1)) {
+		return;
+	}
+	for (size_t i = 0; i < _workers.size(); i++) {
+		pthread_create(&_workers[i]->thread, 0, &AckWorkerPool::run, _workers[i]);
+	}
+}
+
+void AckWorkerPool::stop() {
+	if (!__sync_bool_compare_and_swap(&_running, 1, 0)) {
+		return;
+	}
+	// A dispatch counted before the flag was cleared may still be queuing its response
+	while (_dispatching.get()) {
+		sched_yield();
+	}
+	for (size_t i = 0; i < _workers.size(); i++) {
+		sem_post(&_workers[i]->ready);
+	}
+	for (size_t i = 0; i < _workers.size(); i++) {
+		pthread_join(_workers[i]->thread, 0);
+	}
+	// Nothing is queued anymore, handle what the workers left
+	TransactionRef trans;
+	for (size_t i = 0; i < _workers.size(); i++) {
+		while (_workers[i]->queue->pop(trans)) {
+			handle(_server, trans);
+		}
+	}
+}
+
+bool AckWorkerPool::dispatch(const TransactionRef& trans) {
+	if (_workers.empty()) {
+		return false;
+	}
+	// Counted before reading the flag, so stop either sees this dispatch or this
+	// dispatch sees the pool stopped
+	_dispatching.increment();
+	bool queued = false;
+	if (_running) {
+		Worker* worker = _workers[trans->transId() % _workers.size()];
+		if (worker->queue->push(trans)) {
+			sem_post(&worker->ready);
+			queued = true;
+		}
+	}
+	_dispatching.decrement();
+	return queued;
+}
+
+void AckWorkerPool::handle(Server& server, const TransactionRef& trans) {
 	try {
-		std::ostringstream oss;
-		oss << "Got a write request: " << request;
-		FC_Debug1(oss.str().c_str());
-		// Check if the server has this object
-		if (_localDev->hasObject(request.oid())) {
-			// check if the property is remote writtable
-			if (_localDev->isPropertyRemoteWrittable(request.oid(), request.pid())) {
-				_localDev->setObjectProperty(request.oid(), request.pid(), request.value());
-				notifyRequest<WriteRequestEvent>(request);
-			} else {
-				throw BacnetErrorException(ErrorClassEnum::Property, ErrorCodeEnum::WriteAccessDenied);
+		server.handleConfirmedRequestAck(*trans);
+	} catch (FC::Exception& ex) {
+		FC_Debug1f("Could not handle transaction %llu response: %s", trans->transId(), ex.what());
+	} catch (std::exception& ex) {
+		FC_Debug1f("Could not handle transaction %llu response: %s", trans->transId(), ex.what());
+	}
+}
+
+void* AckWorkerPool::run(void* arg) {
+	Worker* worker = (Worker*)arg;
+	TransactionRef trans;
+	for (;;) {
+		sem_wait(&worker->ready);
+		if (!worker->queue->pop(trans)) {
+			// Woken up without response, the pool is stopping
+			if (!worker->pool->_running) {
+				break;
 			}
+			continue;
+		}
+		handle(worker->pool->_server, trans);
+		trans = 0;
+	}
+	return 0;
+}
+
+void Server::dispatchAck(const TransactionRef& trans) {
+	if (!_ackWorkers || !_ackWorkers->dispatch(trans)) {
+		handleConfirmedRequestAck(*trans);
+	}
+}
+
+void Server::recordIncoming(ServiceStats& stats, int result, uint64_t start) {
+	stats.requests.add();
+	stats.latency.recordSince(start);
+	// A deferred write is negative, it is answered later
+	if (result <= 0) {
+		stats.success.add();
+	} else {
+		stats.recordError(VsbConverter::fromError((uint16_t)result).getClass().get());
+	}
+}
+
+void Server::recordResponse(const Transaction& trans) {
+	ServiceStats& stats = _stats.outgoingService(trans.service().get());
+	uint64_t rtt = Clock::now() - trans.startTime();
+	stats.latency.record(rtt);
+	HotTrace::record(HotTrace::TransactionAck, trans.vbag()->pdtype, trans.transId(), rtt);
+	const RemoteDeviceStatsRef& remote = trans.remoteStats();
+	if (trans.hasError()) {
+		Error error = VsbConverter::fromError(trans.vbag()->pd.errval);
+		bool timeout = (error.getCode() == ErrorCodeEnum::Timeout);
+		stats.recordError(error.getClass().get());
+		if (timeout) {
+			_stats.timeouts.add();
+		}
+		if (remote) {
+			remote->recordError(trans.vbag()->pd.errval, timeout, rtt);
+		}
+	} else {
+		stats.success.add();
+		if (remote) {
+			remote->recordAck(rtt);
+		}
+	}
+}
+
+void Server::enableHotPoints(bool enable, size_t capacity) {
+	FC::MutexLock lock(_hotPointsMutex);
+	if (enable && !_hotPoints) {
+		_hotPoints = new HotPointCounters(capacity);
+		// The counters must be visible before the flag
+		__sync_synchronize();
+	}
+	_hotPointsEnabled = enable;
+}
+
+void Server::getHotPoints(size_t count, std::vector<HotPoint>& points) const {
+	FC::MutexLock lock(_hotPointsMutex);
+	if (_hotPoints) {
+		_hotPoints->top(count, points);
+	} else {
+		points.clear();
+	}
+}
+
+void Server::resetHotPoints() {
+	FC::MutexLock lock(_hotPointsMutex);
+	if (_hotPoints) {
+		_hotPoints->reset();
+	}
+}
+
+RemoteDeviceStatsRef Server::remoteStats(ObjectInstance devInstance) const {
+	{
+		ReadLock remoteLock(_remoteLock);
+		auto it = _remoteStats.find(devInstance);
+		if (it != _remoteStats.end()) {
+			return it->second;
+		}
+	}
+	WriteLock remoteLock(_remoteLock);
+	RemoteDeviceStatsRef& stats = _remoteStats[devInstance];
+	if (!stats) {
+		stats = new RemoteDeviceStats(devInstance);
+	}
+	return stats;
+}
+
+bool Server::getRemoteStats(ObjectInstance devInstance, RemoteDeviceStatsSnapshot& snap) const {
+	RemoteDeviceStatsRef stats;
+	{
+		ReadLock remoteLock(_remoteLock);
+		auto it = _remoteStats.find(devInstance);
+		if (it == _remoteStats.end()) {
+			return false;
+		}
+		stats = it->second;
+	}
+	stats->snapshot(snap);
+	return true;
+}
+
+void Server::getSlowestDevices(size_t count, std::vector<RemoteDeviceStatsSnapshot>& devices) const {
+	typedef std::pair<uint64_t, RemoteDeviceStats*> RankedDevice;
+	std::vector<RankedDevice> ranked;
+	std::vector<RemoteDeviceStatsRef> held;
+	{
+		ReadLock remoteLock(_remoteLock);
+		ranked.reserve(_remoteStats.size());
+		held.reserve(_remoteStats.size());
+		auto it = _remoteStats.begin();
+		while (it != _remoteStats.end()) {
+			ranked.push_back(RankedDevice(it->second->rttP99(), it->second.get()));
+			held.push_back(it->second);
+			it++;
+		}
+	}
+	count = std::min(count, ranked.size());
+	std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(),
+			std::greater<RankedDevice>());
+	devices.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		ranked[i].second->snapshot(devices[i]);
+	}
+}
+
+#ifdef VSB_DEFERRED_RESPONSE
+BacnetStatus Server::deferWrite(const WritePropertyRequest& request, bool& deferred) {
+	deferred = false;
+	if (!_deferredWrites) {
+		return BacnetStatus();
+	}
+	if (!hasObject(request.oid())) {
+		return BacnetStatus(ErrorClassEnum::Object, ErrorCodeEnum::UnknownObject);
+	}
+	if (!isPropertyRemoteWrittable(request.oid(), request.pid())) {
+		return BacnetStatus(ErrorClassEnum::Property, ErrorCodeEnum::WriteAccessDenied);
+	}
+	dword token = frDeferredToken();
+	{
+		FC::MutexLock lock(_pendingMutex);
+		_pendingWrites[token] = PendingWrite(request, Clock::now());
+	}
+	FC::Ref<DeferredWriteEvent> event(new DeferredWriteEvent(token, request));
+	post(event);
+	deferred = true;
+	return BacnetStatus();
+}
+
+bool Server::completeWrite(dword token, const Error* error) {
+	int result;
+	if (!takePendingWrite(token, error, result)) {
+		return false;
+	}
+	FC::MutexLock lock(_stackMutex);
+	return frcCompleteDeferred(token, result) == 0;
+}
+
+bool Server::takePendingWrite(dword token, const Error* error, int& result) {
+	PendingWrite pending;
+	{
+		FC::MutexLock lock(_pendingMutex);
+		auto it = _pendingWrites.find(token);
+		if (it == _pendingWrites.end()) {
+			return false;
+		}
+		pending = it->second;
+		_pendingWrites.erase(it);
+	}
+	result = 0;
+	if (error) {
+		result = VsbConverter::toError(*error);
+	} else {
+		const WritePropertyRequest& request = *pending.request;
+		BacnetStatus status = trySetProperty(request.oid(), request.pid(), *request.value());
+		if (status.ok()) {
+			EventRecord record(EventRecord::WriteRequest);
+			record.setObject(request.oid(), request.pid());
+			record.index = (uint32_t)request.index();
+			record.priority = (uint8_t)request.priority();
+			queueRecord(_writeQueue.get(), record);
 		} else {
-			throw BacnetErrorException(ErrorClassEnum::Object, ErrorCodeEnum::UnknownObject);
+			result = VsbConverter::toError(status);
 		}
+	}
+	return true;
+}
 
-	} catch (std::bad_cast&) {
-		throw BacnetErrorException(ErrorClassEnum::Services, ErrorCodeEnum::MissingRequiredParameter);
+void Server::expirePendingWrites() {
+	std::vector<dword> expired;
+	{
+		FC::MutexLock lock(_pendingMutex);
+		if (_pendingWrites.empty()) {
+			return;
+		}
+	}
+	// The requesting device gives up after its own timeout and retries, assume they are
+	// the ones the local device announces
+	Unsigned apduTimeout(REQUEST_TIMEOUT);
+	Unsigned apduRetries(REQUEST_RETRIES);
+	getProperty(PropertyIdentifierEnum::ApduTimeout, apduTimeout, false);
+	getProperty(PropertyIdentifierEnum::NumberOfApduRetries, apduRetries, false);
+	uint64_t timeout = (uint64_t)apduTimeout * ((uint64_t)apduRetries + 1) * 1000000000ull;
+	uint64_t now = Clock::now();
+	{
+		FC::MutexLock lock(_pendingMutex);
+		auto it = _pendingWrites.begin();
+		while (it != _pendingWrites.end()) {
+			if (now - it->second.received > timeout) {
+				expired.push_back(it->first);
+			}
+			it++;
+		}
+	}
+	// Called by doWork which holds the stack mutex already
+	Error timeoutError(ErrorClassEnum::Communication, ErrorCodeEnum::Timeout);
+	for (size_t i = 0; i < expired.size(); i++) {
+		int result;
+		if (takePendingWrite(expired[i], &timeoutError, result)) {
+			frcCompleteDeferred(expired[i], result);
+		}
 	}
 }
+#endif
 
 void Server::handleConfirmedRequestAck(const Transaction& trans) {
 	switch (trans.service()) {
@@ -392,61 +1264,77 @@ void Server::handleConfirmedRequestAck(const Transaction& trans) {
 	default:
 		break;
 	}
+	trans.markSpan(&TransactionSpan::posted);
+	trans.finishSpan(trans.hasError() ? trans.vbag()->pd.errval : 0);
 }
 
 void Server::handleReadAck(const Transaction& trans) {
 	ReadPropertyAckRef ack = dynamic_cast<ReadPropertyAck*>(trans.ack().get());
-	std::ostringstream oss;
-	oss << "Got a read transaction ack (" << trans.transId() << ") with ack: " << *ack;
-	FC_Debug1(oss.str().c_str());
-	BacnetValueRef value = VsbConverter::fromVbag(*(trans.vbag()));
+	BACNET_DEBUG1("Got a read transaction ack (" << trans.transId() << ") with ack: " << *ack);
+	// Decoded without a value instance, then set into the value of the ack
+	CompactValue value;
+	bool decoded = VsbConverter::fromVbag(*(trans.vbag()), value);
+	trans.markSpan(&TransactionSpan::decoded);
 	FC::Ref<Error> error;
 	if (trans.hasError()) {
-		error = value_cast<Error*>(value.get(), false);
+		BacnetValueRef errorValue = value.toValue();
+		error = value_cast<Error*>(errorValue.get(), false);
 		if (!error) {
 			error = new Error(ErrorClassEnum::Property, ErrorCodeEnum::InvalidDataType);
 		}
-	} else if (!value) {
+	} else if (!decoded) {
 		error = new Error(ErrorClassEnum::Property, ErrorCodeEnum::DatatypeNotSupported);
 	} else if (!ack) {
 		error = new Error(ErrorClassEnum::Services, ErrorCodeEnum::MissingRequiredParameter);
 	} else {
 		try {
-			ack->value()->set(*value);
+			value.assignTo(*ack->value());
 		} catch (BacnetErrorException &ex) {
-			std::ostringstream oss;
-			oss << "Transaction " << trans.transId() << " for " << ack->oid() <<
-				"could not read the return value: " << ex.what();
-			FC_Debug1(oss.str().c_str());
+			BACNET_DEBUG1("Transaction " << trans.transId() << " for " << ack->oid() <<
+					"could not read the return value: " << ex.what());
 			error = new Error(ex.eClass(), ex.eCode());
 		}
 	}
+	EventRecord record(EventRecord::ReadAck, trans.transId());
+	if (ack) {
+		record.setObject(ack->oid(), ack->pid());
+		record.index = (uint32_t)ack->index();
+	}
 	if (error) {
-		notifyAck<ErrorEvent>(trans.transId(), *error);
+		record.setError(*error);
+		queueRecord(_ackQueue.get(), record);
+		notifyAck<ErrorEvent>(record, *error);
 	} else {
-		notifyAck<ReadAckEvent>(trans.transId(), *ack);
+		queueRecord(_ackQueue.get(), record);
+		notifyAck<ReadAckEvent>(record, *ack);
 	}
 }
 
 void Server::handleWriteAck(const Transaction& trans) {
 	WritePropertyAckRef ack = dynamic_cast<WritePropertyAck*>(trans.ack().get());
-	std::ostringstream oss;
-	oss << "Got a write transaction ack (" << trans.transId() << ") with ack: " << *ack;
-	FC_Debug1(oss.str().c_str());
+	BACNET_DEBUG1("Got a write transaction ack (" << trans.transId() << ") with ack: " << *ack);
+	EventRecord record(EventRecord::WriteAck, trans.transId());
+	if (ack) {
+		record.setObject(ack->oid(), ack->pid());
+	}
 	if (trans.hasError()) {
 		BacnetValueRef value = VsbConverter::fromVbag(*(trans.vbag()));
 		FC::Ref<Error> error = value_cast<Error*>(value.get(), false);
 		if (!error) {
 			error = new Error(ErrorClassEnum::Property, ErrorCodeEnum::InvalidDataType);
 		}
-		notifyAck<ErrorEvent>(trans.transId(), *error);
+		trans.markSpan(&TransactionSpan::decoded);
+		record.setError(*error);
+		queueRecord(_ackQueue.get(), record);
+		notifyAck<ErrorEvent>(record, *error);
 	} else {
-		notifyAck<WriteAckEvent>(trans.transId(), *ack);
+		trans.markSpan(&TransactionSpan::decoded);
+		queueRecord(_ackQueue.get(), record);
+		notifyAck<WriteAckEvent>(record, *ack);
 	}
 }
 
 Transaction::State Server::getTransactionState(const Transaction::IdType& id) const {
-	FC::MutexLock lock(_mutex);
 	TransactionRef trans = _transMgr->getTransaction(id);
 	if (trans) {
 		return trans->state();
@@ -455,7 +1343,6 @@ Transaction::State Server::getTransactionState(const Transaction::IdType& id) co
 }
 
 BacnetValueRef Server::getTransactionValue(const Transaction::IdType& id) const {
-	FC::MutexLock lock(_mutex);
 	TransactionRef trans = _transMgr->getTransaction(id);
 	if (trans->state() == Transaction::Complete) {
 		return VsbConverter::fromVbag(*(trans->vbag()));
@@ -464,35 +1351,34 @@ BacnetValueRef Server::getTransactionValue(const Transaction::IdType& id) const
 }
 
 bool Server::isTransactionSimpelAck(const Transaction::IdType& id) const {
-	FC::MutexLock lock(_mutex);
 	TransactionRef trans = _transMgr->getTransaction(id);
 	return trans->isSimpleAck();
 
 }
 
 bool Server::isTransactionError(const Transaction::IdType& id) const {
-	FC::MutexLock lock(_mutex);
 	TransactionRef trans = _transMgr->getTransaction(id);
 	return trans->hasError();
 }
 
 void Server::deleteTransaction(const Transaction::IdType& id) const {
-	FC::MutexLock lock(_mutex);
 	_transMgr->deleteTransaction(id);
 }
 
 
 TransactionRef Server::getTransactionHandle(const Transaction::IdType& id) const {
-	FC::MutexLock lock(_mutex);
 	return _transMgr->getTransaction(id);
 }
 
-TransactionRef Server::getTransactionHandle(const frVbag& id) const {
-	FC::MutexLock lock(_mutex);
-	return _transMgr->getTransaction(id);
+TransactionRef Server::getTransactionHandle(const frVbag& id, unsigned shard) const {
+	return _transMgr->getTransaction(id, shard);
 }
 
 std::string Server::toString(std::string *str) {
+	// Printing reads every object, keep them all from changing while readers go on
+	ReadLock dbLock(_dbLock);
+	StripedReadLock objLocks(_objLocks);
+	ReadLock remoteLock(_remoteLock);
 	std::ostringstream oss;
 	auto it = _remoteDev.begin();
 	size_t last = _remoteDev.size();
@@ -516,24 +1402,54 @@ std::string Server::toString(std::string *str) {
 }
 
 struct StackAccessor {
-	static const DeviceRef getDevice(const Server& server) {
-		return server._localDev;
-	}
 	template <typename REQUEST, typename ACK>
 	static const void handleConfirmedRequest(Server& server, const REQUEST& request,
 			ACK& ack) {
 		server.handleConfirmedRequest(request, ack);
 	}
-	static const void handleConfirmedAck(Server& server, const Transaction& trans) {
-		server.handleConfirmedRequestAck(trans);
+	template <typename REQUEST, typename ACK>
+	static BacnetStatus tryHandleConfirmedRequest(Server& server, const REQUEST& request,
+			ACK& ack) {
+		return server.tryHandleConfirmedRequest(request, ack);
+	}
+	static BacnetStatus tryServeReadRequest(Server& server, const ReadPropertyRequest& request,
+			frVbag& bag) {
+		return server.tryServeReadRequest(request, bag);
+	}
+#ifdef VSB_DEFERRED_RESPONSE
+	static BacnetStatus deferWrite(Server& server, const WritePropertyRequest& request,
+			bool& deferred) {
+		return server.deferWrite(request, deferred);
+	}
+#endif
+	static const void handleConfirmedAck(Server& server, const TransactionRef& trans) {
+		server.dispatchAck(trans);
 	}
 	template <typename REQUEST>
 	static const void handleUnconfirmedRequest(Server& server, const DeviceAddress& source,
 			const REQUEST& request) {
 		server.handleUnconfirmedRequest(source, request);
 	}
-	static const TransactionRef getTransactionHandle(Server& server, const frVbag& bag) {
-		return server.getTransactionHandle(bag);
+	static const TransactionRef getTransactionHandle(Server& server, const frVbag& bag,
+			unsigned shard) {
+		return server.getTransactionHandle(bag, shard);
+	}
+	/**
+	 * A request for an unknown object is counted by the primary server
+	 */
+	static void recordIncoming(const ServerRef& server, bool write, int result, uint64_t start) {
+		ServerRef target = server ? server : ServerManager::getPrimaryServer();
+		if (target) {
+			target->recordIncoming(write ? target->_stats.incomingWrite : target->_stats.incomingRead,
+					result, start);
+		}
+	}
+	static void recordHotPoint(Server& server, const ObjectIdentifier& oid,
+			const PropertyIdentifierEnum& pid, bool write) {
+		server.recordHotPoint(oid, pid, write);
+	}
+	static void recordResponse(Server& server, const Transaction& trans) {
+		server.recordResponse(trans);
 	}
 };
 
@@ -586,7 +1502,12 @@ dword bpublic fraGetDatabaseRevision(void) {
 }
 
 void bpublic fraIAm(frBACnetdevice* device) {
-	ServerRef server = ServerManager::begin()->second;
+	if (TraceRecorder::isRecording()) {
+		TraceRecord record(TraceRecord::IAm);
+		record.time = TraceRecorder::now();
+		record.device = *device;
+		TraceRecorder::write(record);
+	}
 	// get the address of the device, check if it has a router in between
 	DeviceAddress addr;
 	addr.setSourceNet(device->src.snet.w);
@@ -600,12 +1521,25 @@ void bpublic fraIAm(frBACnetdevice* device) {
 	IAmRequest request(ObjectIdentifier(ObjectTypeEnum::Device, device->devinst),
 			device->maxlen, SegmentationEnum::NoSegmentation, device->vendorid);
 
-	StackAccessor::handleUnconfirmedRequest(*server, addr, request);
+	// Every hosted device keeps its own list of remote devices
+	std::vector<ServerRef> servers;
+	ServerManager::getServers(servers);
+	auto it = servers.begin();
+	while (it != servers.end()) {
+		StackAccessor::handleUnconfirmedRequest(**it, addr, request);
+		it++;
+	}
 }
 
 
+/**
+ * The stack asks for the device it announces, which is the primary device
+ */
 void  bpublic fraGetDeviceInfo(frDevInfo *dev) {
-	ServerRef server = ServerManager::begin()->second;
+	ServerRef server = ServerManager::getPrimaryServer();
+	if (!server) {
+		return;
+	}
 	ObjectIdentifier oid;
 	server->getProperty(PropertyIdentifierEnum::ObjectIdentifier, oid);
 	dev->deviceinstance = oid.getInstance();
@@ -692,20 +1626,26 @@ void  bpublic fraGetDeviceInfo(frDevInfo *dev) {
 }
 
 dword bpublic fraGetNumberOfObjects(void) {
-	DeviceRef device = StackAccessor::getDevice(*ServerManager::begin()->second);
-	return (dword)device->getCount();
+	ServerRef server = ServerManager::getPrimaryServer();
+	return (dword)(server ? server->getObjectCount() : 0);
 }
 
+/**
+ * A walk starts on the primary device and goes on with the device hosting the
+ * object it is given, so it never mixes the objects of two devices
+ */
 dword bpublic fraGetNextObject(dword oid) {
-	DeviceRef device = StackAccessor::getDevice(*ServerManager::begin()->second);
-	ObjectRef obj;
+	ObjectIdentifier next;
+	bool found = false;
 	if (oid == noobject) {
-		obj = device->getNextObject(0);
+		ServerRef server = ServerManager::getPrimaryServer();
+		found = server && server->getNextObjectIdentifier(0, next);
 	} else {
 		ObjectIdentifier bacOid(oid);
-		obj = device->getNextObject(&bacOid);
+		ServerRef server = ServerManager::getObjectServer(bacOid);
+		found = server && server->getNextObjectIdentifier(&bacOid, next);
 	}
-	return (dword)(obj ? obj->getOid() : noobject);
+	return (dword)(found ? next.getCoded() : noobject);
 }
 
 bool  bpublic fraGetTimeDate(frTimeDate *dt) {
@@ -738,44 +1678,75 @@ void  bpublic fraPrivateTransfer(frSource *,word,byte *,word) {
 
 int bpublic fraWriteProperty(dword oid, dword pid, dword aidx, frVbag *vp) {
 	int result = 0;
+	TraceScope trace(TraceRecord::WriteProperty, oid, pid, aidx, vp, &result);
+	HotTrace::record(HotTrace::WriteRequest, oid, pid);
+	uint64_t start = Clock::now();
+	ServerRef server;
 	try {
+		BacnetStatus status;
 		// convert the stack value to BACnet value
 		BacnetValueRef val = VsbConverter::fromVbag(*vp);
 		if (val) {
 			WritePropertyRequest request(ObjectIdentifier(oid), (PropertyIdentifierEnum::Enum)pid,
 					*val, vp->priority, aidx);
 			WritePropertyAckRef ack;
-			StackAccessor::handleConfirmedRequest(*ServerManager::begin()->second, request, ack);
-			if (!ack) {
-				result = VsbConverter::toError(Error(ErrorClassEnum::Services, ErrorCodeEnum::Other));
+			server = ServerManager::getObjectServer(request.oid());
+			if (server) {
+				StackAccessor::recordHotPoint(*server, request.oid(), request.pid(), true);
+#ifdef VSB_DEFERRED_RESPONSE
+				bool deferred = false;
+				status = StackAccessor::deferWrite(*server, request, deferred);
+				if (deferred) {
+					result = vsbDeferred;
+					StackAccessor::recordIncoming(server, true, result, start);
+					return result;
+				}
+				if (status.ok()) {
+					status = StackAccessor::tryHandleConfirmedRequest(*server, request, ack);
+				}
+#else
+				status = StackAccessor::tryHandleConfirmedRequest(*server, request, ack);
+#endif
+			} else {
+				status = BacnetStatus(ErrorClassEnum::Object, ErrorCodeEnum::UnknownObject);
 			}
 		} else {
-			result = VsbConverter::toError(Error(ErrorClassEnum::Property,
-								ErrorCodeEnum::DatatypeNotSupported));
+			status = BacnetStatus(ErrorClassEnum::Property, ErrorCodeEnum::DatatypeNotSupported);
+		}
+		if (!status.ok()) {
+			result = VsbConverter::toError(status);
 		}
 	} catch(BacnetErrorException& ex) {
 		result = VsbConverter::toError(Error(ex.eClass(), ex.eCode()));
 	}
+	StackAccessor::recordIncoming(server, true, result, start);
 	return result;
 }
 
 int   bpublic fraReadProperty(dword oid, dword pid, dword aidx, frVbag *vp, dword *nextpid) {
 	int result = 0;
+	TraceScope trace(TraceRecord::ReadProperty, oid, pid, aidx, vp, &result);
+	HotTrace::record(HotTrace::ReadRequest, oid, pid);
+	uint64_t start = Clock::now();
+	ServerRef server;
 	try {
+		BacnetStatus status;
 		ReadPropertyRequest request(ObjectIdentifier(oid), (PropertyIdentifierEnum::Enum)pid, aidx);
-		ReadPropertyAckRef ack;
-		StackAccessor::handleConfirmedRequest(*ServerManager::begin()->second, request, ack);
-		if (ack) {
-			if (!VsbConverter::toVbag(*(ack->value()), *vp)) {
-				result = VsbConverter::toError(Error(ErrorClassEnum::Property,
-						ErrorCodeEnum::InvalidDataType));
-			}
+		server = ServerManager::getObjectServer(request.oid());
+		if (server) {
+			StackAccessor::recordHotPoint(*server, request.oid(), request.pid(), false);
+			status = StackAccessor::tryServeReadRequest(*server, request, *vp);
 		} else {
-			result = VsbConverter::toError(Error(ErrorClassEnum::Services, ErrorCodeEnum::Other));
+			status = BacnetStatus(ErrorClassEnum::Object, ErrorCodeEnum::UnknownObject);
+		}
+		if (!status.ok()) {
+			result = VsbConverter::toError(status);
 		}
 	} catch(BacnetErrorException& ex) {
+		// Left for the exceptions of the conversions, the request path reports a status
 		result = VsbConverter::toError(Error(ex.eClass(), ex.eCode()));
 	}
+	StackAccessor::recordIncoming(server, false, result, start);
 	return result;
 }
 
@@ -785,11 +1756,23 @@ int   bpublic fraReinitDevice(int, frString *) {
 }
 
 void  bpublic fraResponse(frVbag *bag) {
-	ServerRef server = ServerManager::begin()->second;
-	TransactionRef trans = StackAccessor::getTransactionHandle(*ServerManager::begin()->second, *bag);
+	if (TraceRecorder::isRecording()) {
+		TraceRecord record(TraceRecord::Response);
+		record.time = TraceRecorder::now();
+		record.bag = *bag;
+		TraceRecorder::write(record);
+	}
+	unsigned shard = 0;
+	ServerRef server = ServerManager::getTransactionServer(*bag, &shard);
+	if (!server) {
+		return;
+	}
+	TransactionRef trans = StackAccessor::getTransactionHandle(*server, *bag, shard);
 	if (trans) {
+		trans->markSpan(&TransactionSpan::responded);
 		trans->resetCompleteTime();
-		StackAccessor::handleConfirmedAck(*server, *trans);
+		StackAccessor::recordResponse(*server, *trans);
+		StackAccessor::handleConfirmedAck(*server, trans);
 	}
 }
 
@@ -811,15 +1794,34 @@ void  bpublic fraUnsubscribedCOV(frCOV *) {
 }
 
 void  bpublic fraWhoHas(word snet, bool byname, dword objid, frString *oname) {
-	DeviceRef device = StackAccessor::getDevice(*ServerManager::begin()->second);
+	if (TraceRecorder::isRecording()) {
+		TraceRecord record(TraceRecord::WhoHas);
+		record.time = TraceRecorder::now();
+		record.snet = snet;
+		record.byName = byname;
+		record.oid = objid;
+		if (byname && oname) {
+			record.name = VsbConverter::fromString(*oname).get();
+		}
+		TraceRecorder::write(record);
+	}
 	ObjectRef robj;
 	if (byname) {
 		if (oname) {
 			CharacterString str = VsbConverter::fromString(*oname);
-			robj = device->getObject(str.get());
+			std::vector<ServerRef> servers;
+			ServerManager::getServers(servers);
+			auto it = servers.begin();
+			while (!robj && it != servers.end()) {
+				robj = (*it)->getObject(str.get());
+				it++;
+			}
 		}
 	} else {
-		robj = device->getObject(ObjectIdentifier(objid));
+		ServerRef server = ServerManager::getObjectServer(ObjectIdentifier(objid));
+		if (server) {
+			robj = server->getObject(ObjectIdentifier(objid));
+		}
 	}
 	if (robj) {
 		VsbString vsbStr;
@@ -7,12 +7,23 @@
 #ifndef BacnetServer_h
 #define BacnetServer_h
 
+#include <pthread.h>
+#include <semaphore.h>
+#include <unordered_map>
+#include <unordered_set>
 #include "fc.h"
 #include "BacnetDevice.h"
 #include "BacnetUnconfirmedServices.h"
 #include "BacnetConfirmedServices.h"
 #include "BacnetConfirmedServicesAck.h"
+#include "BacnetSync.h"
+#include "BacnetSnapshot.h"
+#include "BacnetQueue.h"
+#include "BacnetClock.h"
+#include "BacnetStats.h"
+#include "BacnetSpans.h"
 #include "vsbhp.h"
+#include "BacnetStackExt.h"
 
 namespace VIGBACNET {
 
@@ -38,6 +49,10 @@ struct PropertiesSetter {
 	DeviceAddress address;
 	std::string broadcastAddress;
 	unsigned int processRate;
+	unsigned int transactionShards;
+	unsigned int ackWorkers;
+	uint32_t transactionRecycleMs;
+	uint32_t transactionLiveMs;
 };
 
 extern PropertiesSetter defaultPropertiesSetter;
@@ -45,22 +60,90 @@ extern PropertiesSetter defaultPropertiesSetter;
 class Server;
 typedef FC::Ref<Server> ServerRef;
 
+template <typename T> class PointHandle;
+
+/**
+ * Host the servers of the process
+ * Several virtual devices can be served by one process.  The VSB stack is unique
+ * to the process, so the first server created is the primary one: it runs the stack
+ * and is the device the stack announces.  The stack callbacks for a given object or
+ * transaction are routed to the server hosting it through hash indexes, hence an
+ * object identifier can only be hosted by one server.
+ * The device information and object count callbacks carry no device instance, they
+ * are answered for the primary device only; the object list walk continues on the
+ * server hosting the object it starts from.  The other devices are reached through
+ * their objects, their Device object included, not through the stack device tables.
+ * The primary server should be deleted last.
+ */
 class ServerManager {
 public:
-	static const size_t MaxServerAllowed = 1;
+	static const size_t MaxServerAllowed = 256;
 	typedef std::map<ObjectInstance, ServerRef> InstanceServerMap;
 	typedef InstanceServerMap::iterator iterator;
 
 	static ServerRef createServer(const PropertiesSetter& = defaultPropertiesSetter);
 	static bool deleteServer(ObjectInstance);
 	static ServerRef getServer(ObjectInstance);
+	static ServerRef getPrimaryServer();
+	/**
+	 * Return the server hosting an object or a null reference
+	 */
+	static ServerRef getObjectServer(const ObjectIdentifier& oid);
+	/**
+	 * Return the server that created the transaction using a stack vbag
+	 * {shard} receives the transaction shard of the server holding it.
+	 */
+	static ServerRef getTransactionServer(const frVbag& bag, unsigned* shard = 0);
+	/**
+	 * Return all the servers, e.g. to broadcast an unconfirmed request
+	 */
+	static void getServers(std::vector<ServerRef>& servers);
 	static size_t totalServer() { return _servers.size(); }
 	static iterator begin() { return _servers.begin(); }
 	static iterator end() { return _servers.end(); }
 
 private:
+	friend class Server;
+	friend class TransactionManager;
+
+	typedef std::unordered_map<uint32_t, Server*> ObjectServerMap;
+
+	struct VbagRoute {
+		Server* server;
+		unsigned shard;
+	};
+	typedef std::unordered_map<const frVbag*, VbagRoute> VbagRouteMap;
+	/**
+	 * Routes of the pending transaction vbags, striped by vbag address
+	 * The transaction shards register their vbags without taking _lock, so the
+	 * shards and the stack thread resolving the responses do not serialize on it.
+	 */
+	struct VbagStripe {
+		FC::Mutex mutex;
+		VbagRouteMap routes;
+	} __attribute__((aligned(64)));
+
+	static VbagStripe& vbagStripe(const frVbag* bag) {
+		// The low bits of a heap address are the same for every vbag
+		return _vbagStripes[StripedLock::index((uint32_t)((uintptr_t)bag >> 4))];
+	}
+
 	static void setServerProperties(const ServerRef&, const PropertiesSetter&);
+	/**
+	 * Bind an object to its server
+	 * return false if the object is already hosted by another server
+	 */
+	static bool registerObject(const ObjectIdentifier& oid, Server* server);
+	static void unregisterObject(const ObjectIdentifier& oid, const Server* server);
+	static void registerTransaction(const frVbag* bag, Server* server, unsigned shard);
+	static void unregisterTransaction(const frVbag* bag);
+
 	static InstanceServerMap _servers;
+	static ServerRef _primary;
+	// Servers are kept alive by _servers, the indexes do not hold a reference
+	static ObjectServerMap _objectServers;
+	static VbagStripe _vbagStripes[StripedLock::NumStripes];
+	static RWLock _lock;
 };
 
 /**
@@ -72,6 +155,8 @@ private:
  */
 class Transaction : public virtual FC::RefObject {
 public:
+	BACNET_POOL_ALLOCATED
+
 	typedef unsigned long long IdType;
 
 	/**
@@ -87,8 +172,17 @@ public:
 
 	Transaction(const IdType& transId, const ConfirmedServiceChoiceEnum& service,
 			ConfirmedRequestAckRef ack = 0) :
-		_create(time(0)), _complete(0), _transId(transId), _service(service), _ack(ack) {
-		_bag = new frVbag;
+		_create(TickClock::now()), _complete(0), _start(Clock::now()), _transId(transId), _service(service),
+		_ack(ack) {
+		// A submitted transaction is polled before the stack fills its vbag
+		_bag = new frVbag();
+		_bag->status = vbsIdle;
+		if (SpanRecorder::sample()) {
+			_span.sampled = true;
+			_span.id = transId;
+			_span.service = service.get();
+			_span.created = _start;
+		}
 	}
 
 	~Transaction() {
@@ -97,15 +191,35 @@ public:
 
 	void resetCompleteTime() {
 		if (state() == Complete) {
-			_complete = time(0);
+			_complete = TickClock::now();
 		}
 	}
-	void resetCreateTime() { _create= time(0); }
+	void resetCreateTime() { _create = TickClock::now(); }
 
 	frVbag* vbag() const { return _bag; }
 	IdType transId() const { return _transId; }
-	time_t createTime() const { return _create; }
-	time_t completeTime() const { return _complete; }
+	// TickClock times in nanoseconds, the complete time is 0 until the timer is started
+	uint64_t createTime() const { return _create; }
+	uint64_t completeTime() const { return _complete; }
+	// Clock time of the creation, to measure the response time
+	uint64_t startTime() const { return _start; }
+	// Statistics of the remote device the request is sent to, if any
+	const RemoteDeviceStatsRef& remoteStats() const { return _remoteStats; }
+	void setRemoteStats(const RemoteDeviceStatsRef& stats) { _remoteStats = stats; }
+	// Lifecycle timestamps, only taken when the transaction is sampled
+	const TransactionSpan& span() const { return _span; }
+	void setSpanDevice(uint32_t device) { _span.device = device; }
+	void markSpan(uint64_t TransactionSpan::*step) const {
+		if (_span.sampled) {
+			_span.*step = Clock::now();
+		}
+	}
+	void finishSpan(int result) const {
+		if (_span.sampled) {
+			_span.result = result;
+			SpanRecorder::record(_span);
+		}
+	}
 	const ConfirmedServiceChoiceEnum& service() const { return _service; }
 	ConfirmedRequestAckRef ack() const { return _ack; }
 	State state() const {
@@ -129,8 +243,12 @@ public:
 	}
 
 private:
-	time_t _create;
-	time_t _complete;
+	uint64_t _create;
+	uint64_t _complete;
+	uint64_t _start;
+	RemoteDeviceStatsRef _remoteStats;
+	// Diagnostic only, marked along the way by the const handlers
+	mutable TransactionSpan _span;
 	IdType _transId;
 	frVbag* _bag;
 	ConfirmedServiceChoiceEnum _service;
@@ -143,16 +261,33 @@ typedef FC::Ref<Transaction> TransactionRef;
  * This class create transactions for a new client request and
  * bind it to an unique invokeid.  A worker method needs to be called periodically
  * to do some cleanup.  A completed transaction will be kept live for about
- * 5s afterward it will be destroyed.
+ * 5s afterward it will be destroyed, one never answered after 320s.  Both times
+ * can be set in milliseconds and are measured on the monotonic TickClock.
  */
 class TransactionManager : public virtual FC::RefObject {
 public:
-	static const time_t RecycleTime = 320;
-	static const time_t LiveTime = 5;
+	static const uint32_t DefaultRecycleMs = 320000;
+	static const uint32_t DefaultLiveMs = 5000;
 
-	TransactionManager() : _currentId(0) {}
+	/**
+	 * A manager can be one shard of a TransactionShards, the transaction ids it gives
+	 * are then {shard} modulo {shardCount} so the shard is found back from the id.
+	 */
+	TransactionManager(Server* owner = 0, unsigned shard = 0, unsigned shardCount = 1) :
+		_owner(owner), _shard(shard), _shardCount(shardCount), _currentId(0),
+		_recycleTime(DefaultRecycleMs * 1000000ull), _liveTime(DefaultLiveMs * 1000000ull) {}
 
-	TransactionRef createTransaction(const ConfirmedServiceChoiceEnum&, ConfirmedRequestAckRef = 0);
+	/**
+	 * Create a transaction with a new id or with an id given by nextId
+	 */
+	TransactionRef createTransaction(const ConfirmedServiceChoiceEnum&, ConfirmedRequestAckRef = 0,
+			Transaction::IdType id = 0);
+	/**
+	 * Reserve a transaction id, it can be called without holding the manager lock
+	 */
+	Transaction::IdType nextId() {
+		return __sync_add_and_fetch(&_currentId, 1) * _shardCount + _shard;
+	}
 	void deleteTransaction(TransactionRef);
 	void deleteTransaction(const Transaction::IdType&);
 	void deleteTransaction(const frVbag&);
@@ -161,16 +296,85 @@ public:
 	Transaction::State getState(const Transaction::IdType&) const;
 	ConfirmedRequestAckRef getAck(const Transaction::IdType&);
 	void extendTransactionLife(const Transaction::IdType&);
+	/**
+	 * A 0 time keeps its default, like a PropertiesSetter initialized without it
+	 */
+	void setTimeouts(uint32_t recycleMs, uint32_t liveMs) {
+		_recycleTime = (recycleMs ? recycleMs : DefaultRecycleMs) * 1000000ull;
+		_liveTime = (liveMs ? liveMs : DefaultLiveMs) * 1000000ull;
+	}
 	void cleanup();
 
 private:
 	std::map<Transaction::IdType, TransactionRef > _uuidTransMap;
 	std::map<frVbag*, TransactionRef > _vbagTransMap;
-	Transaction::IdType _currentId;
+	Server* _owner;
+	unsigned _shard;
+	unsigned _shardCount;
+	volatile Transaction::IdType _currentId;
+	uint64_t _recycleTime;
+	uint64_t _liveTime;
+};
+
+/**
+ * Client transactions partitioned by remote device
+ * Each shard is a TransactionManager with its own lock.  A new transaction goes to
+ * the shard of the remote device it is sent to and its id tells the shard it belongs
+ * to, so the application threads polling transactions for different devices do not
+ * wait for each other nor for the stack thread.  It does not make the stack itself
+ * faster: doWork holds _stackMutex for the whole tick and every request still goes
+ * through the one stack, so the requests per second it sends and answers are
+ * unchanged.
+ */
+class TransactionShards : public virtual FC::RefObject {
+public:
+	static const unsigned MaxShards = 64;
+
+	TransactionShards(Server* owner, unsigned count);
+	~TransactionShards();
+
+	unsigned count() const { return _count; }
+
+	TransactionRef createTransaction(ObjectInstance device, const ConfirmedServiceChoiceEnum&,
+			ConfirmedRequestAckRef = 0);
+	TransactionRef createTransaction(const Transaction::IdType& id, const ConfirmedServiceChoiceEnum&,
+			ConfirmedRequestAckRef = 0);
+	Transaction::IdType nextId(ObjectInstance device) {
+		return _shards[device % _count].manager->nextId();
+	}
+	void deleteTransaction(TransactionRef);
+	/**
+	 * Delete a transaction for the application, a pending one is no longer in flight
+	 */
+	void deleteTransaction(const Transaction::IdType&);
+	TransactionRef getTransaction(const Transaction::IdType&);
+	/**
+	 * Find the transaction of a stack vbag in the shard it was registered by, see
+	 * ServerManager::getTransactionServer
+	 */
+	TransactionRef getTransaction(const frVbag&, unsigned shard);
+	void setTimeouts(uint32_t recycleMs, uint32_t liveMs);
+	void cleanup();
+
+private:
+	TransactionShards(const TransactionShards&);
+	TransactionShards& operator=(const TransactionShards&);
+
+	struct Shard {
+		FC::Mutex mutex;
+		FC::Ref<TransactionManager> manager;
+	};
+
+	Shard& shard(const Transaction::IdType& id) { return _shards[id % _count]; }
+
+	unsigned _count;
+	Shard* _shards;
 };
 
 class ReadRequestEvent : public FC::Event {
 public:
+	BACNET_POOL_ALLOCATED
+
 	ReadRequestEvent(const ReadPropertyRequest& req) :
 		_req(req) {
 	}
@@ -183,6 +387,8 @@ private:
 
 class WriteRequestEvent : public FC::Event {
 public:
+	BACNET_POOL_ALLOCATED
+
 	WriteRequestEvent(const WritePropertyRequest& req) :
 		_req(req) {
 	}
@@ -196,6 +402,8 @@ private:
 
 class ResponseEvent : public FC::Event {
 public:
+	BACNET_POOL_ALLOCATED
+
 	ResponseEvent(Transaction::IdType id) :
 		_transId(id){
 	}
@@ -242,8 +450,212 @@ private:
 	Error _error;
 };
 
+#ifdef VSB_DEFERRED_RESPONSE
+/**
+ * Remote write waiting for the application to complete it
+ * The value is not written yet: the application forwards the request, e.g. to a field
+ * bus, then calls Server::completeWrite with the token to write it and answer.
+ */
+class DeferredWriteEvent : public WriteRequestEvent {
+public:
+	DeferredWriteEvent(dword token, const WritePropertyRequest& req) :
+		WriteRequestEvent(req), _token(token) {
+	}
+
+	dword token() const { return _token; }
+
+private:
+	dword _token;
+};
+#endif
+
+/**
+ * Posted once per batch of local property updates
+ * It lists the objects that had at least one property changed by the batch.
+ */
+class PropertiesChangedEvent : public FC::Event {
+public:
+	BACNET_POOL_ALLOCATED
+
+	PropertiesChangedEvent(const std::vector<ObjectIdentifier>& objects) :
+		_objects(objects) {
+	}
+
+	const std::vector<ObjectIdentifier>& objects() const { return _objects; }
+
+private:
+	std::vector<ObjectIdentifier> _objects;
+};
+
+/**
+ * Compact description of a request or response event
+ * Records are plain values delivered in batches by EventBatchEvent.  No value is
+ * copied: a written value can be read back from the server and an acknowledged value
+ * from its transaction while it is alive.
+ */
+struct EventRecord {
+	enum Kind {
+		ReadRequest,
+		WriteRequest,
+		ReadAck,
+		WriteAck,
+		ErrorAck,
+		KindCount,
+	};
+	static const uint32_t AllKinds = (1u << KindCount) - 1;
+
+	EventRecord(Kind k = ReadRequest, Transaction::IdType id = 0) :
+		transId(id), kind(k), oid(0), pid(0), index(ReadPropertyRequest::NoIndex),
+		priority(0), errorClass(0), errorCode(0) {
+	}
+
+	void setObject(const ObjectIdentifier& objId, const PropertyIdentifierEnum& propId) {
+		oid = objId.getCoded();
+		pid = propId.get();
+	}
+
+	void setError(const Error& error) {
+		kind = ErrorAck;
+		errorClass = (uint16_t)error.getClass();
+		errorCode = (uint16_t)error.getCode();
+	}
+
+	Transaction::IdType transId;
+	Kind kind;
+	uint32_t oid;
+	uint32_t pid;
+	uint32_t index;
+	uint8_t priority;
+	uint16_t errorClass;
+	uint16_t errorCode;
+};
+typedef std::vector<EventRecord> EventRecordList;
+
+/**
+ * Select the request and response events an application is interested in
+ * An event is notified if its kind is in {kinds} and, when objects were added, if it
+ * is about one of them.  A filter must not be changed once given to a server.
+ */
+class EventFilter : public FC::RefObject {
+public:
+	EventFilter(uint32_t kinds = EventRecord::AllKinds) : _kinds(kinds) {}
+
+	static uint32_t kindMask(EventRecord::Kind kind) { return 1u << kind; }
+
+	void addObject(const ObjectIdentifier& oid) { _objects.insert(oid.getCoded()); }
+
+	bool accepts(const EventRecord& record) const {
+		return (_kinds & kindMask(record.kind)) &&
+				(_objects.empty() || _objects.find(record.oid) != _objects.end());
+	}
+
+private:
+	uint32_t _kinds;
+	std::unordered_set<uint32_t> _objects;
+};
+typedef FC::Ref<EventFilter> EventFilterRef;
+
+/**
+ * All the request and response events of a server work tick
+ */
+class EventBatchEvent : public FC::Event {
+public:
+	BACNET_POOL_ALLOCATED
+
+	EventBatchEvent(const EventRecordList& records) :
+		_records(records) {
+	}
+
+	const EventRecordList& records() const { return _records; }
+
+private:
+	EventRecordList _records;
+};
+
+/**
+ * Size and overflow policy of the queues between the stack and the application
+ * - submit: requests queued by submitReadProperty/submitWriteProperty
+ * - ack: responses and errors of the client transactions
+ * - write: properties written by remote devices
+ * The ack and write queues are filled from the stack thread which must not wait, they
+ * should not use OverflowBlock.
+ */
+struct QueueSettings {
+	QueueSettings() :
+		submitCapacity(1024), submitPolicy(OverflowBlock),
+		ackCapacity(4096), ackPolicy(OverflowDropOldest),
+		writeCapacity(4096), writePolicy(OverflowDropOldest) {
+	}
+
+	size_t submitCapacity;
+	OverflowPolicy submitPolicy;
+	size_t ackCapacity;
+	OverflowPolicy ackPolicy;
+	size_t writeCapacity;
+	OverflowPolicy writePolicy;
+};
+
+/**
+ * Request waiting in the submission queue to be sent by the stack thread
+ */
+struct SubmitRecord {
+	SubmitRecord() : device(0), submitted(0) {}
+
+	TransactionRef trans;
+	ObjectInstance device;
+	ConfirmedRequestRef request;
+	uint64_t submitted;
+};
+
+/**
+ * Threads decoding the client transaction responses
+ * The stack thread only hands the completed transaction to a worker and goes back to
+ * the stack.  The vbag is owned by the transaction and the stack does not touch it
+ * once complete, so the queue slot just holds the transaction reference, no value
+ * is copied nor allocated.  A transaction always goes to the same worker, picked from
+ * its id.  If the worker queue is full the response is handled by the caller.
+ * Dispatching takes no lock, stop waits for the dispatches in progress instead.
+ */
+class AckWorkerPool : public FC::RefObject {
+public:
+	static const size_t QueueCapacity = 1024;
+
+	AckWorkerPool(Server& server, unsigned workers);
+	~AckWorkerPool();
+
+	void start();
+	/**
+	 * Stop the workers, the responses still queued are handled by the caller
+	 */
+	void stop();
+	bool dispatch(const TransactionRef& trans);
+
+private:
+	AckWorkerPool(const AckWorkerPool&);
+	AckWorkerPool& operator=(const AckWorkerPool&);
+
+	struct Worker {
+		AckWorkerPool* pool;
+		pthread_t thread;
+		sem_t ready;
+		FC::Ref<BoundedQueue<TransactionRef> > queue;
+	};
+
+	static void* run(void* arg);
+	static void handle(Server& server, const TransactionRef& trans);
+
+	Server& _server;
+	std::vector<Worker*> _workers;
+	// Set and cleared atomically by start and stop
+	volatile int _running;
+	// Dispatches that may have seen the pool running, stop waits for them
+	AtomicCounter _dispatching;
+};
+
 class IAmEvent : public FC::Event {
 public:
+	BACNET_POOL_ALLOCATED
+
 	IAmEvent(const IAmRequest& request) :
 		_request(request) {
 	}
@@ -263,6 +675,9 @@ public:
 
 	friend class ServerManager;
 	friend class StackAccessor;
+	friend class AckWorkerPool;
+	friend class TransactionManager;
+	template <typename T> friend class PointHandle;
 
 	ObjectInstance getInstance() const {
 		return _localDev->getInstance();
@@ -290,111 +705,221 @@ public:
 		return _broadcast;
 	}
 
-	void addObject(const Object& obj) {
-		FC::Mutex(_mutex);
-		_localDev->addObject(obj);
-	}
+	/*
+	 * Synchronization of the local device database
+	 * - _dbLock protects the object index (which objects exist).  Adding or deleting an
+	 *   object takes it in write mode, every other accessor takes it in read mode.
+	 * - _objLocks protects the property values, one stripe per group of objects.
+	 *   Reads take the object stripe in read mode, writes in write mode.
+	 * - _remoteLock protects the remote device map.
+	 * - _stackMutex serializes the calls into the VSB stack, it is shared by all the
+	 *   servers of the process since there is only one stack.  Transactions are
+	 *   protected by their shard lock, taken after _stackMutex when both are needed.
+	 * Lock order is _stackMutex, _dbLock then an object stripe.
+	 *
+	 * Property values and the object list are read from a snapshot, without the
+	 * database locks as long as no object was added or deleted, see snapshot.  Each
+	 * writer publishes a new version of the object it changed, while still holding the
+	 * object stripe, so a reader always sees its own writes.  The modified and dirty
+	 * flags are not part of the snapshot and are read under the locks.
+	 */
 
-	void deleteObject(const ObjectIdentifier& oid) {
-		FC::Mutex(_mutex);
-		_localDev->deleteObject(oid);
-	}
+	/**
+	 * Return a snapshot of the local objects
+	 * Only a spin lock is held, to copy the snapshot reference, unless objects were
+	 * added or deleted since the previous snapshot.  The new one is then built under
+	 * the object database read lock and _snapshotMutex, so the first reader after an
+	 * add or delete waits for the writers and the other readers rebuilding it.
+	 */
+	DatabaseSnapshotRef snapshot() const;
+
+	/**
+	 * Add an object to the local device
+	 * The object identifier must not be used by another server of the process.
+	 */
+	void addObject(const Object& obj);
+	void deleteObject(const ObjectIdentifier& oid);
 
 	uint32_t getNextObjectInstance(const ObjectTypeEnum& type) const {
-		FC::Mutex(_mutex);
+		ReadLock dbLock(_dbLock);
 		return _localDev->getNextObjectInstance(type);
 	}
 
 	template <typename T>
 	bool getProperty(const PropertyIdentifierEnum& id, T& value, bool throwError = true) const {
-		FC::Mutex(_mutex);
-		return _localDev->getProperty(id, value, throwError);
+		return snapshot()->getObjectProperty(_localOid, id, value, throwError);
 	}
 	template <typename T>
 	bool getProperty(const ObjectIdentifier& oid, const PropertyIdentifierEnum& id,
 			T& value, bool throwError = true) const {
-		FC::Mutex(_mutex);
-		return _localDev->getObjectProperty(oid, id, value, throwError);
+		return snapshot()->getObjectProperty(oid, id, value, throwError);
+	}
+	/**
+	 * Get a property value without exception, see BacnetStatus
+	 */
+	template <typename T>
+	BacnetStatus tryGetProperty(const ObjectIdentifier& oid, const PropertyIdentifierEnum& id,
+			T& value) const {
+		return snapshot()->tryGetObjectProperty(oid, id, value);
 	}
 	template <typename T>
 	bool setProperty(const PropertyIdentifierEnum& id, const T& value, bool throwError = true) {
-		FC::Mutex(_mutex);
-		return _localDev->setProperty(id, value, throwError);
+		ReadLock dbLock(_dbLock);
+		WriteLock objLock(_objLocks.get(_localOid));
+		bool result = _localDev->setProperty(id, value, throwError);
+		if (result) {
+			publishProperty(_localOid, id);
+		}
+		return result;
 	}
 	template <typename T>
 	bool setProperty(const ObjectIdentifier& oid, const PropertyIdentifierEnum& id,
 			const T& value, bool throwError = true) {
-		FC::Mutex(_mutex);
-		return _localDev->setObjectProperty(oid, id, value, throwError);
+		ReadLock dbLock(_dbLock);
+		WriteLock objLock(_objLocks.get(oid));
+		bool result = _localDev->setObjectProperty(oid, id, value, throwError);
+		if (result) {
+			publishProperty(oid, id);
+		}
+		return result;
+	}
+	/**
+	 * Set a property value without exception, see BacnetStatus
+	 */
+	BacnetStatus trySetProperty(const ObjectIdentifier& oid, const PropertyIdentifierEnum& id,
+			const BacnetValue& value) {
+		ReadLock dbLock(_dbLock);
+		WriteLock objLock(_objLocks.get(oid));
+		BacnetStatus status = _localDev->trySetObjectProperty(oid, id, value);
+		if (status.ok()) {
+			publishProperty(oid, id);
+		}
+		return status;
 	}
+	/**
+	 * Apply a batch of local property updates
+	 * The updates are grouped by object lock so the object index is locked once and
+	 * each object stripe at most once.  The status of each update is reported in place
+	 * and a single PropertiesChangedEvent is posted for the whole batch.
+	 *
+	 * return the number of updates successfully applied
+	 */
+	size_t setProperties(PropertyUpdate* updates, size_t count);
+	size_t setProperties(PropertyUpdateList& updates) {
+		return updates.empty() ? 0 : setProperties(&updates[0], updates.size());
+	}
+	/**
+	 * Resolve a local object property once into a typed handle
+	 * T is the BacnetValue type stored for the property, e.g. Real for the present
+	 * value of an analog object.  If the property does not exist or is not of type T
+	 * an invalid handle is returned, or an exception is thrown if {throwError} is set.
+	 */
+	template <typename T>
+	PointHandle<T> getPointHandle(const ObjectIdentifier& oid, const PropertyIdentifierEnum& id,
+			bool throwError = true) const;
+	// Remote writable flags never change once an object is created, no value lock needed
 	bool isPropertyRemoteWrittable(const PropertyIdentifierEnum& id) const {
-		FC::Mutex(_mutex);
+		ReadLock dbLock(_dbLock);
 		return _localDev->isPropertyRemoteWrittable(id);
 	}
-	bool isPropertyRemoteWrittable(const ObjectIdentifier& oid, const PropertyIdentifierEnum& id) {
-		FC::Mutex(_mutex);
+	bool isPropertyRemoteWrittable(const ObjectIdentifier& oid, const PropertyIdentifierEnum& id) const {
+		ReadLock dbLock(_dbLock);
 		return _localDev->isPropertyRemoteWrittable(oid, id);
 	}
 	bool isPropertyModified(const PropertyIdentifierEnum& id) const {
-		FC::Mutex(_mutex);
+		ReadLock dbLock(_dbLock);
+		ReadLock objLock(_objLocks.get(_localOid));
 		return _localDev->isPropertyModified(id);
 	}
-	bool isPropertyModified(const ObjectIdentifier& oid, const PropertyIdentifierEnum& id) {
-		FC::Mutex(_mutex);
+	bool isPropertyModified(const ObjectIdentifier& oid, const PropertyIdentifierEnum& id) const {
+		ReadLock dbLock(_dbLock);
+		ReadLock objLock(_objLocks.get(oid));
 		return _localDev->isPropertyModified(oid, id);
 	}
 	void clearPropertyModified(const PropertyIdentifierEnum& id) const {
-		FC::Mutex(_mutex);
+		ReadLock dbLock(_dbLock);
+		WriteLock objLock(_objLocks.get(_localOid));
 		_localDev->clearPropertyModified(id);
 	}
-	void clearPropertyModified(const ObjectIdentifier& oid, const PropertyIdentifierEnum& id) {
-		FC::Mutex(_mutex);
+	void clearPropertyModified(const ObjectIdentifier& oid, const PropertyIdentifierEnum& id) const {
+		ReadLock dbLock(_dbLock);
+		WriteLock objLock(_objLocks.get(oid));
 		_localDev->clearPropertyModified(oid, id);
 	}
 	bool isPropertyDirty(const PropertyIdentifierEnum& id) const {
-		FC::Mutex(_mutex);
+		ReadLock dbLock(_dbLock);
+		ReadLock objLock(_objLocks.get(_localOid));
 		return _localDev->isPropertyDirty(id);
 	}
-	bool isPropertyDirty(const ObjectIdentifier& oid, const PropertyIdentifierEnum& id) {
-		FC::Mutex(_mutex);
+	bool isPropertyDirty(const ObjectIdentifier& oid, const PropertyIdentifierEnum& id) const {
+		ReadLock dbLock(_dbLock);
+		ReadLock objLock(_objLocks.get(oid));
 		return _localDev->isPropertyDirty(oid, id);
 	}
 	void clearPropertyDirty(const PropertyIdentifierEnum& id) const {
-		FC::Mutex(_mutex);
+		ReadLock dbLock(_dbLock);
+		WriteLock objLock(_objLocks.get(_localOid));
 		_localDev->clearPropertyDirty(id);
 	}
-	void clearPropertyDirty(const ObjectIdentifier& oid, const PropertyIdentifierEnum& id) {
-		FC::Mutex(_mutex);
+	void clearPropertyDirty(const ObjectIdentifier& oid, const PropertyIdentifierEnum& id) const {
+		ReadLock dbLock(_dbLock);
+		WriteLock objLock(_objLocks.get(oid));
 		_localDev->clearPropertyDirty(oid, id);
 	}
 
 	bool hasObject(const ObjectIdentifier& oid) const {
-		FC::Mutex(_mutex);
-		return _localDev->hasObject(oid);
+		return snapshot()->hasObject(oid);
+	}
+
+	size_t getObjectCount() const {
+		return snapshot()->getCount();
+	}
+
+	bool getNextObjectIdentifier(const ObjectIdentifier* from, ObjectIdentifier& next) const {
+		return snapshot()->getNextObjectIdentifier(from, next);
+	}
+
+	/**
+	 * Return a copy of a local object or a null reference if it does not exist
+	 */
+	ObjectRef getObject(const ObjectIdentifier& oid) const {
+		ReadLock dbLock(_dbLock);
+		ReadLock objLock(_objLocks.get(oid));
+		return _localDev->getObject(oid);
+	}
+
+	/**
+	 * Return a copy of the local object with the given name
+	 * Every object name is compared, it is meant for seldom requests like Who-Has.
+	 */
+	ObjectRef getObject(const std::string& name) const {
+		CompactObjectRef obj = snapshot()->getObject(name);
+		return obj ? getObject(obj->getOid()) : ObjectRef(0);
 	}
 
 	void addRemoteDevice(const Device& device) {
-		FC::Mutex(_mutex);
+		WriteLock remoteLock(_remoteLock);
 		_remoteDev[device.getInstance()] = new Device(device);
 	}
 
 	void deleteRemoteDevice(ObjectInstance devInstance) {
-		FC::Mutex(_mutex);
+		WriteLock remoteLock(_remoteLock);
 		_remoteDev.erase(devInstance);
+		_remoteStats.erase(devInstance);
 	}
 
 	bool knowsRemoteDevice(ObjectInstance devInstance) const {
-		FC::Mutex(_mutex);
+		ReadLock remoteLock(_remoteLock);
 		return _remoteDev.find(devInstance) != _remoteDev.end();
 	}
 
 	template <typename T>
-	bool getRemoteProperty(ObjectInstance devInstance, const ObjectIdentifier& oid, T& value,
-			bool throwError = true) const {
-		FC::Mutex(_mutex);
+	bool getRemoteProperty(ObjectInstance devInstance, const ObjectIdentifier& oid,
+			const PropertyIdentifierEnum& id, T& value, bool throwError = true) const {
+		ReadLock remoteLock(_remoteLock);
 		auto it = _remoteDev.find(devInstance);
-		if (it) {
-			return it->second->getObjectProperty(oid, value, throwError);
+		if (it != _remoteDev.end()) {
+			return it->second->getObjectProperty(oid, id, value, throwError);
 		} else if (throwError) {
 			throwException(BacnetErrorException(ErrorClassEnum::Communication,
 						ErrorCodeEnum::UnknownDevice,
@@ -404,12 +929,12 @@ public:
 	}
 
 	template <typename T>
-	bool setRemoteProperty(ObjectInstance devInstance, const ObjectIdentifier& oid, T& value,
-			bool throwError = true) const {
-		FC::Mutex(_mutex);
+	bool setRemoteProperty(ObjectInstance devInstance, const ObjectIdentifier& oid,
+			const PropertyIdentifierEnum& id, const T& value, bool throwError = true) {
+		WriteLock remoteLock(_remoteLock);
 		auto it = _remoteDev.find(devInstance);
-		if (it) {
-			return it->second->setObjectProperty(oid, value, throwError);
+		if (it != _remoteDev.end()) {
+			return it->second->setObjectProperty(oid, id, value, throwError);
 		} else if (throwError) {
 			throwException(BacnetErrorException(ErrorClassEnum::Communication,
 						ErrorCodeEnum::UnknownDevice,
@@ -418,6 +943,42 @@ public:
 		return false;
 	}
 
+	/**
+	 * Choose which request and response events are notified
+	 * E.g. a filter without EventRecord::ReadRequest suppresses the read request events.
+	 * A null filter notifies everything.
+	 */
+	void setEventFilter(const EventFilterRef& filter) { _eventFilter.store(filter); }
+	/**
+	 * Deliver the request and response events in batches
+	 * When set, one EventBatchEvent is posted per work tick with the records of all the
+	 * events of the tick instead of one event each.
+	 */
+	void setBatchEvents(bool batch) { _batchEvents = batch; }
+
+#ifdef VSB_DEFERRED_RESPONSE
+	/**
+	 * Answer the remote writes asynchronously
+	 * When set, a valid remote write is not applied in the stack callback: a
+	 * DeferredWriteEvent is posted and the requesting device waits until completeWrite
+	 * is called.  Requests not completed within the APDU timeout are answered with a
+	 * timeout error.
+	 */
+	void setDeferredWrites(bool deferred) { _deferredWrites = deferred; }
+	/**
+	 * Complete a deferred write from any thread
+	 * Without {error} the value is written and a SimpleACK sent, otherwise the error is
+	 * sent and nothing is written.
+	 *
+	 * return false if the token is unknown, e.g. it already timed out
+	 */
+	bool completeWrite(dword token, const Error* error = 0);
+	size_t getPendingWriteCount() const {
+		FC::MutexLock lock(_pendingMutex);
+		return _pendingWrites.size();
+	}
+#endif
+
 	// Bacnet Service Public API
 	void sendWhoIs(const WhoIsRequest&) const;
 	void sendIHave() const;
@@ -426,12 +987,78 @@ public:
 	Transaction::IdType sendWriteProperty(ObjectInstance, const WritePropertyRequest&) const;
 
 
+	/**
+	 * Create the queues between the stack and the application
+	 * It must be called before the server is started.  Once open, the responses and
+	 * the remote writes are also queued for pollAcks and pollWrites, in addition to
+	 * the events selected by the event filter.
+	 */
+	void openQueues(const QueueSettings& settings = QueueSettings());
+	/**
+	 * Queue a request to be sent by the stack thread
+	 * The caller does not wait for the stack.  The transaction is created right away so
+	 * its id can be polled at once, it stays Idle until sent.  If sending fails the
+	 * transaction is deleted and an ErrorAck record is queued.
+	 *
+	 * return the transaction id or 0 if the submission queue rejected the request
+	 */
+	Transaction::IdType submitReadProperty(ObjectInstance, const ReadPropertyRequest&);
+	Transaction::IdType submitWriteProperty(ObjectInstance, const WritePropertyRequest&);
+	/**
+	 * Move up to {max} queued records to {records}
+	 * return the number of records moved
+	 */
+	size_t pollAcks(EventRecord* records, size_t max);
+	size_t pollWrites(EventRecord* records, size_t max);
+	/**
+	 * Time from submission to the request being handed to the stack
+	 */
+	const StatHistogram& submitLatency() const { return _submitLatency; }
+
+	/**
+	 * Service counters and latencies, see ServerStats
+	 * They are updated with atomic adds and read without lock, a snapshot can be
+	 * taken from any thread.
+	 */
+	const ServerStats& stats() const { return _stats; }
+	void getStats(ServerStatsSnapshot& snap) const { _stats.snapshot(snap); }
+	/**
+	 * Traffic of a remote device, kept from the first request sent to it or its I-Am
+	 * return false if nothing is known about the device
+	 */
+	bool getRemoteStats(ObjectInstance devInstance, RemoteDeviceStatsSnapshot& snap) const;
+	/**
+	 * Return the {count} remote devices with the highest 99th percentile round trip time,
+	 * slowest first.  Only the returned devices are copied, so it can be called often.
+	 */
+	void getSlowestDevices(size_t count, std::vector<RemoteDeviceStatsSnapshot>& devices) const;
+	/**
+	 * Count the remote reads and writes of each local object property
+	 * It is off by default.  The counters are created the first time it is enabled,
+	 * with room for {capacity} properties, and kept when it is disabled.  ServerBench
+	 * --hot-points measures the read path with them on.
+	 */
+	void enableHotPoints(bool enable, size_t capacity = HotPointCounters::DefaultCapacity);
+	/**
+	 * Return the {count} most accessed local properties since the last reset
+	 */
+	void getHotPoints(size_t count, std::vector<HotPoint>& points) const;
+	void resetHotPoints();
+
 	// Transaction Public API
+	// Only the transaction shard is locked, the stack is done with a vbag once complete
 	Transaction::State getTransactionState(const Transaction::IdType&) const;
 	BacnetValueRef getTransactionValue(const Transaction::IdType&) const;
 	bool isTransactionSimpelAck(const Transaction::IdType&) const;
 	bool isTransactionError(const Transaction::IdType&) const;
 	void deleteTransaction(const Transaction::IdType&) const;
+	/**
+	 * Delete the transactions never answered after {recycleMs} and the completed
+	 * transactions nobody deleted after {liveMs}, 0 for the default time
+	 */
+	void setTransactionTimeouts(uint32_t recycleMs, uint32_t liveMs) {
+		_transMgr->setTimeouts(recycleMs, liveMs);
+	}
 
 	std::string toString(std::string *str);
 
@@ -459,8 +1086,70 @@ protected:
 		_broadcast = ip;
 	}
 
+	/**
+	 * Number of threads decoding the responses, 0 to decode on the stack thread
+	 * It must be set before the server is started.
+	 */
+	void setAckWorkers(unsigned workers) {
+		_ackWorkers = workers ? new AckWorkerPool(*this, workers) : 0;
+	}
+
+	/**
+	 * Create the slot of a newly added object, _dbLock must be held in write mode
+	 */
+	void addSlot(const ObjectIdentifier& oid) {
+		_slots[oid.getCoded()] = new ObjectSlot(new CompactObject(*_localDev->findObject(oid)));
+		_dbVersion.increment();
+	}
+
+	/**
+	 * Publish the new value of object properties to the snapshot readers
+	 * The new version copies the previous one, sharing its values, and only the given
+	 * properties are converted again.  _dbLock must be held and the object stripe held
+	 * in write mode.
+	 */
+	void publishProperties(const ObjectIdentifier& oid, const PropertyIdentifierEnum* ids,
+			size_t count);
+	void publishProperty(const ObjectIdentifier& oid, const PropertyIdentifierEnum& id) {
+		publishProperties(oid, &id, 1);
+	}
+	/**
+	 * Same with the stored value already at hand, e.g. for a PointHandle
+	 */
+	void publishProperty(const ObjectIdentifier& oid, const PropertyIdentifierEnum& id,
+			const BacnetValue& value) {
+		auto it = _slots.find(oid.getCoded());
+		if (it != _slots.end()) {
+			CompactObjectRef version = new CompactObject(*it->second->load());
+			version->setProperty(id, value);
+			it->second->store(version);
+		}
+	}
+
 	TransactionRef getTransactionHandle(const Transaction::IdType&) const;
-	TransactionRef getTransactionHandle(const frVbag&) const;
+	TransactionRef getTransactionHandle(const frVbag&, unsigned shard) const;
+
+	TransactionRef createReadTransaction(ObjectInstance, const ReadPropertyRequest&,
+			Transaction::IdType id = 0) const;
+	TransactionRef createWriteTransaction(ObjectInstance, const WritePropertyRequest&,
+			Transaction::IdType id = 0) const;
+	/**
+	 * Hand a request to the stack, _stackMutex must be held
+	 * return 0 or the stack error
+	 */
+	int transmitRead(ObjectInstance, const ReadPropertyRequest&, Transaction&) const;
+	int transmitWrite(ObjectInstance, const WritePropertyRequest&, Transaction&) const;
+	/**
+	 * Send the submitted requests, called by the work tick
+	 */
+	void sendSubmitted();
+	Transaction::IdType submit(ObjectInstance, const ConfirmedRequestRef&, const TransactionRef&);
+
+	void queueRecord(BoundedQueue<EventRecord>* queue, const EventRecord& record) {
+		if (queue) {
+			queue->push(record);
+		}
+	}
 
 	virtual void initialize();
 	virtual void fini();
@@ -485,42 +1174,270 @@ protected:
 	/// - ReadProperty
 	/// - WriteProperty
 
+	/**
+	 * Handle a confirmed request without exception, see BacnetStatus
+	 * The ack is set when the request succeeds.  It is the path of the stack callbacks,
+	 * so requests for unknown objects or properties cost no message formatting.
+	 */
+	template <typename CONF_REQUEST, typename CONF_ACK>
+	BacnetStatus tryHandleConfirmedRequest(const CONF_REQUEST& request, FC::Ref<CONF_ACK>&) {
+		return BacnetStatus(ErrorClassEnum::Services, ErrorCodeEnum::ServiceRequestDenied);
+	}
+	/// Specialized in the cpp file for ReadProperty and WriteProperty
+	/**
+	 * Answer a read request straight into the stack vbag, like tryHandleConfirmedRequest
+	 * The published compact value is encoded without creating any value instance.
+	 */
+	BacnetStatus tryServeReadRequest(const ReadPropertyRequest& request, frVbag& bag);
+
+	/**
+	 * Handle a completed transaction on a worker or right away if there is none
+	 */
+	void dispatchAck(const TransactionRef&);
+	/**
+	 * Count an incoming request answered with the stack result code {result}
+	 */
+	void recordIncoming(ServiceStats& stats, int result, uint64_t start);
+	void recordResponse(const Transaction&);
+	/**
+	 * Return the statistics of a remote device, they are created on first use
+	 */
+	RemoteDeviceStatsRef remoteStats(ObjectInstance devInstance) const;
+	void recordHotPoint(const ObjectIdentifier& oid, const PropertyIdentifierEnum& pid, bool write) {
+		if (_hotPointsEnabled) {
+			if (write) {
+				_hotPoints->recordWrite(oid.getCoded(), pid.get());
+			} else {
+				_hotPoints->recordRead(oid.getCoded(), pid.get());
+			}
+		}
+	}
 	void handleConfirmedRequestAck(const Transaction&);
+#ifdef VSB_DEFERRED_RESPONSE
+	/**
+	 * Keep a remote write pending if deferred writes are enabled
+	 * The request is checked as it would be when written right away, without exception
+	 * like tryHandleConfirmedRequest.  {deferred} is set if the write is pending.
+	 *
+	 * return the error to answer at once, ok if the write is pending or must be
+	 * written right away
+	 */
+	BacnetStatus deferWrite(const WritePropertyRequest&, bool& deferred);
+	/**
+	 * Remove a pending write and apply it, or not with {error}
+	 * {result} receives the stack result to answer with, the caller completes the
+	 * deferred response under the stack mutex.
+	 *
+	 * return false if the token is unknown
+	 */
+	bool takePendingWrite(dword token, const Error* error, int& result);
+	/**
+	 * Answer with a timeout the writes pending for longer than the APDU timeout
+	 * times the number of tries of the local device, the stack mutex held
+	 */
+	void expirePendingWrites();
+#endif
 	void handleReadAck(const Transaction&);
 	void handleWriteAck(const Transaction&);
 
+	bool acceptsEvent(const EventRecord& record) const {
+		EventFilterRef filter = _eventFilter.load();
+		return !filter || filter->accepts(record);
+	}
+
+	void queueEvent(const EventRecord& record) {
+		FC::MutexLock lock(_eventMutex);
+		_pendingEvents.push_back(record);
+	}
+
+	/**
+	 * Post the events queued since the last work tick
+	 */
+	void flushEvents();
+
 	template<typename EVENT, typename REQ>
-	void notifyRequest(const REQ& req) {
-		FC::Ref<EVENT> event(new EVENT(req));
-		post(event);
+	void notifyRequest(const EventRecord& record, const REQ& req) {
+		if (!acceptsEvent(record)) {
+			return;
+		}
+		if (_batchEvents) {
+			queueEvent(record);
+		} else {
+			FC::Ref<EVENT> event(new EVENT(req));
+			post(event);
+		}
 	}
 
 	template<typename EVENT, typename ACK>
-	void notifyAck(const Transaction::IdType& id, const ACK& ack) {
-		FC::Ref<EVENT> event(new EVENT(id, ack));
-		post(event);
+	void notifyAck(const EventRecord& record, const ACK& ack) {
+		if (!acceptsEvent(record)) {
+			return;
+		}
+		if (_batchEvents) {
+			queueEvent(record);
+		} else {
+			FC::Ref<EVENT> event(new EVENT(record.transId, ack));
+			post(event);
+		}
 	}
 
 private:
-	Server(ObjectInstance instance, const std::string& name, unsigned doWorkRateMsec = DoWorkRate);
+	Server(ObjectInstance instance, const std::string& name, unsigned doWorkRateMsec = DoWorkRate,
+			unsigned transactionShards = 1);
 
 	typedef std::map<ObjectInstance, DeviceRef > DeviceMap;
+	typedef std::map<uint32_t, ObjectSlotRef> SlotMap;
 
 	DeviceRef _localDev;
 	DeviceMap _remoteDev;
+	typedef std::unordered_map<ObjectInstance, RemoteDeviceStatsRef> RemoteStatsMap;
+	// Protected by _remoteLock like the remote devices
+	mutable RemoteStatsMap _remoteStats;
 	std::string _bbmdIp;
 	uint16_t _bbmdTtl;
 	std::string _broadcast;
 	bool _started;
+	bool _ownsStack;
 	unsigned _workRate;
-	FC::Ref<TransactionManager> _transMgr;
-	struct timeval _lastWork;
+	FC::Ref<TransactionShards> _transMgr;
+	uint64_t _lastWork;
 	FC::Ref<FC::TimerEvent> _workTimer;
-	FC::Mutex _mutex;
+	static FC::Mutex _stackMutex;
+	RWLock _dbLock;
+	StripedLock _objLocks;
+	RWLock _remoteLock;
+	ObjectIdentifier _localOid;
+	SlotMap _slots;
+	AtomicCounter _dbVersion;
+	mutable AtomicRef<DatabaseSnapshot> _snapshot;
+	FC::Mutex _snapshotMutex;
+	AtomicRef<EventFilter> _eventFilter;
+	volatile bool _batchEvents;
+	// Never replaced once created, so it is used without lock while enabled
+	HotPointCountersRef _hotPoints;
+	volatile bool _hotPointsEnabled;
+	FC::Mutex _hotPointsMutex;
+	FC::Mutex _eventMutex;
+	EventRecordList _pendingEvents;
+	FC::Ref<BoundedQueue<SubmitRecord> > _submitQueue;
+	FC::Ref<BoundedQueue<EventRecord> > _ackQueue;
+	FC::Ref<BoundedQueue<EventRecord> > _writeQueue;
+	StatHistogram _submitLatency;
+	mutable ServerStats _stats;
+	FC::Ref<AckWorkerPool> _ackWorkers;
+#ifdef VSB_DEFERRED_RESPONSE
+	struct PendingWrite {
+		PendingWrite() : received(0) {}
+		PendingWrite(const WritePropertyRequest& req, uint64_t time) :
+			request(new WritePropertyRequest(req)), received(time) {}
+
+		FC::Ref<WritePropertyRequest> request;
+		uint64_t received;
+	};
+	typedef std::unordered_map<dword, PendingWrite> PendingWriteMap;
+
+	volatile bool _deferredWrites;
+	FC::Mutex _pendingMutex;
+	PendingWriteMap _pendingWrites;
+#endif
 };
 
 
 
+/**
+ * Pre-resolved handle on a local object property
+ * A handle is resolved once with Server::getPointHandle and then reads or writes the
+ * stored value directly, without looking up the object and the property again.
+ * Access is done under the server object database and object locks, like any
+ * other property accessor, and a set publishes the new value of the property to the
+ * snapshot readers.  The handle keeps the object alive: once the object is deleted
+ * from the server the handle becomes invalid and get/set return false.
+ */
+template <typename T>
+class PointHandle {
+public:
+	PointHandle() {}
+
+	bool isValid() const {
+		if (!_server) {
+			return false;
+		}
+		ReadLock dbLock(_server->_dbLock);
+		return !_object->isDeleted();
+	}
+
+	const ObjectIdentifier& oid() const { return _oid; }
+	PropertyIdentifierEnum pid() const { return _pid; }
+
+	bool get(T& value) const {
+		if (!_server) {
+			return false;
+		}
+		ReadLock dbLock(_server->_dbLock);
+		ReadLock objLock(_server->_objLocks.get(_oid));
+		if (_object->isDeleted()) {
+			return false;
+		}
+		value = *_value;
+		return true;
+	}
+
+	bool set(const T& value) {
+		if (!_server) {
+			return false;
+		}
+		ReadLock dbLock(_server->_dbLock);
+		WriteLock objLock(_server->_objLocks.get(_oid));
+		if (_object->isDeleted()) {
+			return false;
+		}
+		*_value = value;
+		_server->publishProperty(_oid, _pid, *_value);
+		return true;
+	}
+
+private:
+	friend class Server;
+
+	PointHandle(const ServerRef& server, const ObjectRef& object, const FC::Ref<T>& value,
+			const ObjectIdentifier& oid, const PropertyIdentifierEnum& pid) :
+		_server(server), _object(object), _value(value), _oid(oid), _pid(pid) {
+	}
+
+	ServerRef _server;
+	ObjectRef _object;
+	FC::Ref<T> _value;
+	ObjectIdentifier _oid;
+	PropertyIdentifierEnum _pid;
+};
+
+template <typename T>
+PointHandle<T> Server::getPointHandle(const ObjectIdentifier& oid, const PropertyIdentifierEnum& id,
+		bool throwError) const {
+	ReadLock dbLock(_dbLock);
+	ObjectRef obj;
+	BacnetValueRef value;
+	if (!_localDev->resolveProperty(oid, id, obj, value)) {
+		if (throwError) {
+			std::ostringstream oss;
+			oss << "Property " << id.name() << " of object " << oid << " does not exist.";
+			throwException(BacnetErrorException(ErrorClassEnum::Property,
+					ErrorCodeEnum::UnknownProperty, oss.str()));
+		}
+		return PointHandle<T>();
+	}
+	FC::Ref<T> typed = dynamic_cast<T*>(value.get());
+	if (!typed) {
+		if (throwError) {
+			throwException(BacnetErrorException(ErrorClassEnum::Property,
+					ErrorCodeEnum::InvalidDataType,
+					FC::StringAPrintf("Property %s is of type %s.", id.name(), value->typeName())));
+		}
+		return PointHandle<T>();
+	}
+	return PointHandle<T>(const_cast<Server*>(this), obj, typed, oid, id);
+}
+
 } // VIGBACNET
 
 
@@ -0,0 +1,82 @@
+/*
+ * BacnetSnapshot.cpp
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#include <algorithm>
+#include "BacnetSnapshot.h"
+
+namespace VIGBACNET {
+
+CompactObject::CompactObject(const Object& object) :
+	_oid(object.getOid()) {
+	const Object::PropertyMap& properties = object.getProperties();
+	_entries.reserve(properties.size());
+	auto it = properties.begin();
+	while (it != properties.end()) {
+		BacnetValueRef value = it->second->getValue();
+		_entries.push_back(Entry(it->first.get(), value ? CompactValue(*value) : CompactValue()));
+		it++;
+	}
+}
+
+const CompactValue* CompactObject::findProperty(PropertyIdentifierEnum id) const {
+	auto it = std::lower_bound(_entries.begin(), _entries.end(), (uint32_t)id.get(),
+			CompareEntry());
+	if (it != _entries.end() && it->first == (uint32_t)id.get()) {
+		return &it->second;
+	}
+	return 0;
+}
+
+std::string CompactObject::name() const {
+	// The name cannot change once the object is created, it is not kept apart so a
+	// copy of the version does not copy it
+	std::string str;
+	getProperty(PropertyIdentifierEnum::ObjectName, str, false);
+	return str;
+}
+
+void CompactObject::setProperty(PropertyIdentifierEnum id, const BacnetValue& value) {
+	auto it = std::lower_bound(_entries.begin(), _entries.end(), (uint32_t)id.get(),
+			CompareEntry());
+	if (it != _entries.end() && it->first == (uint32_t)id.get()) {
+		it->second.set(value);
+	} else {
+		_entries.insert(it, Entry(id.get(), CompactValue(value)));
+	}
+}
+
+DatabaseSnapshot::EntryList::const_iterator DatabaseSnapshot::find(uint32_t codedOid) const {
+	auto it = std::lower_bound(_entries.begin(), _entries.end(), codedOid, CompareEntry());
+	if (it != _entries.end() && it->first == codedOid) {
+		return it;
+	}
+	return _entries.end();
+}
+
+CompactObjectRef DatabaseSnapshot::getObject(const std::string& name) const {
+	auto it = _entries.begin();
+	while (it != _entries.end()) {
+		CompactObjectRef obj = it->second->load();
+		if (obj->name() == name) {
+			return obj;
+		}
+		it++;
+	}
+	return 0;
+}
+
+bool DatabaseSnapshot::getNextObjectIdentifier(const ObjectIdentifier* from,
+		ObjectIdentifier& next) const {
+	auto it = from ? std::upper_bound(_entries.begin(), _entries.end(), from->getCoded(),
+			CompareEntry()) : _entries.begin();
+	if (it != _entries.end()) {
+		next = ObjectIdentifier(it->first);
+		return true;
+	}
+	return false;
+}
+
+} // VIGBACNET
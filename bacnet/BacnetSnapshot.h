@@ -0,0 +1,210 @@
+/*
+ * BacnetSnapshot.h
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#ifndef BacnetSnapshot_h
+#define BacnetSnapshot_h
+
+#include <vector>
+#include "fc.h"
+#include "BacnetObject.h"
+#include "BacnetSync.h"
+#include "BacnetCompactValue.h"
+
+namespace VIGBACNET {
+
+/**
+ * Read only copy of an object, its properties stored as compact values
+ * The properties are sorted by identifier in one vector, so a version costs one
+ * allocation plus the out of line values.  It is kept next to the live Object, which
+ * still holds the properties as classes for the writers, so it adds to the memory of
+ * an object rather than replacing it: about 820 bytes on the 2 KB of an analog value.
+ */
+class CompactObject : public FC::RefObject {
+public:
+	BACNET_POOL_ALLOCATED
+
+	typedef std::pair<uint32_t, CompactValue> Entry;
+	typedef std::vector<Entry> EntryList;
+
+	explicit CompactObject(const Object& object);
+	/**
+	 * Copy a version, the copy shares the out of line values of {object}
+	 * A change of a few properties is published by copying the previous version and
+	 * replacing the changed values with setProperty, the other values are not
+	 * converted again.
+	 */
+	CompactObject(const CompactObject& object) :
+		FC::RefObject(), _oid(object._oid), _entries(object._entries) {}
+
+	const ObjectIdentifier& getOid() const { return _oid; }
+	std::string name() const;
+	size_t getPropertyCount() const { return _entries.size(); }
+
+	/**
+	 * Return the property value or null if the object does not have it
+	 */
+	const CompactValue* findProperty(PropertyIdentifierEnum id) const;
+
+	/**
+	 * Replace or add the value of a property
+	 * Only for a version not published yet, the published ones are never modified.
+	 */
+	void setProperty(PropertyIdentifierEnum id, const BacnetValue& value);
+
+	template <typename T>
+	bool getProperty(PropertyIdentifierEnum id, T& value, bool throwError = true) const {
+		const CompactValue* v = findProperty(id);
+		if (!v) {
+			if (throwError) {
+				std::ostringstream oss;
+				oss << "Property " << id.name() << " of object " << name() << " does not exist.";
+				throwException(BacnetErrorException(ErrorClassEnum::Property,
+						ErrorCodeEnum::UnknownProperty, oss.str()));
+			}
+			return false;
+		}
+		return v->get(value, throwError);
+	}
+
+	/**
+	 * Get the property value without exception
+	 */
+	template <typename T>
+	BacnetStatus tryGetProperty(PropertyIdentifierEnum id, T& value) const {
+		const CompactValue* v = findProperty(id);
+		if (!v) {
+			return BacnetStatus(ErrorClassEnum::Property, ErrorCodeEnum::UnknownProperty);
+		}
+		if (!v->get(value, false)) {
+			return BacnetStatus(ErrorClassEnum::Property, ErrorCodeEnum::InvalidDataType);
+		}
+		return BacnetStatus();
+	}
+
+private:
+	struct CompareEntry {
+		bool operator() (const Entry& lhs, uint32_t rhs) const { return lhs.first < rhs; }
+	};
+
+	ObjectIdentifier _oid;
+	EntryList _entries;
+};
+typedef FC::Ref<CompactObject> CompactObjectRef;
+
+/**
+ * Latest published version of a local object
+ * Each time an object is changed the writer stores a new compact copy of it in its slot.  A
+ * version is never modified once published, so readers can use it without any lock
+ * and all the properties read from the same version are consistent.
+ */
+class ObjectSlot : public FC::RefObject {
+public:
+	ObjectSlot(const CompactObjectRef& version) : _version(version) {}
+
+	CompactObjectRef load() const { return _version.load(); }
+	void store(const CompactObjectRef& version) { _version.store(version); }
+
+private:
+	AtomicRef<CompactObject> _version;
+};
+typedef FC::Ref<ObjectSlot> ObjectSlotRef;
+
+class DatabaseSnapshot;
+typedef FC::Ref<DatabaseSnapshot> DatabaseSnapshotRef;
+
+/**
+ * Read only view of the local device objects
+ * A snapshot pins the list of objects existing when it was taken, sorted by coded
+ * object identifier like the device object list.  The snapshot itself is never
+ * modified, a new one is built when objects are added or deleted.  Property values
+ * are read from the latest version published in each object slot: use getObject and
+ * read from the returned version to get several properties of the same state, e.g.
+ * to answer a read property multiple for all the properties of an object.
+ */
+class DatabaseSnapshot : public FC::RefObject {
+public:
+	typedef std::pair<uint32_t, ObjectSlotRef> Entry;
+	typedef std::vector<Entry> EntryList;
+
+	DatabaseSnapshot(uint32_t version) : _version(version) {}
+
+	uint32_t version() const { return _version; }
+
+	size_t getCount() const { return _entries.size(); }
+
+	bool hasObject(const ObjectIdentifier& oid) const {
+		return find(oid.getCoded()) != _entries.end();
+	}
+
+	/**
+	 * Return the latest published version of the object or a null reference
+	 * The version is shared with the other readers and must not be modified.
+	 */
+	CompactObjectRef getObject(const ObjectIdentifier& oid) const {
+		auto it = find(oid.getCoded());
+		return it != _entries.end() ? it->second->load() : CompactObjectRef(0);
+	}
+
+	/**
+	 * Return the latest published version of the object with the given name
+	 * Every object is looked at, it is meant for seldom requests like Who-Has.
+	 */
+	CompactObjectRef getObject(const std::string& name) const;
+
+	bool getNextObjectIdentifier(const ObjectIdentifier* from, ObjectIdentifier& next) const;
+
+	template <typename T>
+	bool getObjectProperty(const ObjectIdentifier& oid, PropertyIdentifierEnum id,
+			T& value, bool throwError = true) const {
+		CompactObjectRef obj = getObject(oid);
+		if (obj) {
+			return obj->getProperty(id, value, throwError);
+		} else if (throwError) {
+			std::ostringstream oss;
+			oss << "Object " << oid << "does not exist.";
+			throwException(BacnetErrorException(ErrorClassEnum::Object,
+					ErrorCodeEnum::UnknownObject, oss.str()));
+		}
+		return false;
+	}
+
+	/**
+	 * Get an object property value without exception
+	 */
+	template <typename T>
+	BacnetStatus tryGetObjectProperty(const ObjectIdentifier& oid, PropertyIdentifierEnum id,
+			T& value) const {
+		CompactObjectRef obj = getObject(oid);
+		if (!obj) {
+			return BacnetStatus(ErrorClassEnum::Object, ErrorCodeEnum::UnknownObject);
+		}
+		return obj->tryGetProperty(id, value);
+	}
+
+	/**
+	 * Append a slot, entries must be added by increasing coded identifier
+	 */
+	void add(uint32_t codedOid, const ObjectSlotRef& slot) {
+		_entries.push_back(Entry(codedOid, slot));
+	}
+
+	void reserve(size_t count) { _entries.reserve(count); }
+
+private:
+	struct CompareEntry {
+		bool operator() (const Entry& lhs, uint32_t rhs) const { return lhs.first < rhs; }
+		bool operator() (uint32_t lhs, const Entry& rhs) const { return lhs < rhs.first; }
+	};
+
+	EntryList::const_iterator find(uint32_t codedOid) const;
+
+	uint32_t _version;
+	EntryList _entries;
+};
+
+} // VIGBACNET
+
+#endif /* BACNETSNAPSHOT_H_ */
@@ -0,0 +1,133 @@
+/*
+ * BacnetSpans.cpp
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include "BacnetSpans.h"
+#include "BacnetEnums.h"
+#include "BacnetUtils.h"
+#include "BacnetExceptions.h"
+
+namespace VIGBACNET {
+
+namespace {
+
+/**
+ * Writes the async events of the spans, one transaction per async id
+ */
+class ChromeTraceWriter {
+public:
+	ChromeTraceWriter(FILE* out) : _out(out), _first(true) {
+		fprintf(_out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	}
+
+	~ChromeTraceWriter() {
+		fprintf(_out, "\n]}\n");
+	}
+
+	void write(const TransactionSpan& span) {
+		uint64_t end = span.posted ? span.posted : span.decoded ? span.decoded :
+				span.responded ? span.responded : span.submitted;
+		if (!span.created || !end) {
+			return;
+		}
+		const char* name = ConfirmedServiceChoiceEnum(
+				(ConfirmedServiceChoiceEnum::Enum)span.service).name();
+		event(span, name, 'b', span.created, true);
+		step(span, "queued", span.created, span.submitted);
+		step(span, "stack", span.submitted, span.responded);
+		step(span, "decode", span.responded, span.decoded);
+		step(span, "dispatch", span.decoded, span.posted);
+		event(span, name, 'e', end, false);
+	}
+
+private:
+	void step(const TransactionSpan& span, const char* name, uint64_t begin, uint64_t end) {
+		if (begin && end) {
+			event(span, name, 'b', begin, false);
+			event(span, name, 'e', end, false);
+		}
+	}
+
+	void event(const TransactionSpan& span, const char* name, char phase, uint64_t time,
+			bool args) {
+		fprintf(_out, "%s{\"name\":\"%s\",\"cat\":\"transaction\",\"ph\":\"%c\","
+				"\"id\":\"0x%llx\",\"pid\":1,\"tid\":%u,\"ts\":%.3f",
+				_first ? "" : ",\n", name, phase, (unsigned long long)span.id, span.device,
+				(double)time / 1000.0);
+		if (args) {
+			fprintf(_out, ",\"args\":{\"transaction\":%llu,\"device\":%u,\"result\":%d}",
+					(unsigned long long)span.id, span.device, span.result);
+		}
+		fprintf(_out, "}");
+		_first = false;
+	}
+
+	FILE* _out;
+	bool _first;
+};
+
+} // local namespace
+
+FC::Mutex SpanRecorder::_mutex;
+std::vector<TransactionSpan> SpanRecorder::_spans;
+size_t SpanRecorder::_next = 0;
+volatile uint32_t SpanRecorder::_sampleEvery = 0;
+volatile uint32_t SpanRecorder::_sampleCount = 0;
+
+void SpanRecorder::enable(uint32_t sampleEvery, size_t capacity) {
+	FC::MutexLock lock(_mutex);
+	if (_spans.empty() && capacity) {
+		_spans.resize(capacity);
+	}
+	_sampleEvery = sampleEvery;
+}
+
+void SpanRecorder::record(const TransactionSpan& span) {
+	FC::MutexLock lock(_mutex);
+	if (!_spans.empty()) {
+		_spans[_next % _spans.size()] = span;
+		_next++;
+	}
+}
+
+void SpanRecorder::getSpans(std::vector<TransactionSpan>& spans) {
+	FC::MutexLock lock(_mutex);
+	size_t count = _next < _spans.size() ? _next : _spans.size();
+	spans.clear();
+	spans.reserve(count);
+	for (size_t i = _next - count; i < _next; i++) {
+		spans.push_back(_spans[i % _spans.size()]);
+	}
+}
+
+void SpanRecorder::clear() {
+	FC::MutexLock lock(_mutex);
+	_next = 0;
+}
+
+size_t SpanRecorder::writeChromeTrace(FILE* out) {
+	std::vector<TransactionSpan> spans;
+	getSpans(spans);
+	ChromeTraceWriter writer(out);
+	for (size_t i = 0; i < spans.size(); i++) {
+		writer.write(spans[i]);
+	}
+	return spans.size();
+}
+
+size_t SpanRecorder::dumpChromeTrace(const std::string& path) {
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file) {
+		throwException(BacnetApplicationException(FC::StringAPrintf(
+				"Cannot create the span file %s: %s", path.c_str(), strerror(errno))));
+	}
+	size_t count = writeChromeTrace(file);
+	fclose(file);
+	return count;
+}
+
+} // VIGBACNET
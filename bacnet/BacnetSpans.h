@@ -0,0 +1,98 @@
+/*
+ * BacnetSpans.h
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#ifndef BacnetSpans_h
+#define BacnetSpans_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "fc.h"
+#include "BacnetClock.h"
+
+namespace VIGBACNET {
+
+/**
+ * Timestamps of the life of one client transaction, in Clock nanoseconds
+ * created     the transaction is created, possibly queued for the stack thread
+ * submitted   it is given to the stack (frcReadProperty or frcWriteProperty)
+ * responded   the stack gives back the response, after retries if any (fraResponse)
+ * decoded     the response is converted to a BACnet value
+ * posted      the ack event is queued and posted
+ * A step not reached yet is 0.  Only sampled transactions take the timestamps.
+ */
+struct TransactionSpan {
+	TransactionSpan() :
+		id(0), service(0), device(0), result(0), sampled(false),
+		created(0), submitted(0), responded(0), decoded(0), posted(0) {
+	}
+
+	uint64_t id;
+	uint32_t service;
+	uint32_t device;
+	int32_t result;
+	bool sampled;
+	uint64_t created;
+	uint64_t submitted;
+	uint64_t responded;
+	uint64_t decoded;
+	uint64_t posted;
+};
+
+/**
+ * Ring of the latest completed transaction spans
+ * One transaction out of {sampleEvery} is sampled, so the recorder can stay on in
+ * production with a sampling of e.g. 100.  The spans are written as Chrome trace
+ * JSON, which chrome://tracing and Perfetto open: each transaction is an async
+ * slice split in the queued, stack, decode and dispatch steps.
+ */
+class SpanRecorder {
+public:
+	static const size_t DefaultCapacity = 4096;
+
+	/**
+	 * Sample one transaction out of {sampleEvery}, 0 stops the sampling
+	 * The ring of {capacity} spans is created on the first call.
+	 */
+	static void enable(uint32_t sampleEvery = 1, size_t capacity = DefaultCapacity);
+	static void disable() { _sampleEvery = 0; }
+	static bool isEnabled() { return _sampleEvery != 0; }
+
+	/**
+	 * Tell if the transaction being created is sampled
+	 */
+	static bool sample() {
+		uint32_t every = _sampleEvery;
+		return every && __sync_fetch_and_add(&_sampleCount, 1) % every == 0;
+	}
+
+	static void record(const TransactionSpan& span);
+
+	/**
+	 * Copy the spans of the ring, oldest first
+	 */
+	static void getSpans(std::vector<TransactionSpan>& spans);
+	static void clear();
+
+	/**
+	 * Write the spans of the ring as Chrome trace JSON
+	 * return the number of spans written
+	 */
+	static size_t writeChromeTrace(FILE* out);
+	static size_t dumpChromeTrace(const std::string& path);
+
+private:
+	static FC::Mutex _mutex;
+	static std::vector<TransactionSpan> _spans;
+	static size_t _next;
+	static volatile uint32_t _sampleEvery;
+	static volatile uint32_t _sampleCount;
+};
+
+} // VIGBACNET
+
+#endif /* BACNETSPANS_H_ */
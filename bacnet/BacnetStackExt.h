@@ -0,0 +1,33 @@
+/*
+ * BacnetStackExt.h
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#ifndef BacnetStackExt_h
+#define BacnetStackExt_h
+
+#include "vsbhp.h"
+
+/**
+ * Extensions expected from the stack to answer confirmed requests asynchronously
+ * They are not part of the stock VSB stack, the server only uses them when built
+ * with VSB_DEFERRED_RESPONSE.
+ * - A fraWriteProperty callback returning vsbDeferred keeps the request open: the stack
+ *   neither answers nor frees the invoke id of the requesting device.
+ * - frDeferredToken, called from within the callback, returns the token identifying
+ *   the request being served (source address and invoke id).
+ * - frcCompleteDeferred sends the answer of a deferred request, a SimpleACK for a
+ *   {result} of 0 or the error encoded like the fraWriteProperty return value.
+ *   It returns 0 or an error if the token is unknown, e.g. already timed out.
+ */
+#ifdef VSB_DEFERRED_RESPONSE
+
+const int vsbDeferred = -1;
+
+dword bpublic frDeferredToken(void);
+int bpublic frcCompleteDeferred(dword token, int result);
+
+#endif
+
+#endif /* BACNETSTACKEXT_H_ */
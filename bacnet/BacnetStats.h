@@ -0,0 +1,534 @@
+/*
+ * BacnetStats.h
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#ifndef BacnetStats_h
+#define BacnetStats_h
+
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include "fc.h"
+#include "BacnetClock.h"
+#include "BacnetSync.h"
+
+namespace VIGBACNET {
+
+/**
+ * 64 bit event counter
+ * Updated with one atomic add, it can be read at any time from any thread.
+ */
+class StatCounter {
+public:
+	StatCounter() : _value(0) {}
+
+	void add(uint64_t n = 1) { __sync_fetch_and_add(&_value, n); }
+	uint64_t get() const { return _value; }
+
+private:
+	StatCounter(const StatCounter&);
+	StatCounter& operator=(const StatCounter&);
+
+	volatile uint64_t _value;
+};
+
+/**
+ * Copy of a StatHistogram
+ */
+struct HistogramSnapshot {
+	static const unsigned SubBits = 3;
+	static const unsigned SubCount = 1u << SubBits;
+	static const size_t BucketCount = (64 - SubBits + 1) * SubCount;
+
+	HistogramSnapshot() {
+		memset(this, 0, sizeof(*this));
+	}
+
+	/**
+	 * Bucket of a value: values below SubCount have their own bucket, above that each
+	 * power of two is split in SubCount linear buckets, so a value is known within 1/8.
+	 */
+	static size_t bucket(uint64_t value) {
+		if (value < SubCount) {
+			return (size_t)value;
+		}
+		unsigned magnitude = 63 - __builtin_clzll(value);
+		unsigned shift = magnitude - SubBits;
+		return (size_t)((shift + 1) * SubCount + ((value >> shift) & (SubCount - 1)));
+	}
+
+	/**
+	 * Highest value counted in a bucket
+	 */
+	static uint64_t upperBound(size_t bucket) {
+		if (bucket < SubCount) {
+			return bucket;
+		}
+		unsigned shift = (unsigned)(bucket / SubCount) - 1;
+		uint64_t base = (uint64_t)(SubCount + bucket % SubCount) << shift;
+		return base + ((1ull << shift) - 1);
+	}
+
+	/**
+	 * Return the upper bound of the bucket holding percentile {p}, e.g. 99.9
+	 */
+	uint64_t percentile(double p) const {
+		return percentile(buckets, count, max, p);
+	}
+
+	/**
+	 * Same on the live buckets of a StatHistogram, which can be walked in place
+	 */
+	static uint64_t percentile(const volatile uint64_t* buckets, uint64_t count, uint64_t max,
+			double p) {
+		if (count == 0) {
+			return 0;
+		}
+		uint64_t rank = (uint64_t)(count * p / 100.0);
+		uint64_t seen = 0;
+		for (size_t i = 0; i < BucketCount; i++) {
+			seen += buckets[i];
+			if (seen > rank) {
+				uint64_t bound = upperBound(i);
+				return bound < max ? bound : max;
+			}
+		}
+		return max;
+	}
+
+	uint64_t mean() const { return count ? sum / count : 0; }
+
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t buckets[BucketCount];
+};
+
+/**
+ * Log linear histogram of durations in nanoseconds, HDR histogram style
+ * The only histogram of the library: the server statistics, the remote device round
+ * trips and the benchmarks all use it, so their percentiles are comparable.
+ * Recording is three atomic adds and a compare and swap when the maximum changes,
+ * the buckets are read without lock so a snapshot taken while recording may be off
+ * by the samples being recorded.
+ */
+class StatHistogram {
+public:
+	StatHistogram() {
+		reset();
+	}
+
+	void record(uint64_t value) {
+		__sync_fetch_and_add(&_buckets[HistogramSnapshot::bucket(value)], 1);
+		__sync_fetch_and_add(&_sum, value);
+		__sync_fetch_and_add(&_count, 1);
+		uint64_t max = _max;
+		while (value > max) {
+			uint64_t seen = __sync_val_compare_and_swap(&_max, max, value);
+			if (seen == max) {
+				break;
+			}
+			max = seen;
+		}
+	}
+
+	/**
+	 * Record the time elapsed since {start}, a Clock::now() value
+	 */
+	void recordSince(uint64_t start) {
+		record(Clock::now() - start);
+	}
+
+	uint64_t count() const { return _count; }
+	uint64_t mean() const { return _count ? _sum / _count : 0; }
+
+	/**
+	 * Return the upper bound of the bucket holding percentile {p}, e.g. 99.9
+	 * Walks the live buckets, no snapshot is copied.
+	 */
+	uint64_t percentile(double p) const {
+		return HistogramSnapshot::percentile(_buckets, _count, _max, p);
+	}
+
+	void snapshot(HistogramSnapshot& snap) const {
+		snap.count = _count;
+		snap.sum = _sum;
+		snap.max = _max;
+		for (size_t i = 0; i < HistogramSnapshot::BucketCount; i++) {
+			snap.buckets[i] = _buckets[i];
+		}
+	}
+
+	void reset() {
+		memset((void*)_buckets, 0, sizeof(_buckets));
+		_count = 0;
+		_sum = 0;
+		_max = 0;
+	}
+
+private:
+	StatHistogram(const StatHistogram&);
+	StatHistogram& operator=(const StatHistogram&);
+
+	volatile uint64_t _buckets[HistogramSnapshot::BucketCount];
+	volatile uint64_t _count;
+	volatile uint64_t _sum;
+	volatile uint64_t _max;
+};
+
+/**
+ * Counters of one direction of a service
+ * {errors} is split by error class, the last entry counts the results that are not
+ * an error class, e.g. rejects and aborts.
+ */
+struct ServiceStats {
+	static const size_t ErrorClassCount = 9;
+
+	StatCounter requests;
+	StatCounter success;
+	StatCounter errors[ErrorClassCount];
+	StatHistogram latency;
+
+	void recordError(unsigned errorClass) {
+		errors[errorClass < ErrorClassCount - 1 ? errorClass : ErrorClassCount - 1].add();
+	}
+};
+
+struct ServiceStatsSnapshot {
+	uint64_t requests;
+	uint64_t success;
+	uint64_t errors[ServiceStats::ErrorClassCount];
+	HistogramSnapshot latency;
+
+	void copy(const ServiceStats& stats) {
+		requests = stats.requests.get();
+		success = stats.success.get();
+		for (size_t i = 0; i < ServiceStats::ErrorClassCount; i++) {
+			errors[i] = stats.errors[i].get();
+		}
+		stats.latency.snapshot(latency);
+	}
+};
+
+struct ServerStatsSnapshot;
+
+/**
+ * Instrumentation of a server
+ * - incoming ReadProperty and WriteProperty, from the stack callback to its result
+ * - outgoing transactions by confirmed service, from their creation to the response
+ * - transactions timed out by the stack and the ones expired by the cleanup
+ * - the server work ticks, split in frMain, frWork and the transaction cleanup
+ * Everything is updated lock free and can be read from any thread with snapshot.
+ */
+class ServerStats {
+public:
+	static const size_t MaxServices = 32;
+
+	ServiceStats incomingRead;
+	ServiceStats incomingWrite;
+	// Indexed by ConfirmedServiceChoiceEnum
+	ServiceStats outgoing[MaxServices];
+
+	StatCounter timeouts;
+	// Transactions never answered, deleted after the recycle time
+	StatCounter expiredPending;
+	// Completed transactions nobody deleted, deleted after the live time
+	StatCounter expiredComplete;
+
+	StatCounter workTicks;
+	StatHistogram workMain;
+	StatHistogram workStack;
+	StatHistogram workCleanup;
+
+	ServiceStats& outgoingService(unsigned service) {
+		return outgoing[service < MaxServices ? service : MaxServices - 1];
+	}
+
+	void snapshot(ServerStatsSnapshot& snap) const;
+};
+
+struct ServerStatsSnapshot {
+	ServiceStatsSnapshot incomingRead;
+	ServiceStatsSnapshot incomingWrite;
+	ServiceStatsSnapshot outgoing[ServerStats::MaxServices];
+	uint64_t timeouts;
+	uint64_t expiredPending;
+	uint64_t expiredComplete;
+	uint64_t workTicks;
+	HistogramSnapshot workMain;
+	HistogramSnapshot workStack;
+	HistogramSnapshot workCleanup;
+};
+
+inline void ServerStats::snapshot(ServerStatsSnapshot& snap) const {
+	snap.incomingRead.copy(incomingRead);
+	snap.incomingWrite.copy(incomingWrite);
+	for (size_t i = 0; i < MaxServices; i++) {
+		snap.outgoing[i].copy(outgoing[i]);
+	}
+	snap.timeouts = timeouts.get();
+	snap.expiredPending = expiredPending.get();
+	snap.expiredComplete = expiredComplete.get();
+	snap.workTicks = workTicks.get();
+	workMain.snapshot(snap.workMain);
+	workStack.snapshot(snap.workStack);
+	workCleanup.snapshot(snap.workCleanup);
+}
+
+struct RemoteDeviceStatsSnapshot {
+	typedef std::map<uint16_t, uint64_t> ErrorCountMap;
+
+	uint32_t instance;
+	uint64_t requests;
+	uint64_t acks;
+	uint64_t errors;
+	uint64_t timeouts;
+	uint64_t expired;
+	uint32_t inFlight;
+	// Clock::now() of the last response or I-Am, 0 if never heard of
+	uint64_t lastSeen;
+	uint64_t rttMean;
+	uint64_t rttP50;
+	uint64_t rttP90;
+	uint64_t rttP99;
+	// Error count by stack error code, i.e. error class << 8 + error code
+	ErrorCountMap errorCodes;
+};
+
+/**
+ * Traffic and health of one remote device
+ * The round trip time is kept in a StatHistogram, about 4 KB per device.  Error
+ * codes are rare, they are counted in a map under a spin lock.
+ */
+class RemoteDeviceStats : public FC::RefObject {
+public:
+	RemoteDeviceStats(uint32_t instance) :
+		_instance(instance), _inFlight(0), _lastSeen(0) {
+	}
+
+	uint32_t instance() const { return _instance; }
+
+	void recordSent() {
+		_requests.add();
+		__sync_fetch_and_add(&_inFlight, 1);
+	}
+
+	void recordAck(uint64_t rtt) {
+		_acks.add();
+		recordRtt(rtt);
+	}
+
+	/**
+	 * {error} is the stack error code, see VsbConverter::toError
+	 */
+	void recordError(uint16_t error, bool timeout, uint64_t rtt) {
+		_errors.add();
+		if (timeout) {
+			_timeouts.add();
+		}
+		{
+			SpinLockGuard guard(_errorLock);
+			_errorCodes[error]++;
+		}
+		recordRtt(rtt);
+	}
+
+	/**
+	 * A request never answered, deleted by the transaction cleanup
+	 */
+	void recordExpired() {
+		_expired.add();
+		__sync_fetch_and_sub(&_inFlight, 1);
+	}
+
+	/**
+	 * A request deleted by the application before its response
+	 */
+	void recordCancelled() {
+		__sync_fetch_and_sub(&_inFlight, 1);
+	}
+
+	void seen() { _lastSeen = Clock::now(); }
+
+	/**
+	 * Upper bound of the 99th percentile of the round trip time, to rank devices
+	 */
+	uint64_t rttP99() const { return _rtt.percentile(99); }
+
+	void snapshot(RemoteDeviceStatsSnapshot& snap) const {
+		snap.instance = _instance;
+		snap.requests = _requests.get();
+		snap.acks = _acks.get();
+		snap.errors = _errors.get();
+		snap.timeouts = _timeouts.get();
+		snap.expired = _expired.get();
+		snap.inFlight = _inFlight;
+		snap.lastSeen = _lastSeen;
+		snap.rttMean = _rtt.mean();
+		snap.rttP50 = _rtt.percentile(50);
+		snap.rttP90 = _rtt.percentile(90);
+		snap.rttP99 = _rtt.percentile(99);
+		SpinLockGuard guard(_errorLock);
+		snap.errorCodes = _errorCodes;
+	}
+
+private:
+	void recordRtt(uint64_t rtt) {
+		_rtt.record(rtt);
+		__sync_fetch_and_sub(&_inFlight, 1);
+		seen();
+	}
+
+	uint32_t _instance;
+	StatCounter _requests;
+	StatCounter _acks;
+	StatCounter _errors;
+	StatCounter _timeouts;
+	StatCounter _expired;
+	volatile uint32_t _inFlight;
+	volatile uint64_t _lastSeen;
+	StatHistogram _rtt;
+	SpinLock _errorLock;
+	RemoteDeviceStatsSnapshot::ErrorCountMap _errorCodes;
+};
+typedef FC::Ref<RemoteDeviceStats> RemoteDeviceStatsRef;
+
+/**
+ * Access count of a local object property
+ */
+struct HotPoint {
+	uint32_t oid;
+	uint32_t pid;
+	uint64_t reads;
+	uint64_t writes;
+
+	uint64_t accesses() const { return reads + writes; }
+};
+
+/**
+ * Read and write counters per local object property
+ * The counters live in a fixed size open addressing table: a property takes a slot
+ * the first time it is accessed, with a compare and swap, and keeps it.  Counting is
+ * then a hash, a probe and one atomic add, without lock nor allocation.  When the
+ * table is full the accesses of the new properties are only counted as overflow.
+ */
+class HotPointCounters : public FC::RefObject {
+public:
+	static const size_t DefaultCapacity = 16384;
+	static const unsigned MaxProbes = 32;
+
+	/**
+	 * {capacity} is rounded up to a power of two
+	 */
+	HotPointCounters(size_t capacity = DefaultCapacity) :
+		_mask(0), _overflow(0) {
+		size_t size = 1;
+		while (size < capacity) {
+			size <<= 1;
+		}
+		_mask = size - 1;
+		_slots = new Slot[size];
+		memset((void*)_slots, 0, size * sizeof(Slot));
+	}
+
+	~HotPointCounters() {
+		delete [] _slots;
+	}
+
+	void recordRead(uint32_t oid, uint32_t pid) {
+		Slot* slot = find(oid, pid);
+		if (slot) {
+			__sync_fetch_and_add(&slot->reads, 1);
+		}
+	}
+
+	void recordWrite(uint32_t oid, uint32_t pid) {
+		Slot* slot = find(oid, pid);
+		if (slot) {
+			__sync_fetch_and_add(&slot->writes, 1);
+		}
+	}
+
+	uint64_t overflow() const { return _overflow; }
+
+	/**
+	 * Return the {count} most accessed properties, most accessed first
+	 */
+	void top(size_t count, std::vector<HotPoint>& points) const {
+		points.clear();
+		for (size_t i = 0; i <= _mask; i++) {
+			const Slot& slot = _slots[i];
+			if (slot.key && (slot.reads || slot.writes)) {
+				HotPoint point = { (uint32_t)((slot.key - 1) >> 32), (uint32_t)(slot.key - 1),
+						slot.reads, slot.writes };
+				points.push_back(point);
+			}
+		}
+		count = std::min(count, points.size());
+		std::partial_sort(points.begin(), points.begin() + count, points.end(), MoreAccessed());
+		points.resize(count);
+	}
+
+	/**
+	 * Restart counting, e.g. at the start of each observation period
+	 * The properties keep their slot, an access during the reset may be lost.
+	 */
+	void reset() {
+		for (size_t i = 0; i <= _mask; i++) {
+			_slots[i].reads = 0;
+			_slots[i].writes = 0;
+		}
+		_overflow = 0;
+	}
+
+private:
+	HotPointCounters(const HotPointCounters&);
+	HotPointCounters& operator=(const HotPointCounters&);
+
+	// key is (oid << 32 | pid) + 1 so that 0 marks a free slot
+	struct Slot {
+		volatile uint64_t key;
+		volatile uint64_t reads;
+		volatile uint64_t writes;
+	};
+
+	struct MoreAccessed {
+		bool operator()(const HotPoint& a, const HotPoint& b) const {
+			return a.accesses() > b.accesses();
+		}
+	};
+
+	Slot* find(uint32_t oid, uint32_t pid) {
+		uint64_t key = (((uint64_t)oid << 32) | pid) + 1;
+		// Fibonacci hashing, like StripedLock
+		size_t idx = (size_t)((key * 11400714819323198485ull) >> 32) & _mask;
+		for (unsigned probe = 0; probe < MaxProbes; probe++) {
+			Slot* slot = &_slots[(idx + probe) & _mask];
+			uint64_t current = slot->key;
+			if (current == key) {
+				return slot;
+			}
+			if (current == 0) {
+				current = __sync_val_compare_and_swap(&slot->key, 0, key);
+				if (current == 0 || current == key) {
+					return slot;
+				}
+			}
+		}
+		__sync_fetch_and_add(&_overflow, 1);
+		return 0;
+	}
+
+	size_t _mask;
+	Slot* _slots;
+	volatile uint64_t _overflow;
+};
+typedef FC::Ref<HotPointCounters> HotPointCountersRef;
+
+} // VIGBACNET
+
+#endif /* BACNETSTATS_H_ */
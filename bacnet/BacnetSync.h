@@ -0,0 +1,273 @@
+/*
+ * BacnetSync.h
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#ifndef BacnetSync_h
+#define BacnetSync_h
+
+#include <pthread.h>
+#include <sched.h>
+#include "fc.h"
+
+namespace VIGBACNET {
+
+/**
+ * Size of a cache line
+ * Padding a field with a whole line keeps it off the line of its neighbours whatever
+ * the alignment of the object: operator new only guarantees 16 bytes, so the types
+ * allocated with it are padded rather than over aligned.
+ */
+const size_t CacheLineSize = 64;
+
+/**
+ * Reader/writer lock
+ * Any number of readers can hold the lock at the same time while a writer
+ * holds it alone.  The lock is not recursive, a thread must not take it twice.
+ */
+class RWLock {
+public:
+	RWLock() {
+		pthread_rwlock_init(&_lock, 0);
+	}
+
+	~RWLock() {
+		pthread_rwlock_destroy(&_lock);
+	}
+
+	void readLock() const { pthread_rwlock_rdlock(&_lock); }
+	void writeLock() const { pthread_rwlock_wrlock(&_lock); }
+	void unlock() const { pthread_rwlock_unlock(&_lock); }
+
+private:
+	RWLock(const RWLock&);
+	RWLock& operator=(const RWLock&);
+
+	mutable pthread_rwlock_t _lock;
+};
+
+/**
+ * Hold a RWLock in shared mode for the life of the object
+ */
+class ReadLock {
+public:
+	ReadLock(const RWLock& lock) :
+		_lock(lock) {
+		_lock.readLock();
+	}
+
+	~ReadLock() {
+		_lock.unlock();
+	}
+
+private:
+	ReadLock(const ReadLock&);
+	ReadLock& operator=(const ReadLock&);
+
+	const RWLock& _lock;
+};
+
+/**
+ * Hold a RWLock in exclusive mode for the life of the object
+ */
+class WriteLock {
+public:
+	WriteLock(const RWLock& lock) :
+		_lock(lock) {
+		_lock.writeLock();
+	}
+
+	~WriteLock() {
+		_lock.unlock();
+	}
+
+private:
+	WriteLock(const WriteLock&);
+	WriteLock& operator=(const WriteLock&);
+
+	const RWLock& _lock;
+};
+
+/**
+ * Fixed set of reader/writer locks shared among objects
+ * Each object is bound to one lock (stripe) by hashing its coded identifier, so
+ * threads working on different objects rarely wait for each other while the
+ * memory used does not depend on the number of objects.
+ */
+class StripedLock {
+public:
+	static const size_t NumStripes = 64;
+
+	static size_t index(uint32_t key) {
+		// Fibonacci hashing spreads consecutive instances over all the stripes
+		return (size_t)((key * 2654435769u) >> 26) % NumStripes;
+	}
+
+	const RWLock& get(uint32_t key) const {
+		return _stripes[index(key)].lock;
+	}
+
+	const RWLock& at(size_t idx) const {
+		return _stripes[idx].lock;
+	}
+
+private:
+	// Keep each lock off the cache line of the others to avoid false sharing
+	struct Stripe {
+		RWLock lock;
+		char pad[CacheLineSize];
+	};
+
+	Stripe _stripes[NumStripes];
+};
+
+/**
+ * Hold every stripe of a StripedLock in shared mode for the life of the object
+ * The stripes are taken in index order, a thread holding one stripe must not use it.
+ */
+class StripedReadLock {
+public:
+	StripedReadLock(const StripedLock& lock) :
+		_lock(lock) {
+		for (size_t i = 0; i < StripedLock::NumStripes; i++) {
+			_lock.at(i).readLock();
+		}
+	}
+
+	~StripedReadLock() {
+		for (size_t i = StripedLock::NumStripes; i > 0; i--) {
+			_lock.at(i - 1).unlock();
+		}
+	}
+
+private:
+	StripedReadLock(const StripedReadLock&);
+	StripedReadLock& operator=(const StripedReadLock&);
+
+	const StripedLock& _lock;
+};
+
+/**
+ * Tell the CPU the thread is busy waiting
+ * Frees the core for its sibling hyper-thread and avoids the memory order flush when
+ * the wait ends.  Does nothing on the architectures without such hint.
+ */
+inline void cpuRelax() {
+#if defined(__i386__) || defined(__x86_64__)
+	__builtin_ia32_pause();
+#endif
+}
+
+/**
+ * Busy waiting lock for very short critical sections
+ * Only meant to protect a few instructions, e.g. a pointer copy, where putting the
+ * thread to sleep would cost more than spinning.  A waiter still yields its CPU after
+ * a while, the owner may have been preempted in the critical section.
+ */
+class SpinLock {
+public:
+	static const unsigned MaxSpins = 64;
+
+	SpinLock() : _flag(0) {}
+
+	void lock() const {
+		unsigned spins = 0;
+		while (__sync_lock_test_and_set(&_flag, 1)) {
+			while (_flag) {
+				// wait for the owner without hammering the cache line
+				if (++spins < MaxSpins) {
+					cpuRelax();
+				} else {
+					sched_yield();
+				}
+			}
+		}
+	}
+
+	void unlock() const {
+		__sync_lock_release(&_flag);
+	}
+
+private:
+	SpinLock(const SpinLock&);
+	SpinLock& operator=(const SpinLock&);
+
+	mutable volatile int _flag;
+};
+
+/**
+ * Hold a SpinLock for the life of the object
+ */
+class SpinLockGuard {
+public:
+	SpinLockGuard(const SpinLock& lock) :
+		_lock(lock) {
+		_lock.lock();
+	}
+
+	~SpinLockGuard() {
+		_lock.unlock();
+	}
+
+private:
+	SpinLockGuard(const SpinLockGuard&);
+	SpinLockGuard& operator=(const SpinLockGuard&);
+
+	const SpinLock& _lock;
+};
+
+/**
+ * Reference that can be read and replaced concurrently
+ * Loading takes a counted reference so the object stays alive as long as the reader
+ * uses it, even if a new one is stored in the meantime.  Only the reference copy is
+ * protected, by a SpinLock: it is short but not lock free, a load waits for a
+ * concurrent store or load of the same reference.  The previous object is released
+ * outside the lock.
+ */
+template <typename T>
+class AtomicRef {
+public:
+	AtomicRef() {}
+	AtomicRef(const FC::Ref<T>& ref) : _ref(ref) {}
+
+	FC::Ref<T> load() const {
+		SpinLockGuard guard(_lock);
+		return _ref;
+	}
+
+	void store(const FC::Ref<T>& ref) {
+		FC::Ref<T> old;
+		{
+			SpinLockGuard guard(_lock);
+			old = _ref;
+			_ref = ref;
+		}
+	}
+
+private:
+	AtomicRef(const AtomicRef&);
+	AtomicRef& operator=(const AtomicRef&);
+
+	SpinLock _lock;
+	FC::Ref<T> _ref;
+};
+
+/**
+ * Counter that can be read from any thread without lock
+ */
+class AtomicCounter {
+public:
+	AtomicCounter(uint32_t value = 0) : _value(value) {}
+
+	uint32_t get() const { return __sync_fetch_and_add(&_value, 0); }
+	uint32_t increment() { return __sync_add_and_fetch(&_value, 1); }
+	uint32_t decrement() { return __sync_sub_and_fetch(&_value, 1); }
+
+private:
+	mutable volatile uint32_t _value;
+};
+
+} // VIGBACNET
+
+#endif /* BACNETSYNC_H_ */
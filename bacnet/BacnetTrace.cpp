@@ -0,0 +1,247 @@
+/*
+ * BacnetTrace.cpp
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#include <errno.h>
+#include "BacnetTrace.h"
+#include "BacnetUtils.h"
+#include "BacnetExceptions.h"
+
+namespace VIGBACNET {
+
+namespace {
+
+const char TraceMagic[4] = { 'V', 'B', 'T', 'R' };
+const uint32_t TraceVersion = 1;
+
+/**
+ * Size of the vbag value buffer actually used
+ * The converter clears the vbag before filling it, so the buffer ends with zeros.
+ */
+size_t usedLength(const frVbag& bag) {
+	size_t len = sizeof(bag.ps);
+	const byte* ps = (const byte*)&bag.ps;
+	while (len > 0 && ps[len - 1] == 0) {
+		len--;
+	}
+	return len;
+}
+
+class TraceWriter {
+public:
+	TraceWriter(FILE* file) : _file(file), _ok(true) {}
+
+	template <typename T>
+	void put(const T& value) {
+		put(&value, sizeof(value));
+	}
+
+	void put(const void* data, size_t size) {
+		_ok = _ok && fwrite(data, 1, size, _file) == size;
+	}
+
+	void putBag(const frVbag& bag) {
+		put(bag.status);
+		put(bag.pdtype);
+		put(bag.priority);
+		put(bag.narray);
+		put(bag.pd);
+		uint16_t len = (uint16_t)usedLength(bag);
+		put(len);
+		put(&bag.ps, len);
+	}
+
+	bool ok() const { return _ok; }
+
+private:
+	FILE* _file;
+	bool _ok;
+};
+
+class TraceParser {
+public:
+	TraceParser(FILE* file) : _file(file), _ok(true) {}
+
+	template <typename T>
+	void get(T& value) {
+		get(&value, sizeof(value));
+	}
+
+	void get(void* data, size_t size) {
+		_ok = _ok && fread(data, 1, size, _file) == size;
+	}
+
+	void getBag(frVbag& bag) {
+		memset(&bag, 0, sizeof(bag));
+		get(bag.status);
+		get(bag.pdtype);
+		get(bag.priority);
+		get(bag.narray);
+		get(bag.pd);
+		uint16_t len = 0;
+		get(len);
+		_ok = _ok && len <= sizeof(bag.ps);
+		get(&bag.ps, _ok ? len : 0);
+	}
+
+	bool ok() const { return _ok; }
+
+private:
+	FILE* _file;
+	bool _ok;
+};
+
+} // local namespace
+
+FC::Mutex TraceRecorder::_mutex;
+FILE* TraceRecorder::_file = 0;
+volatile bool TraceRecorder::_recording = false;
+uint64_t TraceRecorder::_start = 0;
+uint64_t TraceRecorder::_count = 0;
+
+void TraceRecorder::start(const std::string& path) {
+	stop();
+	FC::MutexLock lock(_mutex);
+	_file = fopen(path.c_str(), "wb");
+	if (!_file) {
+		throwException(BacnetApplicationException(FC::StringAPrintf(
+				"Cannot create the trace file %s: %s", path.c_str(), strerror(errno))));
+	}
+	TraceWriter writer(_file);
+	writer.put(TraceMagic, sizeof(TraceMagic));
+	writer.put(TraceVersion);
+	_start = Clock::now();
+	_count = 0;
+	_recording = true;
+	FC_Debug1f("Recording the stack callbacks to %s", path.c_str());
+}
+
+void TraceRecorder::stop() {
+	FC::MutexLock lock(_mutex);
+	_recording = false;
+	if (_file) {
+		fclose(_file);
+		_file = 0;
+		FC_Debug1f("Recorded %llu stack callbacks", (unsigned long long)_count);
+	}
+}
+
+void TraceRecorder::write(TraceRecord& record) {
+	FC::MutexLock lock(_mutex);
+	if (!_file) {
+		return;
+	}
+	TraceWriter writer(_file);
+	writer.put((uint8_t)record.kind);
+	writer.put(record.time);
+	switch (record.kind) {
+	case TraceRecord::ReadProperty:
+	case TraceRecord::WriteProperty:
+		writer.put(record.oid);
+		writer.put(record.pid);
+		writer.put(record.aidx);
+		writer.put(record.result);
+		writer.putBag(record.bag);
+		break;
+	case TraceRecord::IAm:
+		writer.put(record.device);
+		break;
+	case TraceRecord::WhoHas: {
+		uint16_t len = (uint16_t)record.name.size();
+		writer.put(record.snet);
+		writer.put((uint8_t)record.byName);
+		writer.put(record.oid);
+		writer.put(len);
+		writer.put(record.name.data(), len);
+		break;
+	}
+	case TraceRecord::Response:
+		writer.putBag(record.bag);
+		break;
+	}
+	if (writer.ok()) {
+		_count++;
+	} else {
+		// Disk full or the like, do not slow down the stack any more
+		FC_Debug1f("Cannot write the trace, recording stopped: %s", strerror(errno));
+		_recording = false;
+		fclose(_file);
+		_file = 0;
+	}
+}
+
+TraceReader::TraceReader(const std::string& path) :
+	_file(fopen(path.c_str(), "rb")), _path(path) {
+	if (!_file) {
+		throwException(BacnetApplicationException(FC::StringAPrintf(
+				"Cannot open the trace file %s: %s", path.c_str(), strerror(errno))));
+	}
+	rewind();
+}
+
+TraceReader::~TraceReader() {
+	fclose(_file);
+}
+
+void TraceReader::rewind() {
+	::rewind(_file);
+	TraceParser parser(_file);
+	char magic[sizeof(TraceMagic)];
+	uint32_t version = 0;
+	parser.get(magic, sizeof(magic));
+	parser.get(version);
+	if (!parser.ok() || memcmp(magic, TraceMagic, sizeof(magic)) || version != TraceVersion) {
+		throwException(BacnetApplicationException(FC::StringAPrintf(
+				"%s is not a trace file of version %u", _path.c_str(), TraceVersion)));
+	}
+}
+
+bool TraceReader::next(TraceRecord& record) {
+	TraceParser parser(_file);
+	uint8_t kind = 0;
+	parser.get(kind);
+	if (!parser.ok()) {
+		return false;
+	}
+	record = TraceRecord((TraceRecord::Kind)kind);
+	parser.get(record.time);
+	switch (kind) {
+	case TraceRecord::ReadProperty:
+	case TraceRecord::WriteProperty:
+		parser.get(record.oid);
+		parser.get(record.pid);
+		parser.get(record.aidx);
+		parser.get(record.result);
+		parser.getBag(record.bag);
+		break;
+	case TraceRecord::IAm:
+		parser.get(record.device);
+		break;
+	case TraceRecord::WhoHas: {
+		uint8_t byName = 0;
+		uint16_t len = 0;
+		parser.get(record.snet);
+		parser.get(byName);
+		parser.get(record.oid);
+		parser.get(len);
+		record.byName = (byName != 0);
+		if (parser.ok()) {
+			record.name.resize(len);
+			parser.get(&record.name[0], len);
+		}
+		break;
+	}
+	case TraceRecord::Response:
+		parser.getBag(record.bag);
+		break;
+	default:
+		throwException(BacnetApplicationException(FC::StringAPrintf(
+				"Invalid record kind %u in trace %s", kind, _path.c_str())));
+	}
+	// A truncated last record, e.g. the process was killed while recording
+	return parser.ok();
+}
+
+} // VIGBACNET
@@ -0,0 +1,146 @@
+/*
+ * BacnetTrace.h
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#ifndef BacnetTrace_h
+#define BacnetTrace_h
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "fc.h"
+#include "vsbhp.h"
+#include "BacnetClock.h"
+
+namespace VIGBACNET {
+
+/**
+ * One stack callback of a trace
+ * Depending on the kind only some fields are used:
+ * - ReadProperty, WriteProperty: oid, pid, aidx, result and bag (the value read or
+ *   the value written)
+ * - IAm: device
+ * - WhoHas: snet, byName, oid and name
+ * - Response: bag
+ * {time} is the call time in nanoseconds since the trace started.
+ */
+struct TraceRecord {
+	enum Kind {
+		ReadProperty = 1,
+		WriteProperty,
+		IAm,
+		WhoHas,
+		Response,
+	};
+
+	TraceRecord(Kind k = ReadProperty) :
+		kind(k), time(0), oid(0), pid(0), aidx(0), result(0), snet(0), byName(false) {
+		memset(&bag, 0, sizeof(bag));
+		memset(&device, 0, sizeof(device));
+	}
+
+	Kind kind;
+	uint64_t time;
+	dword oid;
+	dword pid;
+	dword aidx;
+	int32_t result;
+	word snet;
+	bool byName;
+	std::string name;
+	frVbag bag;
+	frBACnetdevice device;
+};
+
+/**
+ * Record the stack callbacks to a binary trace file
+ * The record is off by default and costs a flag test per callback.  Values are
+ * written in the host byte order, a trace is meant to be replayed on the same
+ * architecture.  The unused tail of a vbag is not written, the converter clears
+ * the vbags so that keeps the trace compact.
+ */
+class TraceRecorder {
+public:
+	/**
+	 * Start recording to {path}, a trace already being recorded is closed
+	 */
+	static void start(const std::string& path);
+	static void stop();
+	static bool isRecording() { return _recording; }
+	static uint64_t getRecordCount() { return _count; }
+
+	static void write(TraceRecord& record);
+	static uint64_t now() { return Clock::now() - _start; }
+
+private:
+	static FC::Mutex _mutex;
+	static FILE* _file;
+	static volatile bool _recording;
+	static uint64_t _start;
+	static uint64_t _count;
+};
+
+/**
+ * Record a property callback when it returns
+ * The call time is taken when the scope is entered, the result and the vbag when it
+ * is left so the value read is recorded.
+ */
+class TraceScope {
+public:
+	TraceScope(TraceRecord::Kind kind, dword oid, dword pid, dword aidx, const frVbag* bag,
+			const int* result) :
+		_kind(kind), _oid(oid), _pid(pid), _aidx(aidx), _bag(bag), _result(result),
+		_time(TraceRecorder::isRecording() ? TraceRecorder::now() : 0) {
+	}
+
+	~TraceScope() {
+		if (TraceRecorder::isRecording()) {
+			TraceRecord record(_kind);
+			record.time = _time;
+			record.oid = _oid;
+			record.pid = _pid;
+			record.aidx = _aidx;
+			record.result = *_result;
+			record.bag = *_bag;
+			TraceRecorder::write(record);
+		}
+	}
+
+private:
+	TraceRecord::Kind _kind;
+	dword _oid;
+	dword _pid;
+	dword _aidx;
+	const frVbag* _bag;
+	const int* _result;
+	uint64_t _time;
+};
+
+/**
+ * Read back a trace file
+ */
+class TraceReader {
+public:
+	TraceReader(const std::string& path);
+	~TraceReader();
+
+	/**
+	 * Read the next record
+	 * return false at the end of the trace
+	 */
+	bool next(TraceRecord& record);
+	void rewind();
+
+private:
+	TraceReader(const TraceReader&);
+	TraceReader& operator=(const TraceReader&);
+
+	FILE* _file;
+	std::string _path;
+};
+
+} // VIGBACNET
+
+#endif /* BACNETTRACE_H_ */
@@ -19,12 +19,12 @@ void BacnetValue::clearModified() {
 
 void BacnetValue::valueModified() {
 	_modified = true;
-	_lastChange = time(0);
+	_lastChange = TickClock::stamp();
 }
 
 void BacnetValue::valueDirty() {
 	_dirty = true;
-	_lastDirty = time(0);
+	_lastDirty = TickClock::stamp();
 }
 
 BacnetValue& BacnetValue::operator=(const BacnetValue &value) {
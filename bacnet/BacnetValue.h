@@ -14,6 +14,8 @@
 #include "fc.h"
 #include "BacnetEnums.h"
 #include "BacnetUtils.h"
+#include "BacnetClock.h"
+#include "BacnetPool.h"
 
 namespace VIGBACNET {
 
@@ -28,16 +30,19 @@ typedef FC::Ref<BacnetValue> BacnetValueRef;
 
 class BacnetValue : public FC::RefObject , public FC::Formatter {
 public:
+	BACNET_POOL_ALLOCATED
+
 	BacnetValue() :
 		_modified(false), _dirty(false), _lastChange(0), _lastDirty(0) {};
 	virtual ~BacnetValue() {};
 
-	virtual void resetLastChanged(time_t t = 0) { _lastChange = t; };
-	virtual time_t lastChanged() const { return _lastChange; }
+	// Change times are TickClock stamps, in nanoseconds, 0 when not changed
+	virtual void resetLastChanged(uint64_t t = 0) { _lastChange = t; };
+	virtual uint64_t lastChanged() const { return _lastChange; }
 	virtual void clearModified();
 	virtual bool isModified() const { return _modified; }
-	virtual void resetLastDirty(time_t t = 0) { _lastChange = t; };
-	virtual time_t lastDirty() const { return _lastDirty; }
+	virtual void resetLastDirty(uint64_t t = 0) { _lastDirty = t; };
+	virtual uint64_t lastDirty() const { return _lastDirty; }
 	void clearDirty() { _dirty = false; }
 	bool isDirty() const { return _dirty; }
 	virtual const char* typeName() const { return DataTypeEnum::getName(type());}
@@ -49,6 +54,24 @@ public:
 	virtual DataTypeEnum type() const = 0;
 	virtual BacnetValueRef clone() const = 0;
 	virtual bool set(const BacnetValue&, bool throwError=true) = 0;
+	/**
+	 * Set the value without throwing
+	 * return the error class and code telling why the value could not be set, the
+	 * types which can reject a value of the right type override it.
+	 */
+	virtual BacnetStatus trySet(const BacnetValue& value) {
+		if (!set(value, false)) {
+			return BacnetStatus(ErrorClassEnum::Property, ErrorCodeEnum::InvalidDataType);
+		}
+		return BacnetStatus();
+	}
+
+	/**
+	 * Address of the value as the primitive class of type {id}, 0 if it is not one
+	 * BacnetValue is a virtual base so static_cast cannot go down from it, the
+	 * primitive classes give their address instead, see primitive_cast.
+	 */
+	virtual const void* primitive(DataTypeEnum::Enum id) const { return 0; }
 
 
 protected:
@@ -58,10 +81,25 @@ protected:
 
 	bool _modified;
 	bool _dirty;
-	time_t _lastChange;
-	time_t _lastDirty;
+	uint64_t _lastChange;
+	uint64_t _lastDirty;
 };
 
+/**
+ * Cast a value to its primitive class T (Real, Unsigned, CharacterString, ...)
+ * The cast needs no RTTI, it returns 0 when the type of the value is not T::TypeId.
+ * The subclasses of T, e.g. Units for Enumerated, are cast to T as well.
+ */
+template <typename T>
+const T* primitive_cast(const BacnetValue& value) {
+	return static_cast<const T*>(value.primitive(T::TypeId));
+}
+
+template <typename T>
+T* primitive_cast(BacnetValue& value) {
+	return static_cast<T*>(const_cast<void*>(value.primitive(T::TypeId)));
+}
+
 
 } // BACNET namespace
 
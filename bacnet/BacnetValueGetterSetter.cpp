@@ -24,37 +24,41 @@ BacnetErrorException getErrorTypeExcepition(const char* from, const char *to) {
 	return BacnetErrorException(ErrorClassEnum::Property, ErrorCodeEnum::InvalidDataType, os.str());
 }
 
+namespace {
+
+/**
+ * Fail a conversion, the message is only built when it is thrown
+ */
+bool typeError(const char* from, const char *to, std::string& lastError, bool throwError) {
+	if (throwError) {
+		BacnetErrorException ex = getErrorTypeExcepition(from, to);
+		lastError = ex.what();
+		throwException(ex);
+	}
+	return false;
+}
+
+} // local namespace
+
 std::string ValueGetter::lastError = "";
 std::string ValueSetter::lastError = "";
 
 bool ValueGetter::get(const BacnetValue& from, bool &to, bool throwError) {
 	if (from.type() == DataTypeEnum::Boolean) {
-		Boolean* v = dynamic_cast<Boolean*>(const_cast<BacnetValue*>(&from));
-		to = v->get();
+		to = primitive_cast<Boolean>(from)->get();
 		return true;
 	} else {
-		BacnetErrorException ex = getErrorTypeExcepition(from.typeName(), "bool");
-		lastError = ex.what();
-		if (throwError) {
-			throwException(ex);
-		}
+		return typeError(from.typeName(), "bool", lastError, throwError);
 	}
-	return false;
 }
 
 bool ValueGetter::get(const BacnetValue& from, int &to, bool throwError) {
 	if (from.type() == DataTypeEnum::Integer) {
-		Integer* v = dynamic_cast<Integer*>(const_cast<BacnetValue*>(&from));
-		to = v->get();
+		to = primitive_cast<Integer>(from)->get();
 		return true;
 	} else {
-		BacnetErrorException ex = getErrorTypeExcepition(from.typeName(), "int");
-		lastError = ex.what();
-		if (throwError) {
-			throwException(ex);
-		}
+		return typeError(from.typeName(), "int", lastError, throwError);
 	}
-	return false;
 }
 
 bool ValueGetter::get(const BacnetValue& from, long &to, bool throwError) {
@@ -68,21 +72,14 @@ bool ValueGetter::get(const BacnetValue& from, long &to, bool throwError) {
 
 bool ValueGetter::get(const BacnetValue& from, unsigned &to, bool throwError) {
 	if (from.type() == DataTypeEnum::Unsigned) {
-		Unsigned* v = dynamic_cast<Unsigned*>(const_cast<BacnetValue*>(&from));
-		to = v->get();
+		to = primitive_cast<Unsigned>(from)->get();
 		return true;
 	} else if (from.type() == DataTypeEnum::Enumerated) {
-		Enumerated* v = dynamic_cast<Enumerated*>(const_cast<BacnetValue*>(&from));
-		to = v->get();
+		to = primitive_cast<Enumerated>(from)->get();
 		return true;
 	} else {
-		BacnetErrorException ex = getErrorTypeExcepition(from.typeName(), "unsigned");
-		lastError = ex.what();
-		if (throwError) {
-			throwException(ex);
-		}
+		return typeError(from.typeName(), "unsigned", lastError, throwError);
 	}
-	return false;
 }
 
 bool ValueGetter::get(const BacnetValue& from, unsigned long &to, bool throwError) {
@@ -96,150 +93,92 @@ bool ValueGetter::get(const BacnetValue& from, unsigned long &to, bool throwErro
 
 bool ValueGetter::get(const BacnetValue& from, float& to, bool throwError) {
 	if (from.type() == DataTypeEnum::Real) {
-		Real* v = dynamic_cast<Real*>(const_cast<BacnetValue*>(&from));
-		to = v->get();
+		to = primitive_cast<Real>(from)->get();
 		return true;
 	} else {
-		BacnetErrorException ex = getErrorTypeExcepition(from.typeName(), "float");
-		lastError = ex.what();
-		if (throwError) {
-			throwException(ex);
-		}
+		return typeError(from.typeName(), "float", lastError, throwError);
 	}
-	return false;
 }
 
 bool ValueGetter::get(const BacnetValue& from, double& to, bool throwError) {
 	if (from.type() == DataTypeEnum::Double) {
-		Double* v = dynamic_cast<Double*>(const_cast<BacnetValue*>(&from));
-		to = v->get();
+		to = primitive_cast<Double>(from)->get();
 		return true;
 	} else if (from.type() == DataTypeEnum::Real) {
-		Real* v = dynamic_cast<Real*>(const_cast<BacnetValue*>(&from));
-		to = v->get();
+		to = primitive_cast<Real>(from)->get();
 		return true;
 	} else {
-		BacnetErrorException ex = getErrorTypeExcepition(from.typeName(), "double");
-		lastError = ex.what();
-		if (throwError) {
-			throwException(ex);
-		}
+		return typeError(from.typeName(), "double", lastError, throwError);
 	}
-	return false;
 }
 
 bool ValueGetter::get(const BacnetValue& from, std::string& to, bool throwError) {
 	if (from.type() == DataTypeEnum::CharacterString) {
-		CharacterString* v = dynamic_cast<CharacterString*>
-								(const_cast<BacnetValue*>(&from));
-		to = v->get();
+		to = primitive_cast<CharacterString>(from)->get();
 		return true;
 	} else {
-		BacnetErrorException ex = getErrorTypeExcepition(from.typeName(), "string");
-		lastError = ex.what();
-		if (throwError) {
-			throwException(ex);
-		}
+		return typeError(from.typeName(), "string", lastError, throwError);
 	}
-	return false;
 }
 
 bool ValueSetter::set(bool from, BacnetValue& to, bool throwError) {
 	if (to.type() == DataTypeEnum::Boolean) {
-		Boolean* v = dynamic_cast<Boolean*>(&to);
-		v->set(from);
+		primitive_cast<Boolean>(to)->set(from);
 		return true;
 	} else {
-		BacnetErrorException ex = getErrorTypeExcepition("bool", to.typeName());
-		lastError = ex.what();
-		if (throwError) {
-			throwException(ex);
-		}
+		return typeError("bool", to.typeName(), lastError, throwError);
 	}
-	return false;
 }
 
 bool ValueSetter::set(int from, BacnetValue& to, bool throwError) {
 	if (to.type() == DataTypeEnum::Integer) {
-		Integer* v = dynamic_cast<Integer*>(&to);
-		v->set(from);
+		primitive_cast<Integer>(to)->set(from);
 		return true;
 	} else {
-		BacnetErrorException ex = getErrorTypeExcepition("int", to.typeName());
-		lastError = ex.what();
-		if (throwError) {
-			throwException(ex);
-		}
+		return typeError("int", to.typeName(), lastError, throwError);
 	}
-	return false;
 }
 
 bool ValueSetter::set(unsigned from, BacnetValue& to, bool throwError) {
 	if (to.type() == DataTypeEnum::Unsigned) {
-		Unsigned* v = dynamic_cast<Unsigned*>(&to);
-		v->set(from);
+		primitive_cast<Unsigned>(to)->set(from);
 		return true;
 	} else if (to.type() == DataTypeEnum::Enumerated) {
-		Enumerated* v = dynamic_cast<Enumerated*>((&to));
-		v->set(from);
+		primitive_cast<Enumerated>(to)->set(from);
 		return true;
-	}else {
-		BacnetErrorException ex = getErrorTypeExcepition("unsigned", to.typeName());
-		lastError = ex.what();
-		if (throwError) {
-			throwException(ex);
-		}
+	} else {
+		return typeError("unsigned", to.typeName(), lastError, throwError);
 	}
-	return false;
 }
 
 bool ValueSetter::set(float from, BacnetValue& to, bool throwError) {
 	if (to.type() == DataTypeEnum::Real) {
-		Real* v = dynamic_cast<Real*>(&to);
-		v->set(from);
+		primitive_cast<Real>(to)->set(from);
 		return true;
 	} else if (to.type() == DataTypeEnum::Double) {
-		Double* v = dynamic_cast<Double*>(&to);
-		v->set(from);
+		primitive_cast<Double>(to)->set(from);
 		return true;
 	} else {
-		BacnetErrorException ex = getErrorTypeExcepition("float", to.typeName());
-		lastError = ex.what();
-		if (throwError) {
-			throwException(ex);
-		}
+		return typeError("float", to.typeName(), lastError, throwError);
 	}
-	return false;
 }
 
 bool ValueSetter::set(double from, BacnetValue& to, bool throwError) {
 	if (to.type() == DataTypeEnum::Double) {
-		Double* v = dynamic_cast<Double*>(&to);
-		v->set(from);
+		primitive_cast<Double>(to)->set(from);
 		return true;
 	} else {
-		BacnetErrorException ex = getErrorTypeExcepition("double", to.typeName());
-		lastError = ex.what();
-		if (throwError) {
-			throwException(ex);
-		}
+		return typeError("double", to.typeName(), lastError, throwError);
 	}
-	return false;
 }
 
 bool ValueSetter::set(const std::string& from, BacnetValue& to, bool throwError) {
 	if (to.type() == DataTypeEnum::CharacterString) {
-		CharacterString* v = dynamic_cast<CharacterString*>(&to);
-		v->set(from);
+		primitive_cast<CharacterString>(to)->set(from);
 		return true;
 	} else {
-		BacnetErrorException ex = getErrorTypeExcepition("string", to.typeName());
-		lastError = ex.what();
-		if (throwError) {
-			throwException(ex);
-		}
+		return typeError("string", to.typeName(), lastError, throwError);
 	}
-	return false;
 }
 
 bool ValueSetter::set(const char *from, BacnetValue& to, bool throwError) {
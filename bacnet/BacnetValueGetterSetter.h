@@ -9,6 +9,7 @@
 
 #include <type_traits>
 #include "BacnetValue.h"
+#include "BacnetAppTypes.h"
 #include "BacnetUtils.h"
 
 namespace VIGBACNET {
@@ -178,6 +179,65 @@ template <typename From, typename To>
 void toString(const From& from, To& to) {
 }
 
+/**
+ * Conversion tables between the scalar classes and the primitive type T
+ *
+ * The tables are indexed by the DataTypeEnum id of the BacnetValue, an entry converts
+ * from or to the scalar class of that id (Boolean to bool, Enumerated to unsigned,
+ * Real to float, ...) and reaches it with primitive_cast, so a conversion is one
+ * lookup and no RTTI.  The entry is 0 when the types cannot be converted.
+ */
+template <typename T>
+struct PrimitiveConverter {
+	typedef void (*Reader)(const BacnetValue&, T&);
+	typedef void (*Writer)(const T&, BacnetValue&);
+
+	static Reader reader(DataTypeEnum::Enum id) {
+		static const Reader readers[] = {
+			0,							// Null
+			&read<Boolean>,
+			&read<Unsigned>,
+			&read<Integer>,
+			&read<Real>,
+			&read<Double>,
+			0,							// OctetString
+			0,							// CharacterString
+			0,							// BitString
+			&read<Enumerated>,
+		};
+		return (size_t)id < sizeof(readers) / sizeof(readers[0]) ? readers[id] : 0;
+	}
+
+	static Writer writer(DataTypeEnum::Enum id) {
+		static const Writer writers[] = {
+			0,							// Null
+			&write<Boolean>,
+			&write<Unsigned>,
+			&write<Integer>,
+			&write<Real>,
+			&write<Double>,
+			0,							// OctetString
+			0,							// CharacterString
+			0,							// BitString
+			&write<Enumerated>,
+		};
+		return (size_t)id < sizeof(writers) / sizeof(writers[0]) ? writers[id] : 0;
+	}
+
+private:
+	template <typename V>
+	static void read(const BacnetValue& from, T& to) {
+		IsPrimitiveType<T>::castFrom(primitive_cast<V>(from)->get(), to);
+	}
+
+	template <typename V>
+	static void write(const T& from, BacnetValue& to) {
+		typename V::ValueType v = typename V::ValueType();
+		IsPrimitiveType<T>::castTo(from, v);
+		primitive_cast<V>(to)->set(v);
+	}
+};
+
 struct ValueGetter {
 	static std::string lastError;
 
@@ -199,56 +259,13 @@ struct ValueGetter {
 	template <typename T>
 	static typename std::enable_if<not std::is_base_of<BacnetValue, T>::value, bool>::type
 	cast(const BacnetValue& from, T& to, bool throwError=true) {
-		// If it is a primitive type look for a match
+		// If it is a primitive type look for the conversion of the value type
 		if (IsPrimitiveType<T>::Value) {
-			{
-				bool v;
-				if (get(from, v, false)) {
-					IsPrimitiveType<T>::castFrom(v, to);
-					return true;
-				}
-			}
-			{
-				int v;
-				if (get(from, v, false)) {
-					IsPrimitiveType<T>::castFrom(v, to);
-					return true;
-				}
-			}
-			{
-				long v;
-				if (get(from, v, false)) {
-					IsPrimitiveType<T>::castFrom(v, to);
-					return true;
-				}
-			}
-			{
-				unsigned v;
-				if (get(from, v, false)) {
-					IsPrimitiveType<T>::castFrom(v, to);
-					return true;
-				}
-			}
-			{
-				unsigned long v;
-				if (get(from, v, false)) {
-					IsPrimitiveType<T>::castFrom(v, to);
-					return true;
-				}
-			}
-			{
-				float v;
-				if (get(from, v, false)) {
-					IsPrimitiveType<T>::castFrom(v, to);
-					return true;
-				}
-			}
-			{
-				double v;
-				if (get(from, v, false)) {
-					IsPrimitiveType<T>::castFrom(v, to);
-					return true;
-				}
+			typename PrimitiveConverter<T>::Reader read =
+					PrimitiveConverter<T>::reader(from.type().get());
+			if (read) {
+				read(from, to);
+				return true;
 			}
 		}
 		if (IsString<T>::Value) {
@@ -258,12 +275,14 @@ struct ValueGetter {
 			toString(from, to);
 			return true;
 		}
-		std::ostringstream oss;
-		oss << "type error: expected " << FC::Demangler(typeid(to).name()) << " but got " <<
-				FC::Demangler(typeid(from).name());
-		lastError = oss.str();
-		throwException(BacnetErrorException(ErrorClassEnum::Property,
-				ErrorCodeEnum::InvalidDataType, oss.str()));
+		if (throwError) {
+			std::ostringstream oss;
+			oss << "type error: expected " << FC::Demangler(typeid(to).name()) << " but got " <<
+					FC::Demangler(typeid(from).name());
+			lastError = oss.str();
+			throwException(BacnetErrorException(ErrorClassEnum::Property,
+					ErrorCodeEnum::InvalidDataType, oss.str()));
+		}
 		return false;
 	}
 };
@@ -288,42 +307,13 @@ struct ValueSetter {
 	template <typename T>
 	static typename std::enable_if<not std::is_base_of<BacnetValue, T>::value, bool>::type
 	cast(const T& from, BacnetValue& to, bool throwError=true) {
-		// If it is a primitive type look for a match
+		// If it is a primitive type look for the conversion of the value type
 		if (IsPrimitiveType<T>::Value) {
-			{
-				bool v;
-				IsPrimitiveType<T>::castTo(from, v);
-				if (set(v, to, false)) {
-					return true;
-				}
-			}
-			{
-				int v;
-				IsPrimitiveType<T>::castTo(from, v);
-				if (set(v, to, false)) {
-					return true;
-				}
-			}
-			{
-				unsigned v;
-				IsPrimitiveType<T>::castTo(from, v);
-				if (set(v, to, false)) {
-					return true;
-				}
-			}
-			{
-				float v;
-				IsPrimitiveType<T>::castTo(from, v);
-				if (set(v, to, false)) {
-					return true;
-				}
-			}
-			{
-				double v;
-				IsPrimitiveType<T>::castTo(from, v);
-				if (set(v, to, false)) {
-					return true;
-				}
+			typename PrimitiveConverter<T>::Writer write =
+					PrimitiveConverter<T>::writer(to.type().get());
+			if (write) {
+				write(from, to);
+				return true;
 			}
 		}
 		if (IsString<T>::Value) {
@@ -331,12 +321,14 @@ struct ValueSetter {
 				return true;
 			}
 		}
-		std::ostringstream oss;
-		oss << "type error: expected " << FC::Demangler(typeid(to).name()) << " but got " <<
-				FC::Demangler(typeid(from).name());
-		lastError = oss.str();
-		throwException(BacnetErrorException(ErrorClassEnum::Property,
-				ErrorCodeEnum::InvalidDataType, oss.str()));
+		if (throwError) {
+			std::ostringstream oss;
+			oss << "type error: expected " << FC::Demangler(typeid(to).name()) << " but got " <<
+					FC::Demangler(typeid(from).name());
+			lastError = oss.str();
+			throwException(BacnetErrorException(ErrorClassEnum::Property,
+					ErrorCodeEnum::InvalidDataType, oss.str()));
+		}
 		return false;
 	}
 };
@@ -157,4 +157,131 @@ BacnetValueRef VsbConverter::fromVbag(const frVbag& bag) {
 	return ref;
 }
 
+bool VsbConverter::toVbag(const CompactValue& val, frVbag& bag) {
+	memset(&bag, 0, sizeof(frVbag));
+	bag.pdtype = (byte)val.type().get();
+	switch (val._kind) {
+	case CompactValue::NullKind:
+		break;
+	case CompactValue::BooleanKind:
+		bag.pd.uval = val._data.b ? 1 : 0;
+		break;
+	case CompactValue::UnsignedKind:
+	case CompactValue::EnumeratedKind:
+	case CompactValue::ObjectIdKind:
+		bag.pd.uval = val._data.u;
+		break;
+	case CompactValue::IntegerKind:
+	case CompactValue::RealKind:
+	case CompactValue::DoubleKind:
+		memcpy(&bag.pd, &val._data, val._kind == CompactValue::DoubleKind ? 8 : 4);
+		break;
+	case CompactValue::DateKind: {
+		// Same encoding as Date::encode
+		uint8_t* pd = (uint8_t*)&bag.pd;
+		int year = val._data.date.year;
+		pd[0] = (uint8_t)(year == Date::Unspecified ? Date::Unspecified : year - 1900);
+		pd[1] = val._data.date.month;
+		pd[2] = val._data.date.day;
+		pd[3] = val._data.date.wday;
+		break;
+	}
+	case CompactValue::TimeKind:
+		memcpy(&bag.pd, &val._data.time, sizeof(val._data.time));
+		break;
+	case CompactValue::OctetStringKind:
+	case CompactValue::BitStringKind:
+		if (val._data.blob->size > sizeof(bag.ps)) {
+			return false;
+		}
+		bag.pd.uval = val._length;
+		memcpy(&bag.ps, val._data.blob->data, val._data.blob->size);
+		break;
+	case CompactValue::CharacterStringKind:
+		if (val._data.blob->size > sizeof(bag.ps.psval)) {
+			return false;
+		}
+		bag.pd.stval.charset = val._charset;
+		bag.pd.stval.len = val._length;
+		memcpy(bag.ps.psval, val._data.blob->data, val._data.blob->size);
+		break;
+	case CompactValue::BoxedKind:
+		return toVbag(*val._data.box->value, bag);
+	default:
+		bag.pdtype = 0;
+		return false;
+	}
+	return true;
+}
+
+bool VsbConverter::fromVbag(const frVbag& bag, CompactValue& val) {
+	val.clear();
+	switch (bag.pdtype) {
+	case adtNull:
+		val._kind = CompactValue::NullKind;
+		break;
+	case adtBoolean:
+		val._kind = CompactValue::BooleanKind;
+		val._data.b = (bag.pd.uval != 0);
+		break;
+	case adtUnsigned:
+		val._kind = CompactValue::UnsignedKind;
+		val._data.u = bag.pd.uval;
+		break;
+	case adtEnumerated:
+		val._kind = CompactValue::EnumeratedKind;
+		val._data.u = bag.pd.uval;
+		break;
+	case adtObjectID:
+		val._kind = CompactValue::ObjectIdKind;
+		val._data.u = bag.pd.uval;
+		break;
+	case adtInteger:
+		val._kind = CompactValue::IntegerKind;
+		val._data.i = (int32_t)bag.pd.sval;
+		break;
+	case adtReal:
+		val._kind = CompactValue::RealKind;
+		val._data.f = bag.pd.fval;
+		break;
+	case adtDouble:
+		val._kind = CompactValue::DoubleKind;
+		val._data.d = bag.pd.dval;
+		break;
+	case adtDate: {
+		// Same decoding as Date::decode, the year is left as sent
+		const uint8_t* pd = (const uint8_t*)&bag.pd;
+		val._kind = CompactValue::DateKind;
+		val._data.date.year = pd[0];
+		val._data.date.month = pd[1];
+		val._data.date.day = pd[2];
+		val._data.date.wday = pd[3];
+		break;
+	}
+	case adtTime:
+		val._kind = CompactValue::TimeKind;
+		memcpy(&val._data.time, &bag.pd, sizeof(val._data.time));
+		break;
+	case adtOctetString:
+		val.setBlob(CompactValue::OctetStringKind, (const uint8_t*)&bag.ps,
+				std::min((size_t)bag.pd.uval, sizeof(bag.ps)), bag.pd.uval);
+		break;
+	case adtBitString:
+		val.setBlob(CompactValue::BitStringKind, (const uint8_t*)&bag.ps,
+				std::min((size_t)(bag.pd.uval + 7) / 8, sizeof(bag.ps)), bag.pd.uval);
+		break;
+	case adtCharString:
+		val.setBlob(CompactValue::CharacterStringKind, (const uint8_t*)&bag.ps,
+				std::min((size_t)bag.pd.stval.len, sizeof(bag.ps)), bag.pd.stval.len);
+		break;
+	case adtError:
+		val.setBox(Error(ErrorClassEnum::Enum((bag.pd.errval >> 8) & 0xFF),
+				ErrorCodeEnum::Enum(bag.pd.errval & 0xFF)));
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
 } // VIGBACNET
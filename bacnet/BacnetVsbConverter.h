@@ -9,6 +9,7 @@
 
 #include "BacnetServer.h"
 #include "BacnetUtils.h"
+#include "BacnetCompactValue.h"
 #include "vsbhp.h"
 
 namespace VIGBACNET {
@@ -101,6 +102,11 @@ public:
 				((uint16_t)error.getCode()() & 0xFF));
 	}
 
+	static uint16_t toError(const BacnetStatus& status) {
+		return (uint16_t)(((uint16_t)status.eClass() << 8) +
+				((uint16_t)status.eCode()() & 0xFF));
+	}
+
 	static Error fromError(uint16_t err) {
 		return Error((ErrorClassEnum::Enum)(err >> 8),
 				(ErrorCodeEnum::Enum)(err & 0xFF));
@@ -111,6 +117,11 @@ public:
 	static bool toVbag(const BacnetValue& val, frVbag& bag);
 	static BacnetValueRef fromVbag(const frVbag& bag);
 
+	/// Same conversions for compact values, without class instance for the
+	/// primitive types.  fromVbag returns false if the vbag type is not supported.
+	static bool toVbag(const CompactValue& val, frVbag& bag);
+	static bool fromVbag(const frVbag& bag, CompactValue& val);
+
 };
 
 
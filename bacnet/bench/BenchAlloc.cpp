@@ -0,0 +1,60 @@
+/*
+ * BenchAlloc.cpp
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#include <stdlib.h>
+#include <malloc.h>
+#include <new>
+#include "BenchUtil.h"
+
+namespace VIGBACNET {
+
+volatile uint64_t AllocStats::allocations = 0;
+volatile uint64_t AllocStats::frees = 0;
+volatile int64_t AllocStats::liveBytes = 0;
+
+} // VIGBACNET
+
+using namespace VIGBACNET;
+
+/// Count every allocation of the benchmark programs
+
+namespace {
+
+void* countedAlloc(size_t size) {
+	void* p = malloc(size ? size : 1);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	__sync_fetch_and_add(&AllocStats::allocations, 1);
+	__sync_fetch_and_add(&AllocStats::liveBytes, (int64_t)malloc_usable_size(p));
+	return p;
+}
+
+void countedFree(void* p) {
+	if (p) {
+		__sync_fetch_and_add(&AllocStats::frees, 1);
+		__sync_fetch_and_sub(&AllocStats::liveBytes, (int64_t)malloc_usable_size(p));
+		free(p);
+	}
+}
+
+} // local namespace
+
+void* operator new(size_t size) {
+	return countedAlloc(size);
+}
+
+void* operator new[](size_t size) {
+	return countedAlloc(size);
+}
+
+void operator delete(void* p) throw() {
+	countedFree(p);
+}
+
+void operator delete[](void* p) throw() {
+	countedFree(p);
+}
@@ -0,0 +1,130 @@
+/*
+ * BenchUtil.h
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#ifndef BenchUtil_h
+#define BenchUtil_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include <sstream>
+#include "BacnetStats.h"
+
+namespace VIGBACNET {
+
+/**
+ * Counters of the global operator new/delete, see BenchAlloc.cpp
+ * {liveBytes} is the memory currently allocated, using the allocator usable size.
+ */
+struct AllocStats {
+	static volatile uint64_t allocations;
+	static volatile uint64_t frees;
+	static volatile int64_t liveBytes;
+};
+
+/**
+ * Allocations made since the scope was created
+ */
+class AllocScope {
+public:
+	AllocScope() :
+		_allocations(AllocStats::allocations), _liveBytes(AllocStats::liveBytes) {
+	}
+
+	uint64_t allocations() const { return AllocStats::allocations - _allocations; }
+	int64_t liveBytes() const { return AllocStats::liveBytes - _liveBytes; }
+
+private:
+	uint64_t _allocations;
+	int64_t _liveBytes;
+};
+
+/**
+ * One benchmark result written as a single JSON object per line
+ * e.g. {"bench": "incoming_read", "objects": 1000, "ops_per_sec": 1.2e+06}
+ */
+class BenchResult {
+public:
+	BenchResult(const std::string& bench) {
+		_oss << "{\"bench\": \"" << bench << "\"";
+	}
+
+	template <typename T>
+	BenchResult& add(const char* key, const T& value) {
+		_oss << ", \"" << key << "\": " << value;
+		return *this;
+	}
+
+	BenchResult& add(const char* key, const std::string& value) {
+		_oss << ", \"" << key << "\": \"" << value << "\"";
+		return *this;
+	}
+
+	BenchResult& addLatency(const StatHistogram& histogram) {
+		return add("p50_ns", histogram.percentile(50)).
+				add("p99_ns", histogram.percentile(99)).
+				add("p999_ns", histogram.percentile(99.9));
+	}
+
+	void write(FILE* out) {
+		fprintf(out, "%s}\n", _oss.str().c_str());
+		fflush(out);
+	}
+
+private:
+	std::ostringstream _oss;
+};
+
+/**
+ * Tell if a benchmark started at {start} ran for {seconds}
+ */
+inline bool elapsed(uint64_t start, double seconds) {
+	return Clock::now() - start >= (uint64_t)(seconds * 1e9);
+}
+
+inline double rate(uint64_t ops, uint64_t durationNs) {
+	return durationNs ? ops * 1e9 / durationNs : 0.0;
+}
+
+struct BenchThreadStart {
+	void (*body)(void*, unsigned);
+	void* arg;
+	unsigned index;
+	pthread_barrier_t* barrier;
+};
+
+inline void* benchThreadMain(void* p) {
+	BenchThreadStart& start = *(BenchThreadStart*)p;
+	pthread_barrier_wait(start.barrier);
+	start.body(start.arg, start.index);
+	return 0;
+}
+
+/**
+ * Call {body}({arg}, index) on {count} threads and wait for all of them
+ * The threads wait for each other before calling {body} so their runs overlap.
+ */
+inline void runThreads(unsigned count, void (*body)(void*, unsigned), void* arg) {
+	std::vector<pthread_t> threads(count);
+	std::vector<BenchThreadStart> starts(count);
+	pthread_barrier_t barrier;
+	pthread_barrier_init(&barrier, 0, count);
+	for (unsigned i = 0; i < count; i++) {
+		BenchThreadStart start = { body, arg, i, &barrier };
+		starts[i] = start;
+		pthread_create(&threads[i], 0, benchThreadMain, &starts[i]);
+	}
+	for (unsigned i = 0; i < count; i++) {
+		pthread_join(threads[i], 0);
+	}
+	pthread_barrier_destroy(&barrier);
+}
+
+} // VIGBACNET
+
+#endif /* BENCHUTIL_H_ */
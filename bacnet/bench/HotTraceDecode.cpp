@@ -0,0 +1,31 @@
+/*
+ * HotTraceDecode.cpp
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+/**
+ * Print a hot path trace written by HotTrace::dump, one event per line
+ *
+ * usage: HotTraceDecode TRACE
+ */
+
+#include <stdio.h>
+#include "BacnetLog.h"
+
+using namespace VIGBACNET;
+
+int main(int argc, char** argv) {
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s TRACE\n", argv[0]);
+		return 1;
+	}
+	try {
+		size_t count = HotTrace::decode(argv[1], stdout);
+		fprintf(stderr, "Decoded %zu events\n", count);
+	} catch (FC::Exception& ex) {
+		fprintf(stderr, "Cannot decode: %s\n", ex.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,775 @@
+/*
+ * ServerBench.cpp
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+/**
+ * End to end throughput of the BACnet server against the simulated stack
+ *
+ * The server thread is not started, the benchmark drives the stack itself so the
+ * results do not depend on the work timer rate.  It measures:
+ * - incoming ReadProperty served by fraReadProperty for 1k, 10k and 100k objects
+ * - incoming ReadProperty of unknown properties and objects, like a scanner probing
+ * - local reads on 4 threads while a writer thread sets values and the stack thread
+ *   serves remote reads, through getProperty/setProperty and a PointHandle
+ * - incoming WriteProperty followed by ReadProperty of the written values
+ * - incoming WriteProperty answered later by completeWrite, when built with
+ *   VSB_DEFERRED_RESPONSE=1, one in four completed with an error
+ * - outgoing sendReadProperty completions for 10 to 5000 remote devices, then one
+ *   read per device checking the decoded value
+ * - outgoing requests lost by the network, completed by the stack timeout
+ * - the memory used per local object and per outstanding transaction
+ * - transaction create, response lookup and delete on 8 threads for 1 to 8 shards,
+ *   the map operations alone without the stack
+ * - the counters of the pools when built with BACNET_POOL=1
+ * Each result is written as one JSON object per line so runs can be compared.  The
+ * runs also check their results: a failed check is reported on stderr and the exit
+ * status is 1.
+ *
+ * usage: ServerBench [--seconds S] [--latency-us L] [--window W] [--out FILE] [--quick]
+ *                    [--hot-points] [--hot-trace FILE] [--spans FILE] [--span-sampling N]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "BacnetServer.h"
+#include "BacnetLog.h"
+#include "VsbSim.h"
+#include "BenchUtil.h"
+
+using namespace VIGBACNET;
+
+namespace {
+
+const ObjectInstance ServerInstance = 4000001;
+const ObjectInstance FirstRemoteInstance = 1000;
+
+unsigned failedChecks = 0;
+
+/**
+ * Count a failed result check, the benchmark then exits with an error
+ */
+void check(bool ok, const char* bench, const char* what) {
+	if (!ok) {
+		fprintf(stderr, "%s: %s\n", bench, what);
+		failedChecks++;
+	}
+}
+
+struct BenchSettings {
+	BenchSettings() :
+		seconds(2.0), latencyUsec(0), window(64), quick(false), hotPoints(false), spanSampling(1), out(stdout) {
+	}
+
+	double seconds;
+	uint32_t latencyUsec;
+	unsigned window;
+	bool quick;
+	bool hotPoints;
+	std::string hotTrace;
+	std::string spans;
+	uint32_t spanSampling;
+	FILE* out;
+};
+
+void usage(const char* prog) {
+	fprintf(stderr, "usage: %s [--seconds S] [--latency-us L] [--window W] [--out FILE] [--quick]"
+			" [--hot-points] [--hot-trace FILE] [--spans FILE] [--span-sampling N]\n", prog);
+	exit(1);
+}
+
+void parseArgs(int argc, char** argv, BenchSettings& settings) {
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = (i + 1 < argc);
+		if (!strcmp(argv[i], "--seconds") && hasValue) {
+			settings.seconds = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "--latency-us") && hasValue) {
+			settings.latencyUsec = (uint32_t)atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--window") && hasValue) {
+			settings.window = (unsigned)atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--out") && hasValue) {
+			settings.out = fopen(argv[++i], "w");
+			if (!settings.out) {
+				perror(argv[i]);
+				exit(1);
+			}
+		} else if (!strcmp(argv[i], "--quick")) {
+			settings.quick = true;
+		} else if (!strcmp(argv[i], "--hot-points")) {
+			settings.hotPoints = true;
+		} else if (!strcmp(argv[i], "--hot-trace") && hasValue) {
+			settings.hotTrace = argv[++i];
+		} else if (!strcmp(argv[i], "--spans") && hasValue) {
+			settings.spans = argv[++i];
+		} else if (!strcmp(argv[i], "--span-sampling") && hasValue) {
+			settings.spanSampling = (uint32_t)atoi(argv[++i]);
+		} else {
+			usage(argv[0]);
+		}
+	}
+	if (!settings.window) {
+		settings.window = 1;
+	}
+}
+
+/**
+ * Grow the local database up to {count} analog values
+ * return the live bytes added per object
+ */
+double growObjects(Server& server, size_t& current, size_t count) {
+	AllocScope scope;
+	size_t added = 0;
+	for (; current < count; current++, added++) {
+		ObjectRef obj = Object::create(ObjectTypeEnum::AnalogValue, (ObjectInstance)current + 1);
+		server.addObject(*obj);
+	}
+	// Build the snapshot now, it is part of the cost of an object
+	server.snapshot();
+	return added ? (double)scope.liveBytes() / added : 0.0;
+}
+
+/**
+ * Serve ReadProperty requests for random local objects like the stack would
+ */
+void benchIncoming(const BenchSettings& settings, size_t objects, double bytesPerObject) {
+	StatHistogram latency;
+	frVbag bag;
+	dword nextPid;
+	uint64_t ops = 0;
+	uint64_t errors = 0;
+	unsigned seed = 1;
+	AllocScope scope;
+	uint64_t start = Clock::now();
+	while (!elapsed(start, settings.seconds)) {
+		// Check the clock every batch so it does not dominate the measure
+		for (int i = 0; i < 256; i++) {
+			ObjectInstance instance = (ObjectInstance)(rand_r(&seed) % objects) + 1;
+			dword oid = ObjectIdentifier(ObjectTypeEnum::AnalogValue, instance).getCoded();
+			uint64_t t0 = Clock::now();
+			int result = fraReadProperty(oid, PropertyIdentifierEnum::PresentValue,
+					ReadPropertyRequest::NoIndex, &bag, &nextPid);
+			latency.record(Clock::now() - t0);
+			if (result != 0) {
+				errors++;
+			}
+			ops++;
+		}
+	}
+	uint64_t duration = Clock::now() - start;
+	BenchResult("incoming_read").
+			add("objects", objects).
+			add("hot_points", settings.hotPoints ? "true" : "false").
+			add("ops", ops).
+			add("errors", errors).
+			add("ops_per_sec", rate(ops, duration)).
+			addLatency(latency).
+			add("allocs_per_op", ops ? (double)scope.allocations() / ops : 0.0).
+			add("bytes_per_object", bytesPerObject).
+			write(settings.out);
+	check(errors == 0, "incoming_read", "a read of an existing object failed");
+}
+
+/**
+ * Serve ReadProperty requests that fail, half for a property analog values do not
+ * have and half for objects that do not exist
+ */
+void benchIncomingMisses(const BenchSettings& settings, size_t objects) {
+	StatHistogram latency;
+	frVbag bag;
+	dword nextPid;
+	uint64_t ops = 0;
+	uint64_t errors = 0;
+	unsigned seed = 1;
+	AllocScope scope;
+	uint64_t start = Clock::now();
+	while (!elapsed(start, settings.seconds)) {
+		for (int i = 0; i < 256; i++) {
+			ObjectInstance instance = (ObjectInstance)(rand_r(&seed) % objects) + 1;
+			PropertyIdentifierEnum::Enum pid = PropertyIdentifierEnum::VendorName;
+			if (i & 1) {
+				instance += (ObjectInstance)objects;
+				pid = PropertyIdentifierEnum::PresentValue;
+			}
+			dword oid = ObjectIdentifier(ObjectTypeEnum::AnalogValue, instance).getCoded();
+			uint64_t t0 = Clock::now();
+			int result = fraReadProperty(oid, pid, ReadPropertyRequest::NoIndex, &bag, &nextPid);
+			latency.record(Clock::now() - t0);
+			if (result != 0) {
+				errors++;
+			}
+			ops++;
+		}
+	}
+	uint64_t duration = Clock::now() - start;
+	BenchResult("incoming_read_miss").
+			add("objects", objects).
+			add("ops", ops).
+			add("errors", errors).
+			add("ops_per_sec", rate(ops, duration)).
+			addLatency(latency).
+			add("allocs_per_op", ops ? (double)scope.allocations() / ops : 0.0).
+			write(settings.out);
+	check(errors == ops, "incoming_read_miss", "a read of a missing property succeeded");
+}
+
+struct ConcurrentRun {
+	Server* server;
+	size_t objects;
+	double seconds;
+	volatile uint64_t reads;
+	volatile uint64_t writes;
+	volatile uint64_t served;
+	volatile uint64_t errors;
+};
+
+/**
+ * Thread 0 is the stack thread, thread 1 the writer and the others the readers
+ */
+void concurrentWorker(void* arg, unsigned index) {
+	ConcurrentRun& run = *(ConcurrentRun*)arg;
+	PointHandle<Real> handle = run.server->getPointHandle<Real>(
+			ObjectIdentifier(ObjectTypeEnum::AnalogValue, 1), PropertyIdentifierEnum::PresentValue);
+	std::vector<SimRequestRef> requests;
+	unsigned seed = index + 1;
+	uint64_t ops = 0;
+	uint64_t errors = 0;
+	uint64_t start = Clock::now();
+	while (!elapsed(start, run.seconds)) {
+		for (int i = 0; i < 64; i++) {
+			ObjectInstance instance = (ObjectInstance)(rand_r(&seed) % run.objects) + 1;
+			ObjectIdentifier oid(ObjectTypeEnum::AnalogValue, instance);
+			bool ok = true;
+			if (index == 0) {
+				requests.push_back(StackSimulator::instance().injectRead(oid.getCoded(),
+						PropertyIdentifierEnum::PresentValue));
+			} else if (index == 1) {
+				ok = (i & 1) ? handle.set(Real((float)ops)) :
+						run.server->setProperty(oid, PropertyIdentifierEnum::PresentValue,
+								(float)ops, false);
+			} else if (i & 1) {
+				Real value;
+				ok = handle.get(value);
+			} else {
+				float value;
+				ok = run.server->getProperty(oid, PropertyIdentifierEnum::PresentValue, value, false);
+			}
+			if (!ok) {
+				errors++;
+			}
+			ops++;
+		}
+		for (size_t i = 0; i < requests.size(); i++) {
+			while (!requests[i]->done) {
+				frMain();
+			}
+			if (requests[i]->result != 0) {
+				errors++;
+			}
+		}
+		requests.clear();
+	}
+	__sync_fetch_and_add(index == 0 ? &run.served : (index == 1 ? &run.writes : &run.reads), ops);
+	__sync_fetch_and_add(&run.errors, errors);
+}
+
+void benchConcurrent(const BenchSettings& settings, Server& server, size_t objects) {
+	const unsigned readers = 4;
+	ConcurrentRun run = { &server, objects, settings.seconds, 0, 0, 0, 0 };
+	uint64_t start = Clock::now();
+	runThreads(readers + 2, concurrentWorker, &run);
+	uint64_t duration = Clock::now() - start;
+	BenchResult("concurrent_local").
+			add("objects", objects).
+			add("readers", readers).
+			add("errors", run.errors).
+			add("reads_per_sec", rate(run.reads, duration)).
+			add("writes_per_sec", rate(run.writes, duration)).
+			add("stack_reads_per_sec", rate(run.served, duration)).
+			write(settings.out);
+	check(run.errors == 0, "concurrent_local", "a local or remote access failed");
+}
+
+/**
+ * Write the present value of {window} objects from the simulated network, then read
+ * them back both remotely and locally
+ */
+void benchWriteRead(const BenchSettings& settings, Server& server, size_t objects) {
+	StackSimulator& sim = StackSimulator::instance();
+	size_t window = settings.window < objects ? settings.window : objects;
+	std::vector<SimRequestRef> writes;
+	std::vector<SimRequestRef> reads;
+	uint64_t ops = 0;
+	uint64_t mismatches = 0;
+	size_t next = 0;
+	uint64_t start = Clock::now();
+	while (!elapsed(start, settings.seconds)) {
+		// Distinct objects in a window so each read expects the value written last
+		for (size_t i = 0; i < window; i++) {
+			ObjectInstance instance = (ObjectInstance)((next + i) % objects) + 1;
+			dword oid = ObjectIdentifier(ObjectTypeEnum::AnalogValue, instance).getCoded();
+			writes.push_back(sim.injectWrite(oid, PropertyIdentifierEnum::PresentValue,
+					Real((float)(ops + i)), 8));
+		}
+		for (size_t i = 0; i < writes.size(); i++) {
+			while (!writes[i]->done) {
+				frMain();
+			}
+			if (writes[i]->result != 0) {
+				mismatches++;
+			}
+			reads.push_back(sim.injectRead(writes[i]->oid, PropertyIdentifierEnum::PresentValue));
+		}
+		for (size_t i = 0; i < reads.size(); i++) {
+			while (!reads[i]->done) {
+				frMain();
+			}
+			float expected = (float)(ops + i);
+			float remote = -1;
+			float local = -1;
+			if (reads[i]->result != 0 || !reads[i]->reply ||
+					!ValueGetter::cast(*reads[i]->reply, remote, false) || remote != expected) {
+				mismatches++;
+			}
+			server.getProperty(ObjectIdentifier(reads[i]->oid), PropertyIdentifierEnum::PresentValue,
+					local, false);
+			if (local != expected) {
+				mismatches++;
+			}
+		}
+		ops += writes.size();
+		next = (next + window) % objects;
+		writes.clear();
+		reads.clear();
+	}
+	uint64_t duration = Clock::now() - start;
+	BenchResult("write_read").
+			add("objects", objects).
+			add("window", window).
+			add("ops", ops).
+			add("mismatches", mismatches).
+			add("ops_per_sec", rate(ops, duration)).
+			write(settings.out);
+	check(ops > 0 && mismatches == 0, "write_read", "a value read back differs from the one written");
+}
+
+#ifdef VSB_DEFERRED_RESPONSE
+/**
+ * Inject remote writes that the server defers, then complete them like the
+ * application would on DeferredWriteEvent and let the stack send the answers
+ */
+void benchDeferredWrites(const BenchSettings& settings, Server& server, size_t objects) {
+	StackSimulator& sim = StackSimulator::instance();
+	Error rejected(ErrorClassEnum::Property, ErrorCodeEnum::WriteAccessDenied);
+	std::vector<SimRequestRef> requests;
+	StatHistogram latency;
+	unsigned seed = 1;
+	uint64_t ops = 0;
+	uint64_t errors = 0;
+	uint64_t mismatches = 0;
+	server.setDeferredWrites(true);
+	AllocScope scope;
+	uint64_t start = Clock::now();
+	while (!elapsed(start, settings.seconds)) {
+		for (unsigned i = 0; i < settings.window; i++) {
+			ObjectInstance instance = (ObjectInstance)(rand_r(&seed) % objects) + 1;
+			dword oid = ObjectIdentifier(ObjectTypeEnum::AnalogValue, instance).getCoded();
+			requests.push_back(sim.injectWrite(oid, PropertyIdentifierEnum::PresentValue,
+					Real((float)i), 8));
+		}
+		for (size_t i = 0; i < requests.size(); i++) {
+			SimRequest& request = *requests[i];
+			while (!request.done && !request.deferred) {
+				frMain();
+			}
+			if (!request.deferred) {
+				mismatches++;
+				continue;
+			}
+			uint64_t t0 = Clock::now();
+			if (!server.completeWrite(request.token, (i & 3) ? 0 : &rejected)) {
+				mismatches++;
+			}
+			latency.record(Clock::now() - t0);
+			// A rejected write must be answered with its error, the others with a SimpleACK
+			if (!request.done || ((request.result != 0) != !(i & 3))) {
+				mismatches++;
+			}
+			if (request.result != 0) {
+				errors++;
+			}
+			ops++;
+		}
+		requests.clear();
+	}
+	uint64_t duration = Clock::now() - start;
+	server.setDeferredWrites(false);
+	BenchResult("deferred_write").
+			add("objects", objects).
+			add("window", settings.window).
+			add("ops", ops).
+			add("errors", errors).
+			add("mismatches", mismatches).
+			add("pending", server.getPendingWriteCount()).
+			add("ops_per_sec", rate(ops, duration)).
+			addLatency(latency).
+			add("allocs_per_op", ops ? (double)scope.allocations() / ops : 0.0).
+			write(settings.out);
+	check(mismatches == 0 && server.getPendingWriteCount() == 0, "deferred_write",
+			"a deferred write was not answered as completed");
+}
+#endif
+
+/**
+ * Add simulated remote devices up to {count}, each with one analog value
+ * The present value is the device instance, so a response can be checked.
+ */
+void growDevices(size_t& current, size_t count) {
+	StackSimulator& sim = StackSimulator::instance();
+	for (; current < count; current++) {
+		ObjectInstance instance = FirstRemoteInstance + (ObjectInstance)current;
+		DeviceRef device = sim.addDevice(instance);
+		ObjectIdentifier oid(ObjectTypeEnum::AnalogValue, 1);
+		device->addObject(*Object::create(oid.getType(), oid.getInstance()));
+		device->setObjectProperty(oid, PropertyIdentifierEnum::PresentValue, (float)instance);
+	}
+}
+
+struct Outstanding {
+	Transaction::IdType id;
+	uint64_t sent;
+};
+
+/**
+ * Keep {window} read requests in flight over all the remote devices
+ */
+void benchOutgoing(const BenchSettings& settings, Server& server, size_t devices) {
+	ReadPropertyRequest request(ObjectIdentifier(ObjectTypeEnum::AnalogValue, 1),
+			PropertyIdentifierEnum::PresentValue);
+	std::vector<Outstanding> outstanding;
+	outstanding.reserve(settings.window);
+	StatHistogram latency;
+	uint64_t completed = 0;
+	uint64_t errors = 0;
+	size_t next = 0;
+	uint64_t start = Clock::now();
+	bool sending = true;
+	while (sending || !outstanding.empty()) {
+		sending = !elapsed(start, settings.seconds);
+		while (sending && outstanding.size() < settings.window) {
+			Outstanding o;
+			o.sent = Clock::now();
+			o.id = server.sendReadProperty(FirstRemoteInstance + (ObjectInstance)next, request);
+			outstanding.push_back(o);
+			next = (next + 1) % devices;
+		}
+		frMain();
+		uint64_t now = Clock::now();
+		for (size_t i = 0; i < outstanding.size();) {
+			Transaction::State state = server.getTransactionState(outstanding[i].id);
+			if (state == Transaction::Complete || state == Transaction::Dead) {
+				latency.record(now - outstanding[i].sent);
+				if (state == Transaction::Dead || server.isTransactionError(outstanding[i].id)) {
+					errors++;
+				}
+				server.deleteTransaction(outstanding[i].id);
+				outstanding[i] = outstanding.back();
+				outstanding.pop_back();
+				completed++;
+			} else {
+				i++;
+			}
+		}
+	}
+	uint64_t duration = Clock::now() - start;
+	BenchResult("outgoing_read").
+			add("devices", devices).
+			add("window", settings.window).
+			add("latency_us", settings.latencyUsec).
+			add("completed", completed).
+			add("errors", errors).
+			add("ops_per_sec", rate(completed, duration)).
+			addLatency(latency).
+			write(settings.out);
+	check(errors == 0, "outgoing_read", "a read of a remote device failed");
+}
+
+/**
+ * Read every remote device once and check the value decoded from its response
+ */
+void checkOutgoingValues(const BenchSettings& settings, Server& server, size_t devices) {
+	ReadPropertyRequest request(ObjectIdentifier(ObjectTypeEnum::AnalogValue, 1),
+			PropertyIdentifierEnum::PresentValue);
+	std::vector<Transaction::IdType> ids;
+	ids.reserve(devices);
+	uint64_t mismatches = 0;
+	for (size_t i = 0; i < devices; i++) {
+		ids.push_back(server.sendReadProperty(FirstRemoteInstance + (ObjectInstance)i, request));
+	}
+	while (StackSimulator::instance().getInFlightCount()) {
+		frMain();
+	}
+	for (size_t i = 0; i < ids.size(); i++) {
+		BacnetValueRef value;
+		if (server.getTransactionState(ids[i]) == Transaction::Complete &&
+				!server.isTransactionError(ids[i])) {
+			value = server.getTransactionValue(ids[i]);
+		}
+		float decoded = -1;
+		if (!value || !ValueGetter::cast(*value, decoded, false) ||
+				decoded != (float)(FirstRemoteInstance + i)) {
+			mismatches++;
+		}
+		server.deleteTransaction(ids[i]);
+	}
+	BenchResult("outgoing_read_check").
+			add("devices", devices).
+			add("mismatches", mismatches).
+			write(settings.out);
+	check(mismatches == 0, "outgoing_read_check", "a decoded response differs from the device value");
+}
+
+/**
+ * Send requests the network loses and let the stack time them out
+ * Every transaction must complete with a timeout error, counted in the server and
+ * the remote device statistics.
+ */
+void benchTimeouts(const BenchSettings& settings, Server& server, const SimSettings& base) {
+	const size_t count = 100;
+	const ObjectInstance device = FirstRemoteInstance;
+	StackSimulator& sim = StackSimulator::instance();
+	SimSettings lossy = base;
+	lossy.lossRate = 1.0;
+	lossy.timeoutMsec = 10;
+	sim.configure(lossy);
+	ServerStatsSnapshot statsBefore;
+	server.getStats(statsBefore);
+	RemoteDeviceStatsSnapshot remoteBefore;
+	server.getRemoteStats(device, remoteBefore);
+
+	ReadPropertyRequest request(ObjectIdentifier(ObjectTypeEnum::AnalogValue, 1),
+			PropertyIdentifierEnum::PresentValue);
+	std::vector<Transaction::IdType> ids;
+	for (size_t i = 0; i < count; i++) {
+		ids.push_back(server.sendReadProperty(device, request));
+	}
+	uint64_t start = Clock::now();
+	while (sim.getInFlightCount()) {
+		frMain();
+	}
+	uint64_t duration = Clock::now() - start;
+	uint64_t timedOut = 0;
+	for (size_t i = 0; i < ids.size(); i++) {
+		if (server.getTransactionState(ids[i]) == Transaction::Complete &&
+				server.isTransactionError(ids[i])) {
+			timedOut++;
+		}
+		server.deleteTransaction(ids[i]);
+	}
+	sim.configure(base);
+
+	ServerStatsSnapshot statsAfter;
+	server.getStats(statsAfter);
+	RemoteDeviceStatsSnapshot remoteAfter;
+	server.getRemoteStats(device, remoteAfter);
+	uint64_t counted = statsAfter.timeouts - statsBefore.timeouts;
+	uint64_t remoteCounted = remoteAfter.timeouts - remoteBefore.timeouts;
+	BenchResult("transaction_timeout").
+			add("transactions", count).
+			add("timeout_ms", lossy.timeoutMsec).
+			add("timed_out", timedOut).
+			add("server_timeouts", counted).
+			add("device_timeouts", remoteCounted).
+			add("duration_ms", (double)duration / 1000000).
+			write(settings.out);
+	check(timedOut == count && counted == count && remoteCounted == count, "transaction_timeout",
+			"a lost request did not end as a counted timeout");
+}
+
+/**
+ * Memory held by {count} transactions waiting for their response
+ */
+void benchTransactionMemory(const BenchSettings& settings, Server& server, size_t devices) {
+	const size_t count = 1000;
+	ReadPropertyRequest request(ObjectIdentifier(ObjectTypeEnum::AnalogValue, 1),
+			PropertyIdentifierEnum::PresentValue);
+	std::vector<Transaction::IdType> ids;
+	ids.reserve(count);
+	AllocScope scope;
+	for (size_t i = 0; i < count; i++) {
+		ids.push_back(server.sendReadProperty(FirstRemoteInstance + (ObjectInstance)(i % devices),
+				request));
+	}
+	double bytesPerTransaction = (double)scope.liveBytes() / count;
+	double allocsPerTransaction = (double)scope.allocations() / count;
+	// Let the responses arrive before deleting, the stack owns the vbags until then
+	while (StackSimulator::instance().getInFlightCount()) {
+		frMain();
+	}
+	for (size_t i = 0; i < ids.size(); i++) {
+		server.deleteTransaction(ids[i]);
+	}
+	BenchResult("transaction_memory").
+			add("transactions", count).
+			add("bytes_per_transaction", bytesPerTransaction).
+			add("allocs_per_transaction", allocsPerTransaction).
+			write(settings.out);
+}
+
+struct ShardRun {
+	TransactionShards* shards;
+	double seconds;
+	volatile uint64_t ops;
+};
+
+void shardWorker(void* arg, unsigned index) {
+	ShardRun& run = *(ShardRun*)arg;
+	ObjectInstance device = FirstRemoteInstance + (ObjectInstance)index;
+	ConfirmedServiceChoiceEnum service(ConfirmedServiceChoiceEnum::ReadProperty);
+	uint64_t ops = 0;
+	uint64_t start = Clock::now();
+	while (!elapsed(start, run.seconds)) {
+		for (int i = 0; i < 256; i++) {
+			TransactionRef trans = run.shards->createTransaction(device, service);
+			// Find it back from its vbag like fraResponse, then by id like the application
+			unsigned shard = 0;
+			ServerManager::getTransactionServer(*trans->vbag(), &shard);
+			run.shards->getTransaction(*trans->vbag(), shard);
+			run.shards->getTransaction(trans->transId());
+			run.shards->deleteTransaction(trans);
+			ops++;
+		}
+	}
+	__sync_fetch_and_add(&run.ops, ops);
+}
+
+/**
+ * Transaction life cycles on 8 application threads, each one sending to its own
+ * remote device, with 1 to 8 transaction shards
+ * Only the transaction map operations are timed, nothing goes through the stack.
+ * They measure the application side contention, not the request throughput, which
+ * the stack mutex held by doWork keeps the same whatever the shard count.
+ */
+void benchShardScaling(const BenchSettings& settings, Server& server) {
+	static const unsigned ShardCounts[] = { 1, 2, 4, 8 };
+	const unsigned threads = 8;
+	for (size_t i = 0; i < sizeof(ShardCounts) / sizeof(ShardCounts[0]); i++) {
+		FC::Ref<TransactionShards> shards = new TransactionShards(&server, ShardCounts[i]);
+		ShardRun run = { shards.get(), settings.seconds, 0 };
+		uint64_t start = Clock::now();
+		runThreads(threads, shardWorker, &run);
+		uint64_t duration = Clock::now() - start;
+		BenchResult("transaction_shards").
+				add("shards", ShardCounts[i]).
+				add("threads", threads).
+				add("ops", run.ops).
+				add("ops_per_sec", rate(run.ops, duration)).
+				write(settings.out);
+	}
+}
+
+/**
+ * Counters of the size class pools at the end of the runs
+ */
+void writePoolStats(const BenchSettings& settings) {
+	if (!Pool::isEnabled()) {
+		return;
+	}
+	std::vector<Pool::Stats> stats;
+	Pool::getStats(stats);
+	for (size_t i = 0; i < stats.size(); i++) {
+		BenchResult("pool").
+				add("block_size", stats[i].blockSize).
+				add("live", stats[i].live).
+				add("live_bytes", stats[i].liveBytes).
+				add("allocations", stats[i].allocations).
+				add("reserved_bytes", stats[i].reservedBytes).
+				write(settings.out);
+	}
+}
+
+} // local namespace
+
+int main(int argc, char** argv) {
+	BenchSettings settings;
+	parseArgs(argc, argv, settings);
+
+	SimSettings sim;
+	sim.latencyUsec = settings.latencyUsec;
+	StackSimulator::instance().configure(sim);
+
+	PropertiesSetter props = defaultPropertiesSetter;
+	props.deviceInstance = ServerInstance;
+	// Decode the responses inline, the benchmark thread is the stack thread
+	props.ackWorkers = 0;
+	ServerRef server = ServerManager::createServer(props);
+	if (!server) {
+		fprintf(stderr, "Cannot create the server\n");
+		return 1;
+	}
+	// Nobody consumes the events, do not let them pile up
+	server->setEventFilter(new EventFilter(0));
+	// Compare with and without to measure the counters overhead
+	server->enableHotPoints(settings.hotPoints);
+	// Also an overhead to compare, the ring keeps the last events of the run
+	if (!settings.hotTrace.empty()) {
+		HotTrace::enable();
+	}
+	if (!settings.spans.empty()) {
+		SpanRecorder::enable(settings.spanSampling);
+	}
+	frStartup(portBIP);
+
+	try {
+		static const size_t ObjectCounts[] = { 1000, 10000, 100000 };
+		size_t objectRuns = settings.quick ? 2 : 3;
+		size_t objects = 0;
+		for (size_t i = 0; i < objectRuns; i++) {
+			double bytesPerObject = growObjects(*server, objects, ObjectCounts[i]);
+			benchIncoming(settings, objects, bytesPerObject);
+		}
+		benchIncomingMisses(settings, objects);
+		benchConcurrent(settings, *server, objects);
+		benchWriteRead(settings, *server, objects);
+#ifdef VSB_DEFERRED_RESPONSE
+		benchDeferredWrites(settings, *server, objects);
+#endif
+
+		static const size_t DeviceCounts[] = { 10, 100, 1000, 5000 };
+		size_t deviceRuns = settings.quick ? 2 : 4;
+		size_t devices = 0;
+		for (size_t i = 0; i < deviceRuns; i++) {
+			growDevices(devices, DeviceCounts[i]);
+			benchOutgoing(settings, *server, devices);
+		}
+		checkOutgoingValues(settings, *server, devices);
+		benchTimeouts(settings, *server, sim);
+		benchTransactionMemory(settings, *server, devices);
+		benchShardScaling(settings, *server);
+		writePoolStats(settings);
+	} catch (FC::Exception& ex) {
+		fprintf(stderr, "Benchmark failed: %s\n", ex.what());
+		frStop(portBIP);
+		return 1;
+	}
+
+	frStop(portBIP);
+	ServerManager::deleteServer(ServerInstance);
+	if (!settings.hotTrace.empty()) {
+		HotTrace::disable();
+		HotTrace::dump(settings.hotTrace);
+	}
+	if (!settings.spans.empty()) {
+		SpanRecorder::disable();
+		SpanRecorder::dumpChromeTrace(settings.spans);
+	}
+	if (settings.out != stdout) {
+		fclose(settings.out);
+	}
+	if (failedChecks) {
+		fprintf(stderr, "%u result checks failed\n", failedChecks);
+		return 1;
+	}
+	return 0;
+}
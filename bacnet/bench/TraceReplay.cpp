@@ -0,0 +1,233 @@
+/*
+ * TraceReplay.cpp
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+/**
+ * Replay a stack callback trace against a server on the simulated stack
+ *
+ * The trace is recorded with TraceRecorder on a production server.  The local objects
+ * read or written in the trace are created first, then the property requests are sent
+ * by the simulated stack and the I-Am and Who-Has are delivered as they were recorded.
+ * Responses are counted but not replayed, the transactions they answered do not
+ * exist in the replaying process.  With --realtime the records are replayed at the
+ * recorded pace, otherwise as fast as the server serves them.  The summary is written
+ * as one JSON object, including the requests whose result differs from the trace.
+ *
+ * usage: TraceReplay [--realtime] [--out FILE] TRACE
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <set>
+#include <vector>
+#include "BacnetServer.h"
+#include "BacnetTrace.h"
+#include "BacnetVsbConverter.h"
+#include "VsbSim.h"
+#include "BenchUtil.h"
+
+using namespace VIGBACNET;
+
+namespace {
+
+struct ReplaySettings {
+	ReplaySettings() :
+		realtime(false), out(stdout) {
+	}
+
+	bool realtime;
+	std::string trace;
+	FILE* out;
+};
+
+void usage(const char* prog) {
+	fprintf(stderr, "usage: %s [--realtime] [--out FILE] TRACE\n", prog);
+	exit(1);
+}
+
+void parseArgs(int argc, char** argv, ReplaySettings& settings) {
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--realtime")) {
+			settings.realtime = true;
+		} else if (!strcmp(argv[i], "--out") && i + 1 < argc) {
+			settings.out = fopen(argv[++i], "w");
+			if (!settings.out) {
+				perror(argv[i]);
+				exit(1);
+			}
+		} else if (argv[i][0] != '-' && settings.trace.empty()) {
+			settings.trace = argv[i];
+		} else {
+			usage(argv[0]);
+		}
+	}
+	if (settings.trace.empty()) {
+		usage(argv[0]);
+	}
+}
+
+/**
+ * Create the server with every local object the trace refers to
+ * The server instance is the one of the device object read in the trace, if any.
+ */
+ServerRef createServer(TraceReader& reader) {
+	std::set<dword> oids;
+	ObjectInstance instance = defaultPropertiesSetter.deviceInstance;
+	TraceRecord record;
+	while (reader.next(record)) {
+		if (record.kind == TraceRecord::ReadProperty || record.kind == TraceRecord::WriteProperty) {
+			ObjectIdentifier oid(record.oid);
+			if (oid.getType() == ObjectTypeEnum::Device) {
+				instance = oid.getInstance();
+			} else {
+				oids.insert(record.oid);
+			}
+		}
+	}
+	reader.rewind();
+
+	PropertiesSetter props = defaultPropertiesSetter;
+	props.deviceInstance = instance;
+	props.ackWorkers = 0;
+	ServerRef server = ServerManager::createServer(props);
+	if (!server) {
+		return 0;
+	}
+	server->setEventFilter(new EventFilter(0));
+	size_t skipped = 0;
+	for (auto it = oids.begin(); it != oids.end(); it++) {
+		ObjectIdentifier oid(*it);
+		try {
+			server->addObject(*Object::create(oid.getType(), oid.getInstance()));
+		} catch (BacnetException&) {
+			// Not supported by this build, its requests will report a mismatch
+			skipped++;
+		}
+	}
+	fprintf(stderr, "Created %zu objects, %zu not supported\n", oids.size() - skipped, skipped);
+	return server;
+}
+
+void waitUntil(uint64_t due) {
+	uint64_t now = Clock::now();
+	if (due > now) {
+		struct timespec ts;
+		ts.tv_sec = (time_t)((due - now) / 1000000000ull);
+		ts.tv_nsec = (long)((due - now) % 1000000000ull);
+		nanosleep(&ts, 0);
+	}
+}
+
+struct Replayed {
+	SimRequestRef request;
+	int32_t expected;
+};
+
+} // local namespace
+
+int main(int argc, char** argv) {
+	ReplaySettings settings;
+	parseArgs(argc, argv, settings);
+
+	uint64_t records = 0;
+	uint64_t requests = 0;
+	uint64_t unconfirmed = 0;
+	uint64_t responses = 0;
+	uint64_t skipped = 0;
+	uint64_t mismatches = 0;
+	uint64_t traceDuration = 0;
+	uint64_t start = 0;
+	try {
+		TraceReader reader(settings.trace);
+		ServerRef server = createServer(reader);
+		if (!server) {
+			fprintf(stderr, "Cannot create the server\n");
+			return 1;
+		}
+		StackSimulator& sim = StackSimulator::instance();
+		frStartup(portBIP);
+
+		std::vector<Replayed> replayed;
+		TraceRecord record;
+		start = Clock::now();
+		while (reader.next(record)) {
+			records++;
+			traceDuration = record.time;
+			if (settings.realtime) {
+				waitUntil(start + record.time);
+			}
+			Replayed r;
+			r.expected = record.result;
+			switch (record.kind) {
+			case TraceRecord::ReadProperty:
+				r.request = sim.injectRead(record.oid, record.pid, record.aidx);
+				break;
+			case TraceRecord::WriteProperty: {
+				BacnetValueRef value = VsbConverter::fromVbag(record.bag);
+				if (value) {
+					r.request = sim.injectWrite(record.oid, record.pid, *value,
+							record.bag.priority, record.aidx);
+				} else {
+					skipped++;
+				}
+				break;
+			}
+			case TraceRecord::IAm:
+				fraIAm(&record.device);
+				unconfirmed++;
+				break;
+			case TraceRecord::WhoHas: {
+				VsbString name;
+				VsbConverter::toString(CharacterString(record.name), name);
+				fraWhoHas(record.snet, record.byName, record.oid, (frString*)&name);
+				unconfirmed++;
+				break;
+			}
+			case TraceRecord::Response:
+				responses++;
+				break;
+			}
+			if (r.request) {
+				replayed.push_back(r);
+				requests++;
+			}
+			frMain();
+		}
+		// Requests are served in order, wait for the last one
+		while (!replayed.empty() && !replayed.back().request->done) {
+			frMain();
+		}
+		for (size_t i = 0; i < replayed.size(); i++) {
+			if (replayed[i].request->result != replayed[i].expected) {
+				mismatches++;
+			}
+		}
+		frStop(portBIP);
+		ServerManager::deleteServer(server->getInstance());
+	} catch (FC::Exception& ex) {
+		fprintf(stderr, "Replay failed: %s\n", ex.what());
+		return 1;
+	}
+	uint64_t duration = Clock::now() - start;
+
+	BenchResult("trace_replay").
+			add("trace", settings.trace).
+			add("realtime", settings.realtime ? "true" : "false").
+			add("records", records).
+			add("requests", requests).
+			add("unconfirmed", unconfirmed).
+			add("responses_skipped", responses).
+			add("writes_skipped", skipped).
+			add("result_mismatches", mismatches).
+			add("trace_duration_ns", traceDuration).
+			add("replay_duration_ns", duration).
+			add("requests_per_sec", rate(requests, duration)).
+			write(settings.out);
+	if (settings.out != stdout) {
+		fclose(settings.out);
+	}
+	return 0;
+}
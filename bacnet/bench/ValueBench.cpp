@@ -0,0 +1,498 @@
+/*
+ * ValueBench.cpp
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+/**
+ * Microbenchmarks of the value types on the request path
+ *
+ * Each operation is timed over batches and the global allocations made meanwhile are
+ * counted, see BenchAlloc.cpp.  The results are written one JSON object per line
+ * with the time and the allocations per operation.
+ *
+ * The read_ack cases compare the two ways of answering a ReadProperty from a published
+ * object version, the response_decode cases the two ways of decoding a response.
+ * The cross_thread case allocates values on one thread and deletes them on another,
+ * to compare the pools (make BACNET_POOL=1) with the default allocator on the way the
+ * stack and server threads share them, and checks nothing stays allocated.
+ *
+ * usage: ValueBench [--seconds S] [--out FILE] [--filter NAME]
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "BacnetValueGetterSetter.h"
+#include "BacnetVsbConverter.h"
+#include "BacnetSnapshot.h"
+#include "BacnetConfirmedServicesAck.h"
+#include "BacnetQueue.h"
+#include "BacnetPool.h"
+#include "BenchUtil.h"
+
+using namespace VIGBACNET;
+
+namespace {
+
+struct BenchSettings {
+	BenchSettings() :
+		seconds(0.5), out(stdout) {
+	}
+
+	double seconds;
+	std::string filter;
+	FILE* out;
+};
+
+BenchSettings settings;
+
+// Keep the results alive so the compiler does not drop the operations
+volatile uint64_t sink;
+
+void usage(const char* prog) {
+	fprintf(stderr, "usage: %s [--seconds S] [--out FILE] [--filter NAME]\n", prog);
+	exit(1);
+}
+
+void parseArgs(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = (i + 1 < argc);
+		if (!strcmp(argv[i], "--seconds") && hasValue) {
+			settings.seconds = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "--filter") && hasValue) {
+			settings.filter = argv[++i];
+		} else if (!strcmp(argv[i], "--out") && hasValue) {
+			settings.out = fopen(argv[++i], "w");
+			if (!settings.out) {
+				perror(argv[i]);
+				exit(1);
+			}
+		} else {
+			usage(argv[0]);
+		}
+	}
+}
+
+/**
+ * Run {op} in batches for the configured time and write its cost
+ * {op} returns a value folded in the sink.
+ */
+template <typename OP>
+void run(const char* name, OP op) {
+	const unsigned Batch = 1024;
+	if (!settings.filter.empty() && !strstr(name, settings.filter.c_str())) {
+		return;
+	}
+	// Warm up, e.g. the lazily built tables and the allocator caches
+	for (unsigned i = 0; i < Batch; i++) {
+		sink += op();
+	}
+	uint64_t ops = 0;
+	AllocScope scope;
+	uint64_t start = Clock::now();
+	while (!elapsed(start, settings.seconds)) {
+		for (unsigned i = 0; i < Batch; i++) {
+			sink += op();
+		}
+		ops += Batch;
+	}
+	uint64_t duration = Clock::now() - start;
+	BenchResult("value").
+			add("op", std::string(name)).
+			add("ops", ops).
+			add("ns_per_op", ops ? (double)duration / ops : 0.0).
+			add("allocs_per_op", ops ? (double)scope.allocations() / ops : 0.0).
+			write(settings.out);
+}
+
+void benchConstruction() {
+	run("construct_real", [] () -> uint64_t {
+		Real v(21.5f);
+		return v.get() > 0;
+	});
+	run("construct_unsigned", [] () -> uint64_t {
+		Unsigned v(42);
+		return v.get();
+	});
+	run("construct_enum", [] () -> uint64_t {
+		Units v(UnitsEnum::DegreesCelsius);
+		return v.get();
+	});
+	run("construct_charstring", [] () -> uint64_t {
+		CharacterString v("Zone temperature");
+		return v.length();
+	});
+	run("construct_bitstring", [] () -> uint64_t {
+		BitString v(16);
+		return v.length();
+	});
+}
+
+void benchClone() {
+	static Real real(21.5f);
+	static Unsigned uns(42);
+	static Units units(UnitsEnum::DegreesCelsius);
+	static CharacterString str("Zone temperature");
+	static StatusFlags flags;
+	run("clone_real", [] () -> uint64_t {
+		return real.clone().get() != 0;
+	});
+	run("clone_unsigned", [] () -> uint64_t {
+		return uns.clone().get() != 0;
+	});
+	run("clone_enum", [] () -> uint64_t {
+		return units.clone().get() != 0;
+	});
+	run("clone_charstring", [] () -> uint64_t {
+		return str.clone().get() != 0;
+	});
+	run("clone_statusflags", [] () -> uint64_t {
+		return flags.clone().get() != 0;
+	});
+}
+
+void benchSet() {
+	static Real real;
+	static Real realFrom(21.5f);
+	static Unsigned uns;
+	static Unsigned unsFrom(42);
+	static Units units;
+	static Units unitsFrom(UnitsEnum::DegreesFahrenheit);
+	static CharacterString str;
+	static CharacterString strFrom("Zone temperature");
+	static BitString bits(16);
+	static BitString bitsFrom(16, true);
+	run("set_real_from_real", [] () -> uint64_t {
+		return real.set(realFrom, false);
+	});
+	run("set_real_from_unsigned", [] () -> uint64_t {
+		return real.set(unsFrom, false);
+	});
+	run("set_unsigned_from_unsigned", [] () -> uint64_t {
+		return uns.set(unsFrom, false);
+	});
+	run("set_enum_from_enum", [] () -> uint64_t {
+		return units.set(unitsFrom, false);
+	});
+	run("set_charstring_from_charstring", [] () -> uint64_t {
+		return str.set(strFrom, false);
+	});
+	run("set_bitstring_from_bitstring", [] () -> uint64_t {
+		return bits.set(bitsFrom, false);
+	});
+}
+
+void benchCast() {
+	static Real real(21.5f);
+	static Unsigned uns(42);
+	static Units units(UnitsEnum::DegreesCelsius);
+	static CharacterString str("Zone temperature");
+	run("cast_real_to_float", [] () -> uint64_t {
+		float v = 0;
+		ValueGetter::cast(real, v, false);
+		return v > 0;
+	});
+	run("cast_real_to_int", [] () -> uint64_t {
+		int v = 0;
+		ValueGetter::cast(real, v, false);
+		return v;
+	});
+	run("cast_unsigned_to_double", [] () -> uint64_t {
+		double v = 0;
+		ValueGetter::cast(uns, v, false);
+		return v > 0;
+	});
+	run("cast_enum_to_unsigned", [] () -> uint64_t {
+		unsigned v = 0;
+		ValueGetter::cast(units, v, false);
+		return v;
+	});
+	run("cast_charstring_to_string", [] () -> uint64_t {
+		std::string v;
+		ValueGetter::cast(str, v, false);
+		return v.size();
+	});
+	run("cast_charstring_to_float_mismatch", [] () -> uint64_t {
+		float v = 0;
+		return ValueGetter::cast(str, v, false);
+	});
+}
+
+/**
+ * ValueSetter conversions, the way Object::setProperty writes an application value
+ */
+void benchSetterCast() {
+	static Real real;
+	static Double dbl;
+	static Units units;
+	static CharacterString str;
+	static Unsigned uns;
+	static Unsigned unsFrom(62);
+	static Integer integer;
+	static Boolean boolean;
+	static BinaryPV binary;
+	static Real realFrom(21.5f);
+	static std::string name("Zone temperature");
+	run("setter_float_to_real", [] () -> uint64_t {
+		return ValueSetter::cast(21.5f, real, false);
+	});
+	run("setter_double_to_real", [] () -> uint64_t {
+		return ValueSetter::cast(21.5, real, false);
+	});
+	run("setter_int_to_double", [] () -> uint64_t {
+		return ValueSetter::cast(42, dbl, false);
+	});
+	run("setter_int_to_integer", [] () -> uint64_t {
+		return ValueSetter::cast(-42, integer, false);
+	});
+	run("setter_unsigned_to_unsigned", [] () -> uint64_t {
+		return ValueSetter::cast(42u, uns, false);
+	});
+	run("setter_unsigned_to_enum", [] () -> uint64_t {
+		return ValueSetter::cast(62u, units, false);
+	});
+	run("setter_bool_to_boolean", [] () -> uint64_t {
+		return ValueSetter::cast(true, boolean, false);
+	});
+	run("setter_bool_to_binarypv", [] () -> uint64_t {
+		return ValueSetter::cast(true, binary, false);
+	});
+	run("setter_string_to_charstring", [] () -> uint64_t {
+		return ValueSetter::cast(name, str, false);
+	});
+	run("setter_value_to_real", [] () -> uint64_t {
+		return ValueSetter::cast(realFrom, real, false);
+	});
+	run("setter_float_to_charstring_mismatch", [] () -> uint64_t {
+		return ValueSetter::cast(21.5f, str, false);
+	});
+	run("set_enum_from_unsigned", [] () -> uint64_t {
+		return units.set(unsFrom, false);
+	});
+}
+
+void benchEnum() {
+	run("enum_is_valid", [] () -> uint64_t {
+		return UnitsEnum::isValid(UnitsEnum::DegreesCelsius);
+	});
+	run("enum_from_name", [] () -> uint64_t {
+		PropertyIdentifierEnum::Enum pid;
+		return PropertyIdentifierEnum::fromName("Present Value", pid) ? pid : 0;
+	});
+}
+
+void benchVbag() {
+	static Real real(21.5f);
+	static Unsigned uns(42);
+	static Units units(UnitsEnum::DegreesCelsius);
+	static CharacterString str("Zone temperature");
+	static StatusFlags flags;
+	static frVbag bag;
+	run("vbag_real", [] () -> uint64_t {
+		VsbConverter::toVbag(real, bag);
+		return VsbConverter::fromVbag(bag).get() != 0;
+	});
+	run("vbag_unsigned", [] () -> uint64_t {
+		VsbConverter::toVbag(uns, bag);
+		return VsbConverter::fromVbag(bag).get() != 0;
+	});
+	run("vbag_enum", [] () -> uint64_t {
+		VsbConverter::toVbag(units, bag);
+		return VsbConverter::fromVbag(bag).get() != 0;
+	});
+	run("vbag_charstring", [] () -> uint64_t {
+		VsbConverter::toVbag(str, bag);
+		return VsbConverter::fromVbag(bag).get() != 0;
+	});
+	run("vbag_statusflags", [] () -> uint64_t {
+		VsbConverter::toVbag(flags, bag);
+		return VsbConverter::fromVbag(bag).get() != 0;
+	});
+}
+
+void benchVbagCompact() {
+	static CompactValue real((Real(21.5f)));
+	static CompactValue uns((Unsigned(42)));
+	static CompactValue units((Units(UnitsEnum::DegreesCelsius)));
+	static CompactValue str((CharacterString("Zone temperature")));
+	static CompactValue flags((StatusFlags()));
+	static CompactValue decoded;
+	static frVbag bag;
+	run("vbag_compact_real", [] () -> uint64_t {
+		VsbConverter::toVbag(real, bag);
+		return VsbConverter::fromVbag(bag, decoded);
+	});
+	run("vbag_compact_unsigned", [] () -> uint64_t {
+		VsbConverter::toVbag(uns, bag);
+		return VsbConverter::fromVbag(bag, decoded);
+	});
+	run("vbag_compact_enum", [] () -> uint64_t {
+		VsbConverter::toVbag(units, bag);
+		return VsbConverter::fromVbag(bag, decoded);
+	});
+	run("vbag_compact_charstring", [] () -> uint64_t {
+		VsbConverter::toVbag(str, bag);
+		return VsbConverter::fromVbag(bag, decoded);
+	});
+	run("vbag_compact_statusflags", [] () -> uint64_t {
+		VsbConverter::toVbag(flags, bag);
+		return VsbConverter::fromVbag(bag, decoded);
+	});
+}
+
+/**
+ * Answer a ReadProperty from a published object version into the stack vbag
+ * This is the path fraReadProperty used before encoding the compact value directly:
+ * a value of the property type converted from the version, then copied into an ack.
+ */
+uint64_t readAck(const CompactObject& obj, PropertyIdentifierEnum pid, frVbag& bag) {
+	BacnetValueRef value = ObjectProperties::getBacnetValue(obj.getOid().getType(), pid, false);
+	if (!obj.tryGetProperty(pid, *value).ok()) {
+		return 0;
+	}
+	ReadPropertyAckRef ack = new ReadPropertyAck(obj.getOid(), pid, *value);
+	return VsbConverter::toVbag(*(ack->value()), bag);
+}
+
+void benchReadPath() {
+	static CompactObject obj(*Object::create(ObjectTypeEnum::AnalogValue, 1, "Zone temperature"));
+	static frVbag bag;
+	run("read_ack_class_real", [] () -> uint64_t {
+		return readAck(obj, PropertyIdentifierEnum::PresentValue, bag);
+	});
+	run("read_ack_compact_real", [] () -> uint64_t {
+		return VsbConverter::toVbag(*obj.findProperty(PropertyIdentifierEnum::PresentValue), bag);
+	});
+	run("read_ack_class_enum", [] () -> uint64_t {
+		return readAck(obj, PropertyIdentifierEnum::Units, bag);
+	});
+	run("read_ack_compact_enum", [] () -> uint64_t {
+		return VsbConverter::toVbag(*obj.findProperty(PropertyIdentifierEnum::Units), bag);
+	});
+	run("read_ack_class_charstring", [] () -> uint64_t {
+		return readAck(obj, PropertyIdentifierEnum::ObjectName, bag);
+	});
+	run("read_ack_compact_charstring", [] () -> uint64_t {
+		return VsbConverter::toVbag(*obj.findProperty(PropertyIdentifierEnum::ObjectName), bag);
+	});
+	// Decoding a read response into the value of its ack, like Server::handleReadAck
+	static Real ackValue;
+	static frVbag response;
+	VsbConverter::toVbag(Real(21.5f), response);
+	run("response_decode_class_real", [] () -> uint64_t {
+		BacnetValueRef value = VsbConverter::fromVbag(response);
+		return ackValue.set(*value, false);
+	});
+	run("response_decode_compact_real", [] () -> uint64_t {
+		CompactValue value;
+		VsbConverter::fromVbag(response, value);
+		return value.assignTo(ackValue, false);
+	});
+}
+
+struct CrossThreadRun {
+	BoundedQueue<BacnetValue*>* queue;
+	double seconds;
+	volatile bool producing;
+	volatile uint64_t freed;
+};
+
+/**
+ * Thread 0 allocates values and hands them to thread 1 which deletes them
+ */
+void crossThreadWorker(void* arg, unsigned index) {
+	CrossThreadRun& run = *(CrossThreadRun*)arg;
+	if (index == 0) {
+		uint64_t start = Clock::now();
+		while (!elapsed(start, run.seconds)) {
+			for (int i = 0; i < 256; i++) {
+				BacnetValue* value = new Real((float)i);
+				while (!run.queue->push(value)) {
+					sched_yield();
+				}
+			}
+		}
+		__sync_synchronize();
+		run.producing = false;
+		return;
+	}
+	BacnetValue* value;
+	uint64_t freed = 0;
+	for (;;) {
+		if (run.queue->pop(value)) {
+			delete value;
+			freed++;
+		} else if (run.producing) {
+			sched_yield();
+		} else {
+			// The last values were queued before the flag was cleared
+			while (run.queue->pop(value)) {
+				delete value;
+				freed++;
+			}
+			break;
+		}
+	}
+	run.freed = freed;
+}
+
+int64_t poolLiveBlocks() {
+	std::vector<Pool::Stats> stats;
+	Pool::getStats(stats);
+	int64_t live = 0;
+	for (size_t i = 0; i < stats.size(); i++) {
+		if (stats[i].blockSize) {
+			live += (int64_t)stats[i].live;
+		}
+	}
+	return live;
+}
+
+void benchCrossThread() {
+	const char* name = "cross_thread_real";
+	if (!settings.filter.empty() && !strstr(name, settings.filter.c_str())) {
+		return;
+	}
+	BoundedQueue<BacnetValue*> queue(1024);
+	CrossThreadRun run = { &queue, settings.seconds, true, 0 };
+	int64_t poolLive = poolLiveBlocks();
+	AllocScope scope;
+	uint64_t start = Clock::now();
+	runThreads(2, crossThreadWorker, &run);
+	uint64_t duration = Clock::now() - start;
+	BenchResult("value").
+			add("op", std::string(name)).
+			add("pool", Pool::isEnabled() ? "true" : "false").
+			add("ops", run.freed).
+			add("ns_per_op", run.freed ? (double)duration / run.freed : 0.0).
+			add("allocs_per_op", run.freed ? (double)scope.allocations() / run.freed : 0.0).
+			add("live_bytes", scope.liveBytes()).
+			add("pool_live_blocks", poolLiveBlocks() - poolLive).
+			write(settings.out);
+}
+
+} // local namespace
+
+int main(int argc, char** argv) {
+	parseArgs(argc, argv);
+	try {
+		benchConstruction();
+		benchClone();
+		benchSet();
+		benchCast();
+		benchSetterCast();
+		benchEnum();
+		benchVbag();
+		benchVbagCompact();
+		benchReadPath();
+		benchCrossThread();
+	} catch (FC::Exception& ex) {
+		fprintf(stderr, "Benchmark failed: %s\n", ex.what());
+		return 1;
+	}
+	if (settings.out != stdout) {
+		fclose(settings.out);
+	}
+	return 0;
+}
@@ -0,0 +1,383 @@
+/*
+ * VsbSim.cpp
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "VsbSim.h"
+#include "BacnetVsbConverter.h"
+
+namespace VIGBACNET {
+
+StackSimulator& StackSimulator::instance() {
+	static StackSimulator simulator;
+	return simulator;
+}
+
+StackSimulator::StackSimulator() :
+	_random(1), _started(false), _nextToken(0), _currentToken(0), _sent(0), _lost(0),
+	_timeouts(0), _iHaves(0) {
+}
+
+void StackSimulator::configure(const SimSettings& settings) {
+	FC::MutexLock lock(_mutex);
+	_settings = settings;
+	_random = settings.seed;
+}
+
+DeviceRef StackSimulator::addDevice(ObjectInstance instance, const std::string& name) {
+	DeviceRef device = new Device(instance, name);
+	// Give each device its own address on a simulated 10.0.0.0/8 network
+	device->setAddress(FC::StringAPrintf("10.%u.%u.%u", (instance >> 16) & 0xFF,
+			(instance >> 8) & 0xFF, instance & 0xFF), DeviceAddress::BacnetPort);
+	FC::MutexLock lock(_mutex);
+	_devices[instance] = device;
+	return device;
+}
+
+void StackSimulator::removeDevice(ObjectInstance instance) {
+	FC::MutexLock lock(_mutex);
+	_devices.erase(instance);
+}
+
+DeviceRef StackSimulator::getDevice(ObjectInstance instance) {
+	FC::MutexLock lock(_mutex);
+	auto it = _devices.find(instance);
+	return it != _devices.end() ? it->second : DeviceRef(0);
+}
+
+SimRequestRef StackSimulator::injectRead(dword oid, dword pid, dword aidx) {
+	SimRequestRef request = new SimRequest(SimRequest::Read, oid, pid, aidx);
+	FC::MutexLock lock(_mutex);
+	request->due = dueTime(Clock::now());
+	request->lost = isLost();
+	_incoming.push_back(request);
+	return request;
+}
+
+SimRequestRef StackSimulator::injectWrite(dword oid, dword pid, const BacnetValue& value,
+		byte priority, dword aidx) {
+	SimRequestRef request = new SimRequest(SimRequest::Write, oid, pid, aidx);
+	request->value = value.clone();
+	request->priority = priority;
+	FC::MutexLock lock(_mutex);
+	request->due = dueTime(Clock::now());
+	request->lost = isLost();
+	_incoming.push_back(request);
+	return request;
+}
+
+size_t StackSimulator::getInFlightCount() const {
+	FC::MutexLock lock(_mutex);
+	return _inFlight.size();
+}
+
+size_t StackSimulator::getDeferredCount() const {
+	FC::MutexLock lock(_mutex);
+	return _deferred.size();
+}
+
+void StackSimulator::startup() {
+	{
+		FC::MutexLock lock(_mutex);
+		_started = true;
+	}
+	// Like the real stack, read the local device information once started.  The stack
+	// keeps the strings given by the application, so does the simulator.
+	static frDevInfo info;
+	fraGetDeviceInfo(&info);
+}
+
+void StackSimulator::stop() {
+	FC::MutexLock lock(_mutex);
+	_started = false;
+	_inFlight.clear();
+	_incoming.clear();
+	_iAms.clear();
+}
+
+/**
+ * Deliver everything due
+ * The application callbacks are called without holding the simulator lock since
+ * they can send new requests.
+ */
+void StackSimulator::work() {
+	uint64_t now = Clock::now();
+	std::vector<frVbag*> responses;
+	std::vector<SimRequestRef> requests;
+	std::vector<DeviceRef> iAms;
+	{
+		FC::MutexLock lock(_mutex);
+		if (!_started) {
+			return;
+		}
+		auto it = _inFlight.begin();
+		while (it != _inFlight.end()) {
+			if (!it->lost && it->due <= now) {
+				serve(*it);
+				responses.push_back(it->bag);
+				it = _inFlight.erase(it);
+			} else if (it->lost && it->expire <= now) {
+				VsbConverter::toVbag(Error(ErrorClassEnum::Communication, ErrorCodeEnum::Timeout),
+						*it->bag);
+				it->bag->status = vbsComplete;
+				responses.push_back(it->bag);
+				_timeouts++;
+				it = _inFlight.erase(it);
+			} else {
+				++it;
+			}
+		}
+		auto rit = _incoming.begin();
+		while (rit != _incoming.end()) {
+			if ((*rit)->due <= now) {
+				if ((*rit)->lost) {
+					_lost++;
+					(*rit)->done = true;
+				} else {
+					requests.push_back(*rit);
+				}
+				rit = _incoming.erase(rit);
+			} else {
+				++rit;
+			}
+		}
+		while (!_iAms.empty() && _iAms.front().first <= now) {
+			auto dit = _devices.find(_iAms.front().second);
+			if (dit != _devices.end()) {
+				iAms.push_back(dit->second);
+			}
+			_iAms.pop_front();
+		}
+	}
+	for (size_t i = 0; i < responses.size(); i++) {
+		fraResponse(responses[i]);
+	}
+	for (size_t i = 0; i < requests.size(); i++) {
+		deliver(requests[i]);
+	}
+	for (size_t i = 0; i < iAms.size(); i++) {
+		sendIAm(*iAms[i]);
+	}
+}
+
+int StackSimulator::readProperty(dword device, dword oid, dword pid, dword aidx, frVbag* bag) {
+	FC::MutexLock lock(_mutex);
+	if (_devices.find(device) == _devices.end()) {
+		return toResult(Error(ErrorClassEnum::Communication, ErrorCodeEnum::UnknownDevice));
+	}
+	uint64_t now = Clock::now();
+	ClientRequest request = {SimRequest::Read, device, oid, pid, aidx, 0, bag, dueTime(now),
+			now + (uint64_t)_settings.timeoutMsec * 1000000ull, isLost()};
+	bag->status = vbsPending;
+	_inFlight.push_back(request);
+	_sent++;
+	if (request.lost) {
+		_lost++;
+	}
+	return 0;
+}
+
+int StackSimulator::writeProperty(dword device, dword oid, dword pid, dword aidx, frVbag* bag) {
+	FC::MutexLock lock(_mutex);
+	if (_devices.find(device) == _devices.end()) {
+		return toResult(Error(ErrorClassEnum::Communication, ErrorCodeEnum::UnknownDevice));
+	}
+	BacnetValueRef value = VsbConverter::fromVbag(*bag);
+	if (!value) {
+		return toResult(Error(ErrorClassEnum::Property, ErrorCodeEnum::DatatypeNotSupported));
+	}
+	uint64_t now = Clock::now();
+	ClientRequest request = {SimRequest::Write, device, oid, pid, aidx, value, bag, dueTime(now),
+			now + (uint64_t)_settings.timeoutMsec * 1000000ull, isLost()};
+	bag->status = vbsPending;
+	_inFlight.push_back(request);
+	_sent++;
+	if (request.lost) {
+		_lost++;
+	}
+	return 0;
+}
+
+void StackSimulator::whoIs(dword min, dword max) {
+	FC::MutexLock lock(_mutex);
+	uint64_t now = Clock::now();
+	auto it = _devices.lower_bound(min);
+	while (it != _devices.end() && it->first <= max) {
+		if (!isLost()) {
+			_iAms.push_back(std::make_pair(dueTime(now), it->first));
+		}
+		it++;
+	}
+}
+
+void StackSimulator::iHave() {
+	FC::MutexLock lock(_mutex);
+	_iHaves++;
+}
+
+#ifdef VSB_DEFERRED_RESPONSE
+int StackSimulator::completeDeferred(dword token, int result) {
+	SimRequestRef request;
+	{
+		FC::MutexLock lock(_mutex);
+		auto it = _deferred.find(token);
+		if (it == _deferred.end()) {
+			return toResult(Error(ErrorClassEnum::Services, ErrorCodeEnum::Other));
+		}
+		request = it->second;
+		_deferred.erase(it);
+	}
+	request->result = result;
+	__sync_synchronize();
+	request->done = true;
+	return 0;
+}
+#endif
+
+uint64_t StackSimulator::dueTime(uint64_t now) {
+	uint64_t delay = _settings.latencyUsec;
+	if (_settings.jitterUsec) {
+		delay += rand_r(&_random) % _settings.jitterUsec;
+	}
+	return now + delay * 1000ull;
+}
+
+bool StackSimulator::isLost() {
+	return _settings.lossRate > 0.0 &&
+			(double)rand_r(&_random) / RAND_MAX < _settings.lossRate;
+}
+
+/**
+ * Answer a client request from the remote device database
+ */
+void StackSimulator::serve(ClientRequest& request) {
+	frVbag& bag = *request.bag;
+	auto it = _devices.find(request.device);
+	ObjectRef obj;
+	BacnetValueRef value;
+	BacnetStatus status;
+	if (it == _devices.end()) {
+		VsbConverter::toVbag(Error(ErrorClassEnum::Communication, ErrorCodeEnum::Timeout), bag);
+	} else if (!it->second->resolveProperty(ObjectIdentifier(request.oid),
+			(PropertyIdentifierEnum::Enum)request.pid, obj, value)) {
+		VsbConverter::toVbag(Error(ErrorClassEnum::Property, ErrorCodeEnum::UnknownProperty), bag);
+	} else if (request.kind == SimRequest::Read) {
+		if (!VsbConverter::toVbag(*value, bag)) {
+			VsbConverter::toVbag(Error(ErrorClassEnum::Property,
+					ErrorCodeEnum::DatatypeNotSupported), bag);
+		}
+	} else if ((status = value->trySet(*request.value)).ok()) {
+		memset(&bag, 0, sizeof(frVbag));
+		bag.pdtype = adtSACK;
+	} else {
+		VsbConverter::toVbag(Error(status.eClass(), status.eCode()), bag);
+	}
+	bag.status = vbsComplete;
+}
+
+/**
+ * Call the application callback for a request of a simulated device
+ */
+void StackSimulator::deliver(const SimRequestRef& request) {
+	frVbag bag;
+	memset(&bag, 0, sizeof(frVbag));
+	if (request->kind == SimRequest::Read) {
+		dword nextpid = 0;
+		request->result = fraReadProperty(request->oid, request->pid, request->aidx, &bag, &nextpid);
+		if (request->result == 0) {
+			request->reply = VsbConverter::fromVbag(bag);
+		}
+	} else {
+		VsbConverter::toVbag(*request->value, bag);
+		bag.priority = request->priority;
+#ifdef VSB_DEFERRED_RESPONSE
+		{
+			FC::MutexLock lock(_mutex);
+			_currentToken = ++_nextToken;
+			request->token = _currentToken;
+		}
+		request->result = fraWriteProperty(request->oid, request->pid, request->aidx, &bag);
+		if (request->result == vsbDeferred) {
+			FC::MutexLock lock(_mutex);
+			request->deferred = true;
+			_deferred[request->token] = request;
+			return;
+		}
+#else
+		request->result = fraWriteProperty(request->oid, request->pid, request->aidx, &bag);
+#endif
+	}
+	__sync_synchronize();
+	request->done = true;
+}
+
+void StackSimulator::sendIAm(const Device& device) {
+	frBACnetdevice info;
+	memset(&info, 0, sizeof(info));
+	DeviceAddress::MacAddress mac = device.getAddress().getSourceMac();
+	info.src.snet.w = device.getNetwork();
+	info.src.slen = (byte)std::min(mac.size(), sizeof(info.src.sadr));
+	memcpy(info.src.sadr, &mac[0], info.src.slen);
+	info.devinst = device.getInstance();
+	info.maxlen = 1476;
+	Unsigned vendor;
+	if (device.getProperty(PropertyIdentifierEnum::VendorIdentifier, vendor, false)) {
+		info.vendorid = (word)vendor;
+	}
+	fraIAm(&info);
+}
+
+int StackSimulator::toResult(const Error& error) {
+	return VsbConverter::toError(error);
+}
+
+} // VIGBACNET
+
+using namespace VIGBACNET;
+
+/// Stack entry points, with the prototypes of vsbhp.h
+
+void bpublic frStartup(int) {
+	StackSimulator::instance().startup();
+}
+
+void bpublic frStop(int) {
+	StackSimulator::instance().stop();
+}
+
+void bpublic frMain(void) {
+	StackSimulator::instance().work();
+}
+
+void bpublic frWork(byte) {
+	// Timers are checked against the monotonic clock in frMain
+}
+
+int bpublic frcReadProperty(dword device, dword oid, dword pid, dword aidx, frVbag* bag) {
+	return StackSimulator::instance().readProperty(device, oid, pid, aidx, bag);
+}
+
+int bpublic frcWriteProperty(dword device, dword oid, dword pid, dword aidx, frVbag* bag) {
+	return StackSimulator::instance().writeProperty(device, oid, pid, aidx, bag);
+}
+
+void bpublic frcForceRangeWhoIs(dword min, dword max) {
+	StackSimulator::instance().whoIs(min, max);
+}
+
+void bpublic frTransmitIHave(word, dword, frString*) {
+	StackSimulator::instance().iHave();
+}
+
+#ifdef VSB_DEFERRED_RESPONSE
+dword bpublic frDeferredToken(void) {
+	return StackSimulator::instance().deferredToken();
+}
+
+int bpublic frcCompleteDeferred(dword token, int result) {
+	return StackSimulator::instance().completeDeferred(token, result);
+}
+#endif
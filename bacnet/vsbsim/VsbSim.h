@@ -0,0 +1,170 @@
+/*
+ * VsbSim.h
+ *
+ * Copyright (c) 2012 Vigilent Corporation.  All Rights Reserved.
+ */
+
+#ifndef VsbSim_h
+#define VsbSim_h
+
+#include <deque>
+#include "fc.h"
+#include "vsbhp.h"
+#include "BacnetDevice.h"
+#include "BacnetClock.h"
+#include "BacnetStackExt.h"
+
+namespace VIGBACNET {
+
+/**
+ * Behavior of the simulated network
+ * Every message, request or response, is delayed by {latencyUsec} plus a random
+ * part up to {jitterUsec} and lost with a probability of {lossRate}.  A client
+ * request without response is completed with a timeout error after {timeoutMsec}.
+ */
+struct SimSettings {
+	SimSettings() :
+		latencyUsec(0), jitterUsec(0), lossRate(0.0), timeoutMsec(3000), seed(1) {
+	}
+
+	uint32_t latencyUsec;
+	uint32_t jitterUsec;
+	double lossRate;
+	uint32_t timeoutMsec;
+	unsigned seed;
+};
+
+/**
+ * Request sent to the local server by a simulated device
+ * It is filled once the server answered: {result} is the fra callback return value
+ * and {reply} the value read.  A lost request is marked done without being served.
+ */
+class SimRequest : public FC::RefObject {
+public:
+	enum Kind {
+		Read,
+		Write,
+	};
+
+	SimRequest(Kind k, dword objId, dword propId, dword idx) :
+		kind(k), oid(objId), pid(propId), aidx(idx), priority(0), done(false), lost(false),
+		deferred(false), token(0), result(0), due(0) {
+	}
+
+	Kind kind;
+	dword oid;
+	dword pid;
+	dword aidx;
+	BacnetValueRef value;
+	byte priority;
+	volatile bool done;
+	bool lost;
+	bool deferred;
+	dword token;
+	int result;
+	BacnetValueRef reply;
+	uint64_t due;
+};
+typedef FC::Ref<SimRequest> SimRequestRef;
+
+/**
+ * In-process replacement of the VSB stack
+ * Linking with libvsbsim instead of libvsb provides the stack entry points used by
+ * the server.  Remote devices are VIGBACNET::Device objects held by the simulator:
+ * client requests are served from their object database after the simulated
+ * latency, and the devices can send requests to the local server.  Everything the
+ * server receives is delivered from frMain, like the real stack does.
+ */
+class StackSimulator {
+public:
+	static StackSimulator& instance();
+
+	void configure(const SimSettings& settings);
+
+	/**
+	 * Add a remote device, objects can then be added to the returned device
+	 */
+	DeviceRef addDevice(ObjectInstance instance, const std::string& name = "");
+	void removeDevice(ObjectInstance instance);
+	DeviceRef getDevice(ObjectInstance instance);
+
+	/**
+	 * Send a request to the local server from a simulated device
+	 */
+	SimRequestRef injectRead(dword oid, dword pid, dword aidx = 0xFFFFFFFFu);
+	SimRequestRef injectWrite(dword oid, dword pid, const BacnetValue& value, byte priority = 0,
+			dword aidx = 0xFFFFFFFFu);
+
+	bool isStarted() const { return _started; }
+	// Client requests waiting for their response
+	size_t getInFlightCount() const;
+	// Server requests the server kept pending with a deferred response
+	size_t getDeferredCount() const;
+	uint64_t getSentCount() const { return _sent; }
+	uint64_t getLostCount() const { return _lost; }
+	uint64_t getTimeoutCount() const { return _timeouts; }
+	uint64_t getIHaveCount() const { return _iHaves; }
+
+	// Stack entry points
+	void startup();
+	void stop();
+	void work();
+	int readProperty(dword device, dword oid, dword pid, dword aidx, frVbag* bag);
+	int writeProperty(dword device, dword oid, dword pid, dword aidx, frVbag* bag);
+	void whoIs(dword min, dword max);
+	void iHave();
+#ifdef VSB_DEFERRED_RESPONSE
+	dword deferredToken() const { return _currentToken; }
+	int completeDeferred(dword token, int result);
+#endif
+
+private:
+	StackSimulator();
+	StackSimulator(const StackSimulator&);
+	StackSimulator& operator=(const StackSimulator&);
+
+	struct ClientRequest {
+		SimRequest::Kind kind;
+		dword device;
+		dword oid;
+		dword pid;
+		dword aidx;
+		BacnetValueRef value;
+		frVbag* bag;
+		uint64_t due;
+		uint64_t expire;
+		bool lost;
+	};
+
+	uint64_t dueTime(uint64_t now);
+	bool isLost();
+	void serve(ClientRequest& request);
+	void deliver(const SimRequestRef& request);
+	void sendIAm(const Device& device);
+	static int toResult(const Error& error);
+
+	typedef std::map<ObjectInstance, DeviceRef> DeviceMap;
+	typedef std::deque<ClientRequest> ClientRequestList;
+	typedef std::deque<SimRequestRef> SimRequestList;
+	typedef std::map<dword, SimRequestRef> DeferredMap;
+
+	mutable FC::Mutex _mutex;
+	SimSettings _settings;
+	unsigned _random;
+	bool _started;
+	DeviceMap _devices;
+	ClientRequestList _inFlight;
+	SimRequestList _incoming;
+	std::deque<std::pair<uint64_t, ObjectInstance> > _iAms;
+	DeferredMap _deferred;
+	dword _nextToken;
+	dword _currentToken;
+	uint64_t _sent;
+	uint64_t _lost;
+	uint64_t _timeouts;
+	uint64_t _iHaves;
+};
+
+} // VIGBACNET
+
+#endif /* VSBSIM_H_ */